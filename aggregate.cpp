@@ -0,0 +1,177 @@
+/*
+ * Aggregation of fast samples into one report per window.
+ *
+ * A noisy signal (current, flow, light) wants sampling several times a
+ * second, but gnhastd only needs to hear about it once a minute or so.
+ * An aggregated device takes every store_data_dev() into a running min,
+ * max, sum and last, in constant memory, and gn_update_device() on it does
+ * nothing.  When its window closes, handle() stores the chosen statistic
+ * into the device and sends it, subject to the usual reporting policy.
+ * Other statistics of the same window can go to derived devices (a
+ * "current max" device beside "current", say) built by the sketch and
+ * hooked up with add_agg_output().
+ */
+
+#include "gnhast_async.h"
+
+/*
+ * The aggregation slot of dev, NULL if it has none
+ */
+
+gn_agg_t *gnhast::_agg_find(int dev)
+{
+    int i;
+
+    for (i=0; i < GN_MAX_AGG; i++)
+	if (_agg[i].dev == dev)
+	    return &_agg[i];
+    return NULL;
+}
+
+/*!
+ * @brief Aggregate the samples of dev over window ms, and report stat
+ * (enum gn_agg_stat) of each window as its value.  A window of 0 turns
+ * aggregation off again.  Returns false if there are already GN_MAX_AGG
+ * aggregated devices.
+ */
+
+bool gnhast::set_dev_aggregate(int dev, uint32_t window, int stat)
+{
+    gn_agg_t *a = _agg_find(dev);
+    int i;
+
+    if (window == 0) {
+	if (a)
+	    a->dev = -1;
+	_devices[dev].flags &= ~GN_DEV_AGG;
+	return true;
+    }
+    if (stat < 0 || stat >= GN_AGG_NSTATS)
+	return false;
+    if (a == NULL)
+	a = _agg_find(-1);
+    if (a == NULL) {
+	Serial.println("Too many aggregated devices, increase GN_MAX_AGG");
+	return false;
+    }
+    a->dev = dev;
+    for (i=0; i < GN_AGG_NSTATS; i++)
+	a->out[i] = -1;
+    a->out[stat] = dev;
+    a->window = window;
+    a->n = 0;
+    _devices[dev].flags |= GN_DEV_AGG;
+    return true;
+}
+
+/*!
+ * @brief Also report stat (enum gn_agg_stat) of each window of dev, as
+ * the value of device outdev
+ */
+
+bool gnhast::add_agg_output(int dev, int stat, int outdev)
+{
+    gn_agg_t *a = _agg_find(dev);
+
+    if (a == NULL || stat < 0 || stat >= GN_AGG_NSTATS ||
+	outdev < 0 || outdev >= _nrofdevs ||
+	(_devices[outdev].flags & GN_DEV_AGG))
+	return false;
+    a->out[stat] = outdev;
+    return true;
+}
+
+/*
+ * Take a sample into the running statistics
+ */
+
+void gnhast::_agg_add(int dev, gn_data_t data)
+{
+    gn_agg_t *a = _agg_find(dev);
+    double v;
+
+    if (a == NULL)
+	return;
+    switch (_devices[dev].datatype) {
+    case DATATYPE_UINT:
+	v = data.u;
+	break;
+    case DATATYPE_LL:
+	v = data.u64;
+	break;
+    default:
+	v = data.d;
+	break;
+    }
+    if (a->n == 0) {
+	a->start = millis();
+	a->min = a->max = a->sum = v;
+    } else {
+	if (v < a->min)
+	    a->min = v;
+	if (v > a->max)
+	    a->max = v;
+	a->sum += v;
+    }
+    a->last = v;
+    a->n++;
+}
+
+/*
+ * Close the windows that are done, and report them, from handle()
+ */
+
+void gnhast::_agg_run(uint32_t now)
+{
+    gn_agg_t *a;
+    gn_data_t data;
+    double v;
+    int i, s, out;
+
+    for (i=0; i < GN_MAX_AGG; i++) {
+	a = &_agg[i];
+	if (a->dev < 0 || a->n == 0 || now - a->start < a->window)
+	    continue;
+
+	_tx_hold = true;
+	for (s=0; s < GN_AGG_NSTATS; s++) {
+	    out = a->out[s];
+	    if (out < 0)
+		continue;
+	    switch (s) {
+	    case GN_AGG_MEAN:
+		v = a->sum / a->n;
+		break;
+	    case GN_AGG_MIN:
+		v = a->min;
+		break;
+	    case GN_AGG_MAX:
+		v = a->max;
+		break;
+	    default:
+		v = a->last;
+		break;
+	    }
+	    switch (_devices[out].datatype) {
+	    case DATATYPE_UINT:
+		data.u = (uint32_t)(v + 0.5);
+		break;
+	    case DATATYPE_LL:
+		data.u64 = (uint64_t)(v + 0.5);
+		break;
+	    default:
+		data.d = v;
+		break;
+	    }
+	    _gn_store(out, data);
+	    _gn_update(out);
+	}
+	_tx_hold = false;
+	_tx_drain();
+	if (_debug)
+	    Serial.printf("Device #%d window of %u samples closed\n", a->dev,
+			  (unsigned)a->n);
+	/* the next window opens with its first sample */
+	a->n = 0;
+    }
+}
@@ -0,0 +1,192 @@
+/*
+ * Binary config blob, built with GN_CFG_BINARY.
+ *
+ * Holds everything in the two json config files, in one file that is
+ * loaded with a single read and checked with a crc16, no json parser
+ * involved, so a battery node gets to its first upd sooner.  Layout:
+ *
+ *	gn_cfgblob_hdr_t
+ *	server\0 collector_name\0
+ *	nnames times: uid\0 name\0
+ *
+ * Bump GN_CFG_BLOB_VERSION if that changes, an old blob is then ignored
+ * and the json files imported again.
+ */
+
+#include "gnhast_async.h"
+
+#define GN_CFG_BLOB_MAGIC 0x46434E47 /* "GNCF" */
+#define GN_CFG_BLOB_VERSION 1
+
+typedef struct _gn_cfgblob_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t len; /* bytes after the header */
+    uint16_t crc; /* crc16 of port, instance, nnames and the strings */
+    uint16_t port;
+    uint16_t instance;
+    uint16_t nnames;
+} gn_cfgblob_hdr_t;
+
+/*
+ * The crc of a blob
+ */
+
+static uint16_t blob_crc(gn_cfgblob_hdr_t *hdr)
+{
+    uint16_t crc;
+
+    crc = gn_crc16(&hdr->port, sizeof(*hdr) - offsetof(gn_cfgblob_hdr_t, port));
+    return gn_crc16(hdr + 1, hdr->len, crc);
+}
+
+/*
+ * Next NUL terminated string in the blob, NULL if it runs off the end
+ */
+
+static const char *blob_str(const uint8_t **p, const uint8_t *end)
+{
+    const char *s = (const char *)*p;
+    const uint8_t *nul = (const uint8_t *)memchr(*p, '\0', end - *p);
+
+    if (nul == NULL)
+	return NULL;
+    *p = nul + 1;
+    return s;
+}
+
+/*
+ * Load the cache from the blob.  Returns false if there is none, or it is
+ * damaged, or from another version.
+ */
+
+bool gnhast::_cfg_blob_load()
+{
+    gn_cfgblob_hdr_t *hdr;
+    const uint8_t *p, *end;
+    const char *server, *uid, *name;
+    uint8_t *buf;
+    size_t size;
+    File f;
+    bool ok = false;
+    int i;
+    uint32_t start = micros();
+
+    if (!_fs_mount() || !SPIFFS.exists(GN_CFG_BLOB_FILE))
+	return false;
+    f = SPIFFS.open(GN_CFG_BLOB_FILE, "r");
+    if (!f)
+	return false;
+    size = f.size();
+    if (size < sizeof(gn_cfgblob_hdr_t) || size > GN_CFG_BLOB_MAX) {
+	f.close();
+	Serial.println("Config blob has a bad size");
+	return false;
+    }
+    buf = (uint8_t *)malloc(size);
+    if (buf == NULL) {
+	f.close();
+	return false;
+    }
+    if (f.read(buf, size) != size) {
+	Serial.println("Short read of config blob");
+	goto out;
+    }
+
+    hdr = (gn_cfgblob_hdr_t *)buf;
+    p = buf + sizeof(*hdr);
+    end = buf + size;
+    if (hdr->magic != GN_CFG_BLOB_MAGIC ||
+	hdr->version != GN_CFG_BLOB_VERSION ||
+	hdr->len != size - sizeof(*hdr) ||
+	hdr->crc != blob_crc(hdr)) {
+	Serial.println("Config blob is damaged or too old, ignoring it");
+	goto out;
+    }
+
+    /* collector name and instance are the sketch's to pick, skip them */
+    server = blob_str(&p, end);
+    if (server == NULL || blob_str(&p, end) == NULL)
+	goto out;
+    snprintf(_gnhast_server, sizeof(_gnhast_server), "%s", server);
+    snprintf(_gnhast_port_str, sizeof(_gnhast_port_str), "%u",
+	     (unsigned)hdr->port);
+    for (i=0; i < hdr->nnames; i++) {
+	uid = blob_str(&p, end);
+	name = blob_str(&p, end);
+	if (uid == NULL || name == NULL)
+	    goto out;
+	_cfg_set_name(uid, name);
+    }
+    _cfg_blob_crc = hdr->crc;
+    ok = true;
+    _perf_sample(&_perf.parse_us, micros() - start);
+out:
+    free(buf);
+    f.close();
+    return ok;
+}
+
+/*
+ * Write the cache out as a blob, if it changed
+ */
+
+void gnhast::_cfg_blob_write()
+{
+    gn_cfgblob_hdr_t *hdr;
+    uint8_t *buf, *p;
+    size_t size, len;
+    char tmp[32];
+    File f;
+    int i;
+
+    size = sizeof(*hdr) + strlen(_gnhast_server) + 1 +
+	strlen(_collector_name) + 1;
+    for (i=0; i < _cfg_nnames; i++)
+	size += strlen(_cfg_names[i].uid) + strlen(_cfg_names[i].name) + 2;
+    if (size > GN_CFG_BLOB_MAX) {
+	Serial.println("Config too big for the blob, not saved");
+	return;
+    }
+    buf = (uint8_t *)malloc(size);
+    if (buf == NULL)
+	return;
+
+    p = buf + sizeof(*hdr);
+#define BLOB_PUT(s) do { len = strlen(s) + 1; memcpy(p, s, len); p += len; } while (0)
+    BLOB_PUT(_gnhast_server);
+    BLOB_PUT(_collector_name);
+    for (i=0; i < _cfg_nnames; i++) {
+	BLOB_PUT(_cfg_names[i].uid);
+	BLOB_PUT(_cfg_names[i].name);
+    }
+#undef BLOB_PUT
+
+    hdr = (gn_cfgblob_hdr_t *)buf;
+    hdr->magic = GN_CFG_BLOB_MAGIC;
+    hdr->version = GN_CFG_BLOB_VERSION;
+    hdr->len = size - sizeof(*hdr);
+    hdr->port = atoi(_gnhast_port_str);
+    hdr->instance = _instance;
+    hdr->nnames = _cfg_nnames;
+    hdr->crc = blob_crc(hdr);
+    if (hdr->crc == _cfg_blob_crc) {
+	free(buf);
+	return;
+    }
+
+    Serial.println("saving config blob");
+    snprintf(tmp, sizeof(tmp), "%s.tmp", GN_CFG_BLOB_FILE);
+    if (_fs_mount() && (f = SPIFFS.open(tmp, "w"))) {
+	if (f.write(buf, size) == size) {
+	    f.close();
+	    if (_cfg_replace(GN_CFG_BLOB_FILE))
+		_cfg_blob_crc = hdr->crc;
+	} else {
+	    Serial.println("Short write of config blob");
+	    f.close();
+	}
+    } else
+	Serial.println("failed to open config blob for writing");
+    free(buf);
+}
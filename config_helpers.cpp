@@ -1,22 +1,80 @@
 /*
  * Gnhast config file helper routines
+ *
+ * Both config files, /config.json (server settings) and /gnhast.json
+ * (collector name, instance and device names), are read once, on first
+ * use, into a small cache.  Changes are made to the cache, and written
+ * back lazily from handle(), GN_CFG_WRITE_DELAY ms after the last one, so
+ * a burst of web renames costs one write.  A file is only rewritten when
+ * its contents changed (crc16 of the serialized json), and always to a
+ * temp file first, renamed over the old one, so a reset mid write never
+ * leaves a truncated config.
+ *
+ * Built with GN_CFG_BINARY, the cache lives in one binary blob instead
+ * (config_blob.cpp), and the json files are only imported once, if there
+ * is no blob yet.  Either way config_export() and config_import() move
+ * the whole config as json, for the web UI.
  */
 
 #include "gnhast_async.h"
 
+/*
+ * Mount SPIFFS, if it is not already
+ */
+
+bool gnhast::_fs_mount()
+{
+    if (!_fs_mounted) {
+	_boot_begin(GN_BOOT_FSMOUNT);
+	_fs_mounted = SPIFFS.begin();
+	_boot_end(GN_BOOT_FSMOUNT);
+    }
+    return _fs_mounted;
+}
+
+/* the cached config files */
+static const char *gn_cfg_files[GN_CFG_NFILES] = {
+    "/config.json",
+    "/gnhast.json",
+};
+
+/*
+ * A Print that only computes the crc16 of what is written to it
+ */
+
+class gn_crcprint : public Print {
+ public:
+    uint16_t crc = 0xFFFF;
+    size_t write(uint8_t c) { crc = gn_crc16(&c, 1, crc); return 1; }
+    size_t write(const uint8_t *buf, size_t len) {
+	crc = gn_crc16(buf, len, crc);
+	return len;
+    }
+};
+
+static uint16_t gn_json_crc(DynamicJsonDocument &doc)
+{
+    gn_crcprint cp;
+
+    serializeJson(doc, cp);
+    return cp.crc;
+}
+
+/*!
+ * @brief Parse a json file from SPIFFS.  The gnhast config files are
+ * cached, use read_gnhast_config() or config_dev_name() for those.
+ */
+
 DynamicJsonDocument gnhast::parse_json_conf(char *filename)
 {
     DynamicJsonDocument json_doc(JSON_CONFIG_FILE_SIZE);
     DeserializationError j_error;
     File configFile;
-    
-    if (_debug)
-	Serial.println("mounting FS...");
-    if (SPIFFS.begin()) {
-	if (_debug) {
-	    Serial.println("mounted file system");
+    uint32_t start = micros();
+
+    if (_fs_mount()) {
+	if (_debug)
 	    Serial.printf("Searching for %s\n", filename);
-	}
 
 	if (SPIFFS.exists(filename)) {
 	    configFile = SPIFFS.open(filename, "r");
@@ -42,50 +100,318 @@ DynamicJsonDocument gnhast::parse_json_conf(char *filename)
     } else {
 	Serial.println("failed to mount FS");
     }
+    _perf_sample(&_perf.parse_us, micros() - start);
     return(json_doc);
 }
 
 /*
- * Parse the gnhast config
+ * Set the cached name for a uid
+ */
+
+void gnhast::_cfg_set_name(const char *uid, const char *name)
+{
+    int i;
+
+    for (i=0; i < _cfg_nnames; i++)
+	if (strcmp(_cfg_names[i].uid, uid) == 0)
+	    break;
+    if (i == _cfg_nnames) {
+	if (i == gn_MAX_DEVICES)
+	    return;
+	_cfg_names[i].uid = strdup(uid);
+	_cfg_names[i].name = NULL;
+	_cfg_nnames++;
+    } else if (strcmp(_cfg_names[i].name, name) == 0)
+	return;
+    free(_cfg_names[i].name);
+    _cfg_names[i].name = strdup(name);
+}
+
+/*
+ * Read both config files into the cache, the first time we need them.
+ * A temp file without its config means we died mid write, before the
+ * rename, the temp file is complete so use it.
+ */
+
+void gnhast::_cfg_load()
+{
+    if (_cfg_loaded)
+	return;
+    _cfg_loaded = true;
+    _boot_begin(GN_BOOT_CONFIG);
+
+#if GN_CFG_BINARY
+    _cfg_recover(GN_CFG_BLOB_FILE);
+    if (!_cfg_blob_load()) {
+	Serial.println("No config blob, importing json config");
+	_cfg_load_json();
+	/* written as a blob by the next config_commit() */
+	_cfg_touch(GN_CFG_GNHAST);
+    }
+#else
+    _cfg_load_json();
+#endif
+    _boot_end(GN_BOOT_CONFIG);
+}
+
+/*
+ * A temp file without its config means we died mid write, before the
+ * rename.  The temp file is complete, so use it.
+ */
+
+void gnhast::_cfg_recover(const char *path)
+{
+    char tmp[32];
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (_fs_mount() && !SPIFFS.exists(path) && SPIFFS.exists(tmp))
+	SPIFFS.rename(tmp, path);
+}
+
+/*
+ * Move a freshly written temp file over path
+ */
+
+bool gnhast::_cfg_replace(const char *path)
+{
+    char tmp[32];
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    /* SPIFFS will not rename over an existing file */
+    SPIFFS.remove(path);
+    if (!SPIFFS.rename(tmp, path)) {
+	Serial.println("failed to rename config file into place");
+	return false;
+    }
+    return true;
+}
+
+/*
+ * Read both json config files into the cache
+ */
+
+void gnhast::_cfg_load_json()
+{
+    int i;
+
+    for (i=0; i < GN_CFG_NFILES; i++)
+	_cfg_recover(gn_cfg_files[i]);
+
+    {
+	DynamicJsonDocument doc = parse_json_conf((char *)gn_cfg_files[GN_CFG_SETTINGS]);
+
+	_cfg_crc[GN_CFG_SETTINGS] = gn_json_crc(doc);
+	if (doc["gnhast_server"] && doc["gnhast_port"]) {
+	    snprintf(_gnhast_server, sizeof(_gnhast_server), "%s",
+		     (const char *)doc["gnhast_server"]);
+	    snprintf(_gnhast_port_str, sizeof(_gnhast_port_str), "%s",
+		     (const char *)doc["gnhast_port"]);
+	}
+    }
+    {
+	DynamicJsonDocument doc = parse_json_conf((char *)gn_cfg_files[GN_CFG_GNHAST]);
+	JsonObject root = doc.as<JsonObject>();
+
+	_cfg_crc[GN_CFG_GNHAST] = gn_json_crc(doc);
+	for (JsonPair kv : root) {
+	    const char *name = kv.value()["name"];
+	    if (name)
+		_cfg_set_name(kv.key().c_str(), name);
+	}
+    }
+}
+
+/*
+ * Build the json for one config file from the cache
+ */
+
+void gnhast::_cfg_build(int which, DynamicJsonDocument &doc)
+{
+    int i;
+
+    if (which == GN_CFG_SETTINGS) {
+	doc["gnhast_server"] = _gnhast_server;
+	doc["gnhast_port"] = _gnhast_port_str;
+	return;
+    }
+    for (i=0; i < _cfg_nnames; i++)
+	doc[_cfg_names[i].uid]["name"] = _cfg_names[i].name;
+    doc["collector_name"] = _collector_name;
+    doc["instance"] = _instance;
+}
+
+/*
+ * Write one config file, if it changed.  Written to a temp file, then
+ * renamed over the old one.
+ */
+
+void gnhast::_cfg_write(int which)
+{
+    DynamicJsonDocument json_doc(JSON_CONFIG_FILE_SIZE);
+    uint16_t crc;
+    char tmp[32];
+    File configFile;
+
+    _cfg_build(which, json_doc);
+    crc = gn_json_crc(json_doc);
+    if (crc == _cfg_crc[which])
+	return;
+
+    Serial.printf("saving config %s\n", gn_cfg_files[which]);
+    if (!_fs_mount())
+	return;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", gn_cfg_files[which]);
+    configFile = SPIFFS.open(tmp, "w");
+    if (!configFile) {
+	Serial.println("failed to open config file for writing");
+	return;
+    }
+    if (_debug) {
+	serializeJson(json_doc, Serial);
+	Serial.println();
+    }
+    serializeJson(json_doc, configFile);
+    configFile.close();
+    if (!_cfg_replace(gn_cfg_files[which]))
+	return;
+    _cfg_crc[which] = crc;
+}
+
+/*
+ * Note that a config file needs writing, handle() will get to it
+ */
+
+void gnhast::_cfg_touch(int which)
+{
+    _cfg_dirty |= (1 << which);
+    _cfg_due = millis() + GN_CFG_WRITE_DELAY;
+}
+
+/*!
+ * @brief Write any pending config changes now, rather than waiting for
+ * handle() to get to them.  Call before a planned reboot.
+ */
+
+void gnhast::config_commit()
+{
+    uint32_t start;
+
+    _cfg_load();
+    if (_cfg_dirty == 0)
+	return;
+    start = micros();
+#if GN_CFG_BINARY
+    _cfg_blob_write();
+#else
+    for (int i=0; i < GN_CFG_NFILES; i++)
+	if (_cfg_dirty & (1 << i))
+	    _cfg_write(i);
+#endif
+    _cfg_dirty = 0;
+    _perf_sample(&_perf.commit_us, micros() - start);
+}
+
+/*!
+ * @brief The name saved in the config for uid, or NULL if there is none
+ */
+
+const char *gnhast::config_dev_name(const char *uid)
+{
+    int i;
+
+    _cfg_load();
+    for (i=0; i < _cfg_nnames; i++)
+	if (strcmp(_cfg_names[i].uid, uid) == 0)
+	    return _cfg_names[i].name;
+    return NULL;
+}
+
+/*
+ * Parse the gnhast config.  Built from the cache, the file is only read
+ * once.
  */
 
 DynamicJsonDocument gnhast::read_gnhast_config()
 {
-    DynamicJsonDocument doc = parse_json_conf("/gnhast.json");
- 
+    DynamicJsonDocument doc(JSON_CONFIG_FILE_SIZE);
+
+    _cfg_load();
+    _cfg_build(GN_CFG_GNHAST, doc);
     return(doc);
 }
 
 /*
- * Save gnhast config
+ * Save gnhast config.  Only updates the cache, the file is written later,
+ * and only if something changed.
  */
 void gnhast::save_gnhast_config()
 {
-    DynamicJsonDocument json_doc(JSON_CONFIG_FILE_SIZE);
     gn_dev_t *dev;
     int i;
-	
-    Serial.println("saving gnhast config");
 
+    _cfg_load();
     for (i=0; i < gn_MAX_DEVICES; i++) {
 	dev = get_dev_byindex(i);
 	if (dev == NULL)
 	    continue;
-	json_doc[dev->uid]["name"] = dev->name;
+	_cfg_set_name(dev->uid, dev->name);
     }
+    _cfg_touch(GN_CFG_GNHAST);
+}
 
-    json_doc["collector_name"] = _collector_name;
-    json_doc["instance"] = _instance;
-    
-    File configFile = SPIFFS.open("/gnhast.json", "w");
-    if (!configFile) {
-	Serial.println("failed to open gnhast config file for writing");
-    }
+/*!
+ * @brief Write the whole config, settings and device names, as one json
+ * object.  Used by the web UI to back up or clone a collector.
+ */
 
-    if (is_debug()) {
-	serializeJson(json_doc, Serial);
-	Serial.println();
+void gnhast::config_export(Print &out)
+{
+    DynamicJsonDocument doc(JSON_CONFIG_FILE_SIZE);
+
+    _cfg_load();
+    _cfg_build(GN_CFG_SETTINGS, doc);
+    _cfg_build(GN_CFG_GNHAST, doc);
+    serializeJson(doc, out);
+}
+
+/*!
+ * @brief Load config from json, in the config_export() format, or either
+ * of the old config files.  Renamed devices are renamed in gnhastd too.
+ * Returns false if the json does not parse.
+ */
+
+bool gnhast::config_import(const char *json)
+{
+    DynamicJsonDocument doc(JSON_CONFIG_FILE_SIZE);
+    JsonObject root;
+    const char *name;
+    int dev;
+
+    if (deserializeJson(doc, json)) {
+	Serial.println("Cannot parse imported config");
+	return false;
     }
-    serializeJson(json_doc, configFile);
-    configFile.close();
+    _cfg_load();
+    if (doc["gnhast_server"] && doc["gnhast_port"]) {
+	snprintf(_gnhast_server, sizeof(_gnhast_server), "%s",
+		 (const char *)doc["gnhast_server"]);
+	snprintf(_gnhast_port_str, sizeof(_gnhast_port_str), "%s",
+		 (const char *)doc["gnhast_port"]);
+	_cfg_touch(GN_CFG_SETTINGS);
+    }
+    root = doc.as<JsonObject>();
+    for (JsonPair kv : root) {
+	name = kv.value()["name"];
+	if (name == NULL)
+	    continue;
+	_cfg_set_name(kv.key().c_str(), name);
+	dev = find_dev_byuid((char *)kv.key().c_str());
+	if (dev >= 0 && strcmp(_devices[dev].name, name) != 0) {
+	    free(_devices[dev].name);
+	    _devices[dev].name = strdup(name);
+	    gn_mod_name(dev);
+	}
+    }
+    _cfg_touch(GN_CFG_GNHAST);
+    return true;
 }
@@ -0,0 +1,329 @@
+/*
+ * Connection to gnhastd.
+ *
+ * A small state machine, driven by the AsyncClient callbacks and by
+ * handle(), which the sketch calls from loop().  Connecting never blocks.
+ * Failed or dropped connections are retried with exponential backoff plus
+ * random jitter, so a whole fleet does not come back in lockstep when
+ * gnhastd restarts.  Once gnhastd has pinged us, going GN_PING_TIMEOUT
+ * without a ping means the peer is dead, and we reconnect.  Every connect
+ * replays the client line and the reg of every registered device, then
+ * any updates queued while we were away (see pending_queue.cpp).
+ */
+
+#include "gnhast_async.h"
+
+/*
+ * Just tell gnhast about our collector name
+ */
+
+void gnhast::__gn_client()
+{
+    _ln_begin();
+    _ln_put("client client:", 14);
+    _ln_puts(_collector_name);
+    _ln_putc('-');
+    _ln_putu(_instance, 3);
+    _ln_end();
+}
+
+/*!
+ * @brief Where the connection to gnhastd is at, see enum gn_conn_state
+ */
+
+int gnhast::conn_state()
+{
+    return _conn_state;
+}
+
+/*!
+ * @brief Connect to gnhastd, initiate collector
+ * The connect itself is asynchronous, the client line and the reg of every
+ * registered device are sent once it is up.  If it fails, it is retried
+ * from handle().  Returns false only if the attempt could not be started.
+ */
+
+bool gnhast::connect()
+{
+    if (_conn_state == GN_CONN_UP || _conn_state == GN_CONN_CONNECTING)
+	return true;
+    _boot_begin(GN_BOOT_CONNECT);
+    _conn_backoff = GN_BACKOFF_MIN;
+    return _gn_conn_start();
+}
+
+/*!
+ * @brief Disconnect from gnhast nicely, and stop reconnecting
+ */
+
+void gnhast::disconnect()
+{
+    int state = _conn_state;
+
+    if (_debug)
+	Serial.println("Requesting disconnect from gnhastd");
+    _conn_state = GN_CONN_IDLE;
+    if (state == GN_CONN_UP) {
+	_tx_line("disconnect");
+	_tx_closing = true;
+	_tx_drain();
+    } else if (state == GN_CONN_CONNECTING)
+	client->close(true);
+}
+
+/*!
+ * @brief Run the connection state machine and the sensor scheduler,
+ * call this from loop()
+ */
+
+void gnhast::handle()
+{
+    uint32_t now = millis();
+
+    if (_cfg_dirty && (int32_t)(now - _cfg_due) >= 0)
+	config_commit();
+    _wifi_poll(now);
+    _spsc_drain();
+    _sensor_run(now);
+    _agg_run(now);
+
+    switch (_conn_state) {
+    case GN_CONN_BACKOFF:
+	/* look gnhastd up while we wait, the query is kept short */
+	if (_disc_want)
+	    _disc_lookup();
+	else if ((int32_t)(now - _conn_next) >= 0)
+	    _gn_conn_start();
+	break;
+    case GN_CONN_CONNECTING:
+	if (now - _conn_started > GN_CONNECT_TIMEOUT) {
+	    Serial.println("Timed out connecting to gnhastd");
+	    client->close(true);
+	    /* no pcb yet (still resolving) means no callback */
+	    if (_conn_state == GN_CONN_CONNECTING)
+		_gn_conn_retry();
+	}
+	break;
+    case GN_CONN_UP:
+	_gn_pump();
+	_srv_probe(now);
+	_srv_forgive(now);
+	/* signed, _last_ping is odd so can be a ms ahead of now */
+	if (_last_ping &&
+	    (int32_t)(now - _last_ping) > (int32_t)GN_PING_TIMEOUT) {
+	    Serial.println("gnhastd stopped pinging us, reconnecting");
+	    client->close(true);
+	    if (_conn_state == GN_CONN_UP) {
+		_tx_reset();
+		_gn_conn_retry();
+	    }
+	}
+	break;
+    }
+}
+
+/*
+ * Start a connection attempt
+ */
+
+bool gnhast::_gn_conn_start()
+{
+    IPAddress ip;
+    bool ok;
+
+    /* no point before the wifi is up, try again as soon as it is */
+    if (!_wifi_ready()) {
+	_conn_state = GN_CONN_BACKOFF;
+	_conn_next = millis();
+	return true;
+    }
+
+    if (!client) {
+	if (_debug)
+	    Serial.println("Allocating new client.");
+	client = new AsyncClient();
+	if (!client) {
+	    Serial.println("Could not allocate client!");
+	    _gn_conn_retry();
+	    return false;
+	}
+	/* we do our own coalescing in the tx buffer */
+	client->setNoDelay(true);
+	client->onConnect(std::bind(&gnhast::__gn_connected, this,
+				    std::placeholders::_1,
+				    std::placeholders::_2), NULL);
+	client->onDisconnect(std::bind(&gnhast::__gn_disconnected, this,
+				       std::placeholders::_1,
+				       std::placeholders::_2), NULL);
+	client->onAck(std::bind(&gnhast::__gn_gotack, this,
+				std::placeholders::_1,
+				std::placeholders::_2,
+				std::placeholders::_3,
+				std::placeholders::_4), NULL);
+	client->onData(std::bind(&gnhast::__gn_gotdata, this,
+				 std::placeholders::_1,
+				 std::placeholders::_2,
+				 std::placeholders::_3,
+				 std::placeholders::_4), NULL);
+	client->onPoll([this](void *arg, AsyncClient *c) { _tx_drain(); },
+		       NULL);
+    }
+
+    /* find gnhastd first, from handle(), never from connect() */
+    if (_disc_want) {
+	_conn_state = GN_CONN_BACKOFF;
+	_conn_next = millis();
+	return true;
+    }
+    /* the healthiest, fastest gnhastd we know of */
+    _srv_use(_srv_pick());
+
+    _tx_reset();
+    /* a line cut off by the last connection is no start for this one */
+    _rx_len = 0;
+    _rx_discard = false;
+    _last_ping = 0;
+    _conn_started = millis();
+    _conn_state = GN_CONN_CONNECTING;
+    /* skip the DNS lookup if we know where gnhastd was last time */
+    _conn_fast = _fc_server(ip);
+    if (_conn_fast) {
+	Serial.printf("Connecting to: %s:%d (cached %s)\n", _server, _port,
+		      ip.toString().c_str());
+	ok = client->connect(ip, _port);
+    } else {
+	Serial.printf("Connecting to: %s:%d\n", _server, _port);
+	ok = client->connect(_server, _port);
+    }
+    if (!ok) {
+	Serial.println("Connection to gnhastd failed!");
+	if (_conn_state == GN_CONN_CONNECTING)
+	    _gn_conn_retry();
+	return false;
+    }
+    return true;
+}
+
+/*
+ * Schedule the next attempt.  Half the backoff, plus up to half again of
+ * random jitter, then double the backoff for next time.
+ */
+
+void gnhast::_gn_conn_retry()
+{
+    uint32_t wait;
+
+    /* the cached address was no good, look it up, right away */
+    if (_conn_fast) {
+	_conn_fast = false;
+	_fc_server_failed();
+	_conn_state = GN_CONN_BACKOFF;
+	_conn_next = millis();
+	return;
+    }
+    _disc_failed();
+    /* fail over to a gnhastd that is not known to be down, right away */
+    if (_srv_failed()) {
+	_conn_state = GN_CONN_BACKOFF;
+	_conn_next = millis();
+	return;
+    }
+
+    wait = _conn_backoff / 2 + ESP.random() % (_conn_backoff / 2 + 1);
+    _conn_state = GN_CONN_BACKOFF;
+    _conn_next = millis() + wait;
+    Serial.printf("Retrying gnhastd in %u ms\n", (unsigned)wait);
+
+    _conn_backoff *= 2;
+    if (_conn_backoff > GN_BACKOFF_MAX)
+	_conn_backoff = GN_BACKOFF_MAX;
+}
+
+/*
+ * Something wanted to talk to gnhastd.  If nobody ever asked us to
+ * connect, do so now, otherwise leave it to the state machine.
+ */
+
+void gnhast::_gn_kick()
+{
+    /* sleep_end() decides when to connect */
+    if (_sleep_mode)
+	return;
+    if (_conn_state == GN_CONN_IDLE)
+	connect();
+}
+
+/*
+ * The tcp connection came up, introduce ourselves and (re)register
+ */
+
+void gnhast::__gn_connected(void *arg, AsyncClient *c)
+{
+    if (_debug)
+	Serial.println("Connected to gnhastd");
+    _conn_state = GN_CONN_UP;
+    _conn_backoff = GN_BACKOFF_MIN;
+    _boot_end(GN_BOOT_CONNECT);
+    _conn_fast = false;
+    _fc_server_up(c->remoteIP());
+
+    _tx_hold = true;
+    __gn_client();
+    if (_tx_line("getapiv")) {
+	_boot_begin(GN_BOOT_APIV);
+	_srv_probe_at = millis() | 1;
+    }
+    _tx_hold = false;
+    _conn_replay = 0;
+    _gn_pump();
+}
+
+/*
+ * Feed the reg replay into the tx buffer, only as fast as it drains, so a
+ * big device table never overflows it.  Called on connect, on every ack,
+ * and from handle().
+ */
+
+void gnhast::_gn_pump()
+{
+    gn_dev_t *d;
+
+    if (_conn_state != GN_CONN_UP)
+	return;
+
+    _tx_hold = true;
+    for (; _conn_replay < _nrofdevs; _conn_replay++) {
+	d = &_devices[_conn_replay];
+	if (!(d->flags & GN_DEV_REGISTERED))
+	    continue;
+	/* gnhastd already has it from before we went to sleep */
+	if (_sleep_mode && _sleep_registered(_conn_replay))
+	    continue;
+	/* a reg is about 60 bytes plus the uid and name */
+	if (_tx_free() < 64 + d->uidlen + strlen(d->name))
+	    break;
+	_gn_encode_reg(_conn_replay);
+    }
+    /* regs first, then whatever piled up while we were away */
+    if (_conn_replay == _nrofdevs)
+	_pq_replay();
+    _tx_hold = false;
+    _tx_drain();
+}
+
+/*
+ * Lost the connection (or never got it).  Anything still queued is gone.
+ */
+
+void gnhast::__gn_disconnected(void *arg, AsyncClient *c)
+{
+    _tx_reset();
+    if (_conn_state == GN_CONN_IDLE || _conn_state == GN_CONN_BACKOFF)
+	return;
+    Serial.println("Disconnected from gnhastd");
+    /* it may have been restarted, with none of our regs, so send them all
+       when we get back */
+    if (_sleep_mode)
+	_ss.registered = 0;
+    _gn_conn_retry();
+}
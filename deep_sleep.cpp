@@ -0,0 +1,317 @@
+/*
+ * Deep sleep batching, for battery nodes.
+ *
+ * Bringing up wifi costs far more than taking a reading, so a node that
+ * deep sleeps between readings should not join the network on every wake.
+ * In sleep mode, updates go into a small ring in RTC memory instead, and
+ * only every Nth wake (or sooner, when a value moves past its deadband, or
+ * the ring fills) does sleep_end() join the network and send the lot, in
+ * one connection: client, reg for anything gnhastd has not seen yet, the
+ * upd lines oldest first, disconnect.  Wakes that will not send are
+ * started with the radio off altogether.
+ *
+ * The sketch runs:
+ *
+ *	setup() {
+ *	    gn.sleep_begin(10);
+ *	    ... build and register devices, read sensors, gn_update_device ...
+ *	    gn.sleep_end(60 * 1000000ULL);	// does not return
+ *	}
+ *
+ * Which devices gnhastd already has a reg for, and the value last sent
+ * for each (for the deadband), are remembered in RTC memory too, for the
+ * first GN_SLEEP_DEVS devices.  Everything is lost on a power cycle, the
+ * next wake then simply sends.  gnhastd forgets the regs when it restarts,
+ * which a sleeping node cannot see, so every GN_SLEEP_REREG sends they all
+ * go again anyway, as they do after losing the connection mid-send.
+ *
+ * Samples stay in the ring until gnhastd has acked them.  If the
+ * connection drops part way, what was not acked is sent again on the
+ * reconnect, or kept for the next try.
+ */
+
+#include "gnhast_async.h"
+
+#define GN_SLEEP_MAGIC 0x47534C31 /* "GSL1" */
+
+static_assert(sizeof(gn_sleeprec_t) == 12, "sleep records must be 12 bytes");
+static_assert(sizeof(gn_sleepstate_t) % 4 == 0,
+	      "RTC memory is read and written in 4 byte blocks");
+static_assert(GN_RTC_SLEEP_OFFSET % 4 == 0,
+	      "RTC memory is read and written in 4 byte blocks");
+static_assert(GN_RTC_SLEEP_OFFSET >= GN_RTCMEM_RESERVED,
+	      "sleep state overlaps the OTA eboot command");
+static_assert(GN_RTC_SLEEP_OFFSET + sizeof(gn_sleepstate_t) <= GN_RTCMEM_SIZE,
+	      "sleep state does not fit in RTC memory, shrink GN_SLEEP_RING");
+static_assert(GN_RTC_SLEEP_OFFSET >= GN_RTC_FAST_OFFSET + sizeof(gn_fastconn_t),
+	      "sleep state overlaps the fast reconnect cache");
+static_assert(GN_RTC_SLEEP_OFFSET >= GN_RTC_DISC_OFFSET + sizeof(gn_disc_t),
+	      "sleep state overlaps the discovery cache");
+static_assert(GN_SLEEP_DEVS <= 32, "GN_SLEEP_DEVS is limited by the bitmaps");
+static_assert(GN_SLEEP_RING <= 255, "GN_SLEEP_RING must fit in a byte");
+static_assert(GN_SLEEP_REREG < 255, "GN_SLEEP_REREG must fit in a byte");
+static_assert(sizeof(gn_data_t) <= 8, "gn_data_t must fit a sleep record");
+
+/*
+ * Check the state record
+ */
+
+static uint16_t gn_ss_crc(gn_sleepstate_t *ss)
+{
+    return gn_crc16((uint8_t *)ss + offsetof(gn_sleepstate_t, wakes),
+		    sizeof(*ss) - offsetof(gn_sleepstate_t, wakes));
+}
+
+/*!
+ * @brief Use some other RTC memory, a gn_rtcmem_ram when testing on a
+ * host, say.  Call before anything else.
+ */
+
+void gnhast::set_rtcmem(gn_rtcmem *rtc)
+{
+    _rtc = rtc;
+    _fc_loaded = false;
+}
+
+/*!
+ * @brief Enter deep sleep mode, call first thing in setup()
+ * From here on updates are held in RTC memory, and sent by sleep_end()
+ * every "every" wakes, or sooner if a value crosses its deadband.
+ */
+
+void gnhast::sleep_begin(int every)
+{
+    _sleep_mode = true;
+    _sleep_every = (every < 1) ? 1 : every;
+    _sleep_urgent = false;
+    if (!_rtc->read(GN_RTC_SLEEP_OFFSET, &_ss, sizeof(_ss)) ||
+	_ss.magic != GN_SLEEP_MAGIC || _ss.crc != gn_ss_crc(&_ss)) {
+	Serial.println("No deep sleep state, starting fresh");
+	memset(&_ss, 0, sizeof(_ss));
+	/* nothing sent yet, so send on this wake */
+	_ss.flags |= GN_SLEEP_SEND_NEXT;
+    }
+    _ss.wakes++;
+    if (_ss.regage >= GN_SLEEP_REREG) {
+	/* gnhastd may have restarted since, send the regs again */
+	_ss.registered = 0;
+	_ss.regage = 0;
+    }
+    if (_debug)
+	Serial.printf("Wake %u of %d, %u samples held\n", _ss.wakes,
+		      _sleep_every, _ss.count);
+}
+
+/*!
+ * @brief Will sleep_end() connect to gnhastd on this wake?
+ * Handy for skipping work that only matters when we send.
+ */
+
+bool gnhast::sleep_due()
+{
+    return _ss.wakes >= _sleep_every || _sleep_urgent ||
+	(_ss.flags & GN_SLEEP_SEND_NEXT) || _ss.count == GN_SLEEP_RING;
+}
+
+/*!
+ * @brief Send what is due, then deep sleep for sleep_us microseconds
+ * Does not return.
+ */
+
+void gnhast::sleep_end(uint64_t sleep_us)
+{
+    int i;
+    int rfmode;
+
+    if (sleep_due() && _ss.count) {
+	if (_ss.flags & GN_SLEEP_RF_OFF) {
+	    /* the radio is off this wake, come straight back with it on */
+	    Serial.println("Send due, rebooting with the radio on");
+	    _ss.flags |= GN_SLEEP_SEND_NEXT;
+	    _ss.flags &= ~GN_SLEEP_RF_OFF;
+	    _sleep_save();
+	    if (_disc_on)
+		_disc_sleep(1);
+	    ESP.deepSleep(1, WAKE_RF_DEFAULT);
+	    return;
+	}
+	if (_sleep_send()) {
+	    for (i=0; i < GN_SLEEP_DEVS && i < _nrofdevs; i++)
+		if (_devices[i].flags & GN_DEV_REGISTERED)
+		    _ss.registered |= (1UL << i);
+	    _ss.regage++;
+	    _ss.flags &= ~GN_SLEEP_SEND_NEXT;
+	}
+	/* sent or not, wait a full period before trying again */
+	_ss.wakes = 0;
+    } else if (sleep_due())
+	_ss.wakes = 0;
+
+    /* only power the radio up on wakes that will use it */
+    if (_ss.wakes + 1 >= _sleep_every || (_ss.flags & GN_SLEEP_SEND_NEXT)) {
+	rfmode = WAKE_RF_DEFAULT;
+	_ss.flags &= ~GN_SLEEP_RF_OFF;
+    } else {
+	rfmode = WAKE_RF_DISABLED;
+	_ss.flags |= GN_SLEEP_RF_OFF;
+    }
+    _sleep_save();
+    if (_disc_on)
+	_disc_sleep(sleep_us);
+    if (_debug)
+	Serial.printf("Deep sleeping, radio %s\n",
+		      (rfmode == WAKE_RF_DEFAULT) ? "on" : "off");
+    ESP.deepSleep(sleep_us, rfmode);
+}
+
+/*
+ * Hold on to the current value of dev in RTC memory, instead of the
+ * pending queue
+ */
+
+void gnhast::_sleep_add(int dev)
+{
+    gn_sleeprec_t *r;
+
+    if (_ss.count == GN_SLEEP_RING) {
+	_ss.dropped++;
+	if (_debug)
+	    Serial.println("sleep ring full, dropping oldest");
+	_ss.head = (_ss.head + 1) % GN_SLEEP_RING;
+	_ss.count--;
+    }
+    r = &_ss.ring[(_ss.head + _ss.count) % GN_SLEEP_RING];
+    r->dev = dev;
+    memcpy(r->data, &_devices[dev].data, sizeof(r->data));
+    _ss.count++;
+    _devices[dev].flags &= ~GN_DEV_DIRTY;
+
+    /* has it moved far enough from what gnhastd last saw to go now? */
+    if (dev >= GN_SLEEP_DEVS || !(_ss.sentmask & (1UL << dev)))
+	_sleep_urgent = true;
+    else if (_devices[dev].deadband) {
+	gn_data_t sent;
+
+	memcpy(&sent, _ss.sent[dev], sizeof(sent));
+	if (_gn_past_deadband(dev, sent))
+	    _sleep_urgent = true;
+    }
+}
+
+/*
+ * Does gnhastd already have a reg for dev from an earlier wake?
+ */
+
+bool gnhast::_sleep_registered(int dev)
+{
+    return dev < GN_SLEEP_DEVS && (_ss.registered & (1UL << dev));
+}
+
+/*
+ * Drop the n oldest samples from the ring, gnhastd has them.  They are
+ * what it last saw, for the deadband.
+ */
+
+void gnhast::_sleep_retire(int n)
+{
+    gn_sleeprec_t *r;
+
+    for (; n > 0 && _ss.count; n--) {
+	r = &_ss.ring[_ss.head];
+	if (r->dev < GN_SLEEP_DEVS) {
+	    memcpy(_ss.sent[r->dev], r->data, sizeof(r->data));
+	    _ss.sentmask |= (1UL << r->dev);
+	}
+	_ss.head = (_ss.head + 1) % GN_SLEEP_RING;
+	_ss.count--;
+    }
+}
+
+/*
+ * Write the state back to RTC memory
+ */
+
+void gnhast::_sleep_save()
+{
+    _ss.magic = GN_SLEEP_MAGIC;
+    _ss.crc = gn_ss_crc(&_ss);
+    _rtc->write(GN_RTC_SLEEP_OFFSET, &_ss, sizeof(_ss));
+}
+
+/*
+ * Join the network, connect, send the ring, and disconnect, all within
+ * GN_SLEEP_SEND_TIMEOUT ms.  Samples are retired as gnhastd acks them,
+ * returns true only if it acked all of them.
+ */
+
+bool gnhast::_sleep_send()
+{
+    uint32_t start = millis();
+    uint32_t ends[GN_SLEEP_RING]; /* tx offset just past each sample */
+    uint32_t acked;
+    gn_sleeprec_t *r;
+    gn_data_t data;
+    int nsamples = _ss.count;
+    int sent = 0, done = 0;
+    bool ok = false;
+
+    _read_settings_conf();
+    _port = atoi(_gnhast_port_str);
+    init_server();
+    if (WiFi.status() != WL_CONNECTED) {
+	if (WiFi.SSID().length() == 0) {
+	    Serial.println("No wifi configured, cannot send from deep sleep");
+	    return false;
+	}
+	WiFi.mode(WIFI_STA);
+	_wifi_portal_after = 0;
+	_wifi_fails = 0;
+	_wifi_begin();
+    }
+
+    connect();
+    for (;;) {
+	/* the samples go behind the client line and any regs */
+	if (_conn_state == GN_CONN_UP && _conn_replay == _nrofdevs) {
+	    acked = _tx_snd - _tx_inflight;
+	    while (done < sent && (int32_t)(acked - ends[done]) >= 0)
+		done++;
+	    if (done == nsamples)
+		break;
+	    while (sent < nsamples) {
+		r = &_ss.ring[(_ss.head + sent) % GN_SLEEP_RING];
+		if (r->dev < _nrofdevs) {
+		    if (_tx_free() < 64u + _devices[r->dev].uidlen)
+			break;
+		    memcpy(&data, r->data, sizeof(data));
+		    _pq_emit(r->dev, data, millis());
+		}
+		ends[sent++] = _tx_wr;
+	    }
+	} else if (_conn_state != GN_CONN_UP)
+	    /* whatever was not acked went with the connection */
+	    sent = done;
+	if (millis() - start > GN_SLEEP_SEND_TIMEOUT)
+	    goto out;
+	handle();
+	delay(5);
+    }
+    ok = true;
+
+    /* everything acked, say goodbye */
+    disconnect();
+    while (client != NULL && client->connected() &&
+	   millis() - start <= GN_SLEEP_SEND_TIMEOUT) {
+	handle();
+	delay(5);
+    }
+out:
+    _sleep_retire(done);
+    if (!ok) {
+	Serial.printf("Deep sleep send failed, %u samples kept\n", _ss.count);
+	disconnect();
+    } else if (_debug)
+	Serial.printf("Sent %d samples in %u ms\n", done,
+		      (unsigned)(millis() - start));
+    return ok;
+}
@@ -0,0 +1,169 @@
+/*
+ * Finding gnhastd with mDNS / DNS-SD.
+ *
+ * With discovery on, gnhastd is looked up as a _gnhast._tcp service on
+ * the local network, rather than taken from GNHAST_SERVER_HOST or the
+ * portal, so it can move without touching the nodes.  The answer is kept
+ * in RTC memory, so a reset or a deep sleep wake does not query again,
+ * and used until connecting to it fails.  Even then, an answer is trusted
+ * for GN_DISC_TTL seconds, so a gnhastd that is merely down is not
+ * hammered with queries, and after that the next failed attempt looks
+ * again.  A cached answer older than GN_DISC_TTL is not used at all, its
+ * age counts the time slept in deep sleep, but not resets.  If nothing
+ * answers, the configured server is used.
+ *
+ * The query blocks, so it is only made from handle() while the
+ * connection waits in GN_CONN_BACKOFF, for at most GN_DISC_QUERY_MS.
+ */
+
+#include "gnhast_async.h"
+
+#define GN_DISC_MAGIC 0x47445331 /* "GDS1" */
+
+static_assert(sizeof(gn_disc_t) % 4 == 0,
+	      "RTC memory is read and written in 4 byte blocks");
+static_assert(GN_RTC_DISC_OFFSET % 4 == 0,
+	      "RTC memory is read and written in 4 byte blocks");
+static_assert(GN_RTC_DISC_OFFSET >= GN_RTCMEM_RESERVED,
+	      "discovery cache overlaps the OTA eboot command");
+static_assert(GN_RTC_DISC_OFFSET >= GN_RTC_FAST_OFFSET + sizeof(gn_fastconn_t),
+	      "discovery cache overlaps the fast reconnect cache");
+static_assert(GN_RTC_DISC_OFFSET + sizeof(gn_disc_t) <= GN_RTC_SLEEP_OFFSET,
+	      "discovery cache overlaps the deep sleep state");
+
+static uint16_t gn_disc_crc(gn_disc_t *dc)
+{
+    return gn_crc16(&dc->port, sizeof(*dc) - offsetof(gn_disc_t, port));
+}
+
+/*!
+ * @brief Find gnhastd with DNS-SD (_gnhast._tcp) instead of using the
+ * configured server.  Call before init_server().
+ */
+
+void gnhast::set_discovery(bool on)
+{
+    _disc_on = on;
+}
+
+static bool gn_disc_read(gn_rtcmem *rtc, gn_disc_t *dc)
+{
+    return rtc->read(GN_RTC_DISC_OFFSET, dc, sizeof(*dc)) &&
+	dc->magic == GN_DISC_MAGIC && dc->crc == gn_disc_crc(dc);
+}
+
+static void gn_disc_write(gn_rtcmem *rtc, gn_disc_t *dc)
+{
+    dc->magic = GN_DISC_MAGIC;
+    dc->crc = gn_disc_crc(dc);
+    rtc->write(GN_RTC_DISC_OFFSET, dc, sizeof(*dc));
+}
+
+/*
+ * Use the cached answer if there is one still fresh enough, else look it
+ * up before the first connect
+ */
+
+void gnhast::_disc_init()
+{
+    gn_disc_t dc;
+
+    if (!gn_disc_read(_rtc, &dc)) {
+	_disc_want = true;
+	return;
+    }
+    if (dc.age >= GN_DISC_TTL) {
+	Serial.println("Discovered gnhastd is too old, looking again");
+	_disc_want = true;
+	return;
+    }
+    snprintf(_disc_host, sizeof(_disc_host), "%s",
+	     IPAddress(dc.ip).toString().c_str());
+    _server = _disc_host;
+    _port = dc.port;
+    /* as if we had looked it up age seconds ago */
+    _disc_at = (millis() - dc.age * 1000UL) | 1;
+    Serial.printf("Using discovered gnhastd %s:%d\n", _server, _port);
+}
+
+/*
+ * Ask the network where gnhastd is.  Blocks for up to GN_DISC_QUERY_MS.
+ */
+
+void gnhast::_disc_lookup()
+{
+    gn_disc_t dc;
+    char name[32];
+    int n;
+
+    _disc_want = false;
+    _disc_at = millis() | 1;
+    if (!_disc_mdns) {
+	snprintf(name, sizeof(name), "gnhast-%06x",
+		 (unsigned)ESP.getChipId());
+	if (!MDNS.begin(name)) {
+	    Serial.println("Could not start mDNS");
+	    return;
+	}
+	_disc_mdns = true;
+    }
+
+    n = MDNS.queryService(GN_MDNS_SERVICE, GN_MDNS_PROTO, GN_DISC_QUERY_MS);
+    if (n <= 0) {
+	Serial.printf("No gnhastd found by mDNS, trying %s:%d\n", _server,
+		      _port);
+	/* whatever is cached is past its TTL by now, or we would not ask */
+	memset(&dc, 0, sizeof(dc));
+	_rtc->write(GN_RTC_DISC_OFFSET, &dc, sizeof(dc));
+	return;
+    }
+    if (n > 1)
+	Serial.printf("%d gnhastd found by mDNS, using the first\n", n);
+
+    dc.ip = MDNS.IP(0);
+    dc.port = MDNS.port(0);
+    dc.age = 0;
+    gn_disc_write(_rtc, &dc);
+
+    snprintf(_disc_host, sizeof(_disc_host), "%s",
+	     IPAddress(dc.ip).toString().c_str());
+    _server = _disc_host;
+    _port = dc.port;
+    _srv_primary();
+    Serial.printf("Discovered gnhastd %s at %s:%d\n",
+		  MDNS.hostname(0).c_str(), _server, _port);
+}
+
+/*
+ * Connecting failed, look again before the next attempt, if the answer
+ * we have is old enough
+ */
+
+void gnhast::_disc_failed()
+{
+    if (!_disc_on || _disc_want)
+	return;
+    if (_disc_at && millis() - _disc_at < GN_DISC_TTL * 1000UL)
+	return;
+    _disc_want = true;
+}
+
+/*
+ * Going into deep sleep for sleep_us, age the cached answer by the time
+ * since the lookup (or since the wake, if we did not look at it), plus
+ * the sleep, so it expires even on a node that is never up for long
+ */
+
+void gnhast::_disc_sleep(uint64_t sleep_us)
+{
+    gn_disc_t dc;
+
+    if (!gn_disc_read(_rtc, &dc))
+	return;
+    if (_disc_at)
+	dc.age = (millis() - _disc_at) / 1000;
+    else
+	dc.age += millis() / 1000;
+    dc.age += (uint32_t)(sleep_us / 1000000ULL);
+    gn_disc_write(_rtc, &dc);
+}
@@ -0,0 +1,144 @@
+/*
+  Benchmark the gnhast collector hot path on a real ESP8266.
+
+  Builds a set of fake number devices, then for 1, 20 and 200 devices
+  fires a burst of updates through gn_update_device() and waits for
+  gnhastd to ack them.  Each run prints one line of JSON on the serial
+  port, with the burst rate and everything from gnhast.perf_json(), so
+  results can be collected and compared across library releases.
+
+  Point it at extras/fake_gnhastd if you do not want to load a real
+  gnhastd.  Build with -DGN_PERF=1, or the update path is not timed.
+  Only gn_MAX_DEVICES devices can exist, build with -Dgn_MAX_DEVICES=200
+  to really test 200.  extras/host/bench has the same benchmark for the
+  host build.
+*/
+
+#include <gnhast_async.h>
+
+#define UPDATES_PER_RUN 1000 /* updates per run, spread over the devices */
+#define ACK_TIMEOUT 30000 /* ms to wait for gnhastd to ack a run */
+#define CONFIG_ROUNDS 5 /* times to save/commit/parse the config per run */
+
+gnhast gnhast("ESP_bench", 1);
+
+int runs[] = { 1, 20, 200 };
+
+/* Build up to ndevs devices, returns how many exist */
+
+int build_devices(int ndevs)
+{
+    char uid[24], name[32];
+    int i, dev;
+
+    for (i=0; i < ndevs && i < gn_MAX_DEVICES; i++) {
+	snprintf(uid, sizeof(uid), "bench%03d", i);
+	if (gnhast.find_dev_byuid(uid) >= 0)
+	    continue;
+	snprintf(name, sizeof(name), "Bench device %d", i);
+	dev = gnhast.generic_build_device(uid, name, PROTO_GENERIC,
+					  DEVICE_SENSOR, SUBTYPE_NUMBER,
+					  DATATYPE_DOUBLE, 0, NULL);
+	if (dev < 0)
+	    break;
+	gnhast.set_dev_precision(dev, 2);
+	gnhast.gn_register_device(dev);
+    }
+    return i;
+}
+
+/* Wait until nothing is left in the buffer or unacked, or we give up.
+   The byte counters do not balance (a line dropped for a full buffer was
+   never queued), so look at what is outstanding right now instead. */
+
+bool wait_for_acks()
+{
+    gn_txstats_t st;
+    unsigned long start = millis();
+
+    do {
+	delay(1);
+	gnhast.get_txstats(&st);
+	if (st.waiting == 0 && st.inflight == 0)
+	    return true;
+    } while (millis() - start < ACK_TIMEOUT);
+    return false;
+}
+
+void bench_run(int wanted)
+{
+    gn_data_t data;
+    gn_txstats_t st;
+    unsigned long start, elapsed;
+    char uid[24];
+    int ndevs, i;
+
+    ndevs = build_devices(wanted);
+    wait_for_acks();
+    gnhast.perf_reset();
+
+    start = micros();
+    for (i=0; i < UPDATES_PER_RUN; i++) {
+	data.d = 20.0 + (i % 1000) / 100.0;
+	gnhast.store_data_dev(i % ndevs, data);
+	gnhast.gn_update_device(i % ndevs);
+	/* don't outrun the tx buffer, let lwIP drain it */
+	do {
+	    gnhast.get_txstats(&st);
+	    if (st.waiting < GN_TXBUF_SIZE / 2)
+		break;
+	    yield();
+	} while (micros() - start < ACK_TIMEOUT * 1000UL);
+    }
+    wait_for_acks();
+    elapsed = micros() - start;
+
+    for (i=0; i < ndevs; i++) {
+	snprintf(uid, sizeof(uid), "bench%03d", i);
+	gnhast.find_dev_byuid(uid);
+    }
+    /* save_gnhast_config() only marks the config dirty, the write (and
+       the config_commit_us stat) happens in config_commit() */
+    for (i=0; i < CONFIG_ROUNDS; i++) {
+	gnhast.save_gnhast_config();
+	gnhast.config_commit();
+	gnhast.read_gnhast_config();
+    }
+
+    gnhast.get_txstats(&st);
+    Serial.printf("{\"run\":{\"devices_wanted\":%d,\"devices\":%d,"
+		  "\"updates\":%d,\"elapsed_us\":%lu,\"updates_per_sec\":%lu},"
+		  "\"perf\":", wanted, ndevs, UPDATES_PER_RUN, elapsed,
+		  (unsigned long)((uint64_t)UPDATES_PER_RUN * 1000000 / elapsed));
+    gnhast.perf_json(Serial);
+    Serial.println("}");
+}
+
+void setup() {
+    unsigned int i;
+
+    Serial.begin(115200);
+    Serial.println();
+    gnhast.set_debug_mode(0);
+
+    gnhast.init_wifi();
+    gnhast.init_webserver();
+    gnhast.init_server();
+    gnhast.connect();
+    while (gnhast.conn_state() != GN_CONN_UP) {
+	gnhast.handle();
+	delay(10);
+    }
+
+    for (i=0; i < sizeof(runs)/sizeof(runs[0]); i++)
+	bench_run(runs[i]);
+    Serial.println("Benchmark done");
+}
+
+void loop() {
+    gnhast.handle();
+    if (gnhast.shouldReboot) {
+	delay(100);
+	ESP.restart();
+    }
+}
@@ -0,0 +1,113 @@
+/*
+ * Host benchmark for gn_numfmt against snprintf.
+ *
+ * Build and run on any Linux/BSD box:
+ *   g++ -O2 -I../.. -o numfmt_bench numfmt_bench.cpp ../../gn_numfmt.cpp
+ *   ./numfmt_bench
+ *
+ * Also cross checks the output against snprintf, and reports mismatches.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include "gn_numfmt.h"
+
+#define NVALS 100000
+#define ROUNDS 20
+
+static double dvals[NVALS];
+static uint32_t uvals[NVALS];
+static uint64_t llvals[NVALS];
+static volatile int sink;
+
+static double now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *what, double ours, double libc)
+{
+    printf("%-22s gn_fmt %7.1f ns  snprintf %7.1f ns  speedup %5.2fx\n",
+	   what, ours, libc, libc / ours);
+}
+
+int main()
+{
+    char a[GN_FMT_BUFSIZE], b[64];
+    double t, ours, libc;
+    int i, r, prec, bad = 0;
+
+    srand(1);
+    for (i = 0; i < NVALS; i++) {
+	/* temperatures, humidities, watts, the usual suspects */
+	dvals[i] = (rand() % 2000000) / 1000.0 - 200.0;
+	uvals[i] = (uint32_t)rand() * 2654435761u;
+	llvals[i] = ((uint64_t)rand() << 33) ^ (uint64_t)rand();
+    }
+
+    for (i = 0; i < NVALS; i++) {
+	gn_fmt_u32(a, uvals[i]);
+	snprintf(b, sizeof(b), "%" PRIu32, uvals[i]);
+	bad += strcmp(a, b) != 0;
+	gn_fmt_u64(a, llvals[i]);
+	snprintf(b, sizeof(b), "%" PRIu64, llvals[i]);
+	bad += strcmp(a, b) != 0;
+	for (prec = 0; prec <= 6; prec += 2) {
+	    gn_fmt_fixed(a, dvals[i], prec);
+	    snprintf(b, sizeof(b), "%.*f", prec, dvals[i]);
+	    if (strcmp(a, b) != 0) {
+		if (bad < 10)
+		    printf("mismatch: %s vs %s\n", a, b);
+		bad++;
+	    }
+	}
+    }
+    printf("cross check: %d mismatches in %d values\n", bad, NVALS * 6);
+
+    for (prec = 2; prec <= 6; prec += 4) {
+	t = now_ns();
+	for (r = 0; r < ROUNDS; r++)
+	    for (i = 0; i < NVALS; i++)
+		sink += gn_fmt_fixed(a, dvals[i], prec);
+	ours = (now_ns() - t) / (ROUNDS * NVALS);
+	t = now_ns();
+	for (r = 0; r < ROUNDS; r++)
+	    for (i = 0; i < NVALS; i++)
+		sink += snprintf(b, sizeof(b), "%.*f", prec, dvals[i]);
+	libc = (now_ns() - t) / (ROUNDS * NVALS);
+	snprintf(b, sizeof(b), "double, %d decimals", prec);
+	report(b, ours, libc);
+    }
+
+    t = now_ns();
+    for (r = 0; r < ROUNDS; r++)
+	for (i = 0; i < NVALS; i++)
+	    sink += gn_fmt_u32(a, uvals[i]);
+    ours = (now_ns() - t) / (ROUNDS * NVALS);
+    t = now_ns();
+    for (r = 0; r < ROUNDS; r++)
+	for (i = 0; i < NVALS; i++)
+	    sink += snprintf(b, sizeof(b), "%" PRIu32, uvals[i]);
+    libc = (now_ns() - t) / (ROUNDS * NVALS);
+    report("uint32_t", ours, libc);
+
+    t = now_ns();
+    for (r = 0; r < ROUNDS; r++)
+	for (i = 0; i < NVALS; i++)
+	    sink += gn_fmt_u64(a, llvals[i]);
+    ours = (now_ns() - t) / (ROUNDS * NVALS);
+    t = now_ns();
+    for (r = 0; r < ROUNDS; r++)
+	for (i = 0; i < NVALS; i++)
+	    sink += snprintf(b, sizeof(b), "%" PRIu64, llvals[i]);
+    libc = (now_ns() - t) / (ROUNDS * NVALS);
+    report("uint64_t", ours, libc);
+
+    return bad != 0;
+}
@@ -0,0 +1,263 @@
+/*
+ * A tiny stand-in for gnhastd, for poking at collectors from a Linux box.
+ *
+ * Speaks just enough of the line protocol for this library: it accepts
+ * client/reg/upd/mod/imalive/disconnect, answers getapiv, and pings every
+ * client periodically.  Anything typed on stdin is sent to every connected
+ * client verbatim (handy for "chg uid:... switch:1").  Every line received
+ * is logged with a timestamp, and per client counters are printed when a
+ * client goes away, or on SIGINT.
+ *
+ * Build: cc -O2 -o fake_gnhastd fake_gnhastd.c
+ * Usage: fake_gnhastd [-p port] [-i ping_seconds] [-q]
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define MAX_CLIENTS 64
+#define LINEBUF_SIZE 2048
+#define PROTO_VERS 0x12	/* GNHASTD_PROTO_VERS */
+
+typedef struct _fclient_t {
+	int fd;
+	char addr[64];
+	char name[64];
+	char buf[LINEBUF_SIZE];
+	size_t len;
+	double connected;
+	unsigned long bytes, lines, upds, regs, imalives, pings;
+} fclient_t;
+
+static fclient_t clients[MAX_CLIENTS];
+static int quiet;
+static volatile sig_atomic_t done;
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+sigint(int sig)
+{
+	(void)sig;
+	done = 1;
+}
+
+static void
+client_stats(fclient_t *c)
+{
+	double secs = now() - c->connected;
+
+	printf("# %s (%s): %.1fs, %lu bytes, %lu lines (%.1f/s), "
+	    "%lu reg, %lu upd, %lu imalive for %lu pings\n",
+	    c->addr, c->name[0] ? c->name : "?", secs, c->bytes, c->lines,
+	    secs > 0 ? c->lines / secs : 0.0, c->regs, c->upds,
+	    c->imalives, c->pings);
+}
+
+static void
+client_close(fclient_t *c)
+{
+	client_stats(c);
+	close(c->fd);
+	c->fd = -1;
+}
+
+static void
+client_send(fclient_t *c, const char *line)
+{
+	size_t len = strlen(line);
+
+	if (write(c->fd, line, len) != (ssize_t)len)
+		fprintf(stderr, "short write to %s\n", c->addr);
+}
+
+/* Handle one complete line from a collector */
+
+static void
+client_line(fclient_t *c, char *line)
+{
+	char reply[64];
+	char *p;
+
+	c->lines++;
+	if (!quiet)
+		printf("%.3f %s: %s\n", now(), c->addr, line);
+
+	if (strncmp(line, "upd ", 4) == 0)
+		c->upds++;
+	else if (strncmp(line, "reg ", 4) == 0)
+		c->regs++;
+	else if (strcmp(line, "imalive") == 0)
+		c->imalives++;
+	else if (strcmp(line, "getapiv") == 0) {
+		snprintf(reply, sizeof(reply), "apiv apiv:%d\n", PROTO_VERS);
+		client_send(c, reply);
+	} else if (strncmp(line, "client ", 7) == 0) {
+		p = strstr(line, "client:");
+		if (p != NULL)
+			snprintf(c->name, sizeof(c->name), "%s", p + 7);
+	}
+}
+
+static void
+client_read(fclient_t *c)
+{
+	ssize_t n;
+	char *nl, *start;
+
+	n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len - 1);
+	if (n <= 0) {
+		client_close(c);
+		return;
+	}
+	c->bytes += n;
+	c->len += n;
+	c->buf[c->len] = '\0';
+
+	start = c->buf;
+	while ((nl = strchr(start, '\n')) != NULL) {
+		*nl = '\0';
+		if (nl > start && nl[-1] == '\r')
+			nl[-1] = '\0';
+		client_line(c, start);
+		start = nl + 1;
+	}
+	c->len -= start - c->buf;
+	memmove(c->buf, start, c->len);
+	if (c->len == sizeof(c->buf) - 1) {
+		fprintf(stderr, "%s: line too long, discarding\n", c->addr);
+		c->len = 0;
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	struct pollfd pfd[MAX_CLIENTS + 2];
+	struct sockaddr_in sin;
+	socklen_t slen;
+	char line[LINEBUF_SIZE];
+	double lastping;
+	int port = 2920, interval = 60, ch, lfd, fd, i, n, on = 1;
+	int infd = STDIN_FILENO;
+
+	while ((ch = getopt(argc, argv, "p:i:q")) != -1) {
+		switch (ch) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p port] [-i ping_secs] "
+			    "[-q]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	signal(SIGINT, sigint);
+	signal(SIGPIPE, SIG_IGN);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	sin.sin_port = htons(port);
+	if (bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+	    listen(lfd, 16) < 0) {
+		perror("bind/listen");
+		return 1;
+	}
+	printf("# fake gnhastd listening on %d, ping every %ds\n", port,
+	    interval);
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+		clients[i].fd = -1;
+	lastping = now();
+
+	while (!done) {
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = infd;
+		pfd[1].events = POLLIN;
+		for (i = 0; i < MAX_CLIENTS; i++) {
+			pfd[i + 2].fd = clients[i].fd;
+			pfd[i + 2].events = POLLIN;
+		}
+		n = poll(pfd, MAX_CLIENTS + 2, 1000);
+		if (n < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+
+		if (n > 0 && (pfd[0].revents & POLLIN)) {
+			slen = sizeof(sin);
+			fd = accept(lfd, (struct sockaddr *)&sin, &slen);
+			for (i = 0; fd >= 0 && i < MAX_CLIENTS; i++)
+				if (clients[i].fd == -1)
+					break;
+			if (fd >= 0 && i == MAX_CLIENTS) {
+				close(fd);
+			} else if (fd >= 0) {
+				memset(&clients[i], 0, sizeof(fclient_t));
+				clients[i].fd = fd;
+				clients[i].connected = now();
+				snprintf(clients[i].addr,
+				    sizeof(clients[i].addr), "%s:%d",
+				    inet_ntoa(sin.sin_addr),
+				    ntohs(sin.sin_port));
+				printf("# connect from %s\n", clients[i].addr);
+			}
+		}
+
+		if (n > 0 && (pfd[1].revents & (POLLIN | POLLHUP))) {
+			if (fgets(line, sizeof(line), stdin) == NULL)
+				infd = -1;
+			else
+				for (i = 0; i < MAX_CLIENTS; i++)
+					if (clients[i].fd != -1)
+						client_send(&clients[i], line);
+		}
+
+		for (i = 0; n > 0 && i < MAX_CLIENTS; i++)
+			if (clients[i].fd != -1 &&
+			    (pfd[i + 2].revents & (POLLIN | POLLHUP)))
+				client_read(&clients[i]);
+
+		if (interval > 0 && now() - lastping >= interval) {
+			lastping = now();
+			for (i = 0; i < MAX_CLIENTS; i++)
+				if (clients[i].fd != -1) {
+					client_send(&clients[i], "ping\n");
+					clients[i].pings++;
+				}
+		}
+	}
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+		if (clients[i].fd != -1)
+			client_close(&clients[i]);
+	return 0;
+}
@@ -0,0 +1,191 @@
+/*
+ * Benchmark the collector hot path on the host, against a fake gnhastd
+ * on a loopback socket.
+ *
+ * For 1, 20 and 200 devices, fire a burst of updates through
+ * gn_update_device(), as fast as the tx buffer drains, and wait for the
+ * acks.  Then time find_dev_byuid() over every device, and save, commit
+ * and re-read the config a few times.  Each run prints one line of JSON,
+ * the burst rate, how much was malloc()ed on the update path, and
+ * everything from perf_json(), so results can be compared across
+ * releases of the library.  Built against the library with GN_PERF and
+ * 200 devices.
+ *
+ *	gnhast_bench [updates per run]
+ */
+
+#include "../tests/test.h"
+
+#define UPDATES_PER_RUN 1000 /* updates per run, spread over the devices */
+#define ACK_TIMEOUT 30000 /* ms to wait for gnhastd to ack a run */
+#define CONFIG_ROUNDS 5 /* times to save/commit/parse the config per run */
+
+static gnhast gn("host_bench", 1);
+static test_server srv;
+
+static const int runs[] = { 1, 20, 200 };
+
+/*
+ * Count what is malloc()ed while an update runs, the encoder should not
+ * need anything.  operator new ends up here too.
+ */
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+
+static bool counting;
+static uint32_t nallocs;
+static uint64_t nbytes;
+
+extern "C" void *malloc(size_t size)
+{
+    if (counting) {
+	nallocs++;
+	nbytes += size;
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+    if (counting) {
+	nallocs++;
+	nbytes += n * size;
+    }
+    return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *p, size_t size)
+{
+    if (counting) {
+	nallocs++;
+	nbytes += size;
+    }
+    return __libc_realloc(p, size);
+}
+
+/* Build up to ndevs devices, returns how many exist */
+
+static int build_devices(int ndevs)
+{
+    char uid[24], name[32];
+    int i, dev;
+
+    for (i=0; i < ndevs && i < gn_MAX_DEVICES; i++) {
+	snprintf(uid, sizeof(uid), "bench%03d", i);
+	if (gn.find_dev_byuid(uid) >= 0)
+	    continue;
+	snprintf(name, sizeof(name), "Bench device %d", i);
+	dev = gn.generic_build_device(strdup(uid), strdup(name),
+				      PROTO_GENERIC, DEVICE_SENSOR,
+				      SUBTYPE_NUMBER, DATATYPE_DOUBLE, 0, NULL);
+	if (dev < 0)
+	    break;
+	gn.set_dev_precision(dev, 2);
+	gn.gn_register_device(dev);
+    }
+    return i;
+}
+
+/* run everything once, and throw away what gnhastd got */
+
+static void step()
+{
+    gn.handle();
+    host_poll(0);
+    srv.poll();
+    srv.clear();
+}
+
+/* Wait until nothing is left in the buffer or unacked, or we give up */
+
+static bool wait_for_acks()
+{
+    gn_txstats_t st;
+    uint32_t start = millis();
+
+    do {
+	step();
+	gn.get_txstats(&st);
+	if (st.waiting == 0 && st.inflight == 0)
+	    return true;
+    } while (millis() - start < ACK_TIMEOUT);
+    return false;
+}
+
+static void bench_run(int wanted, int updates)
+{
+    gn_data_t data;
+    gn_txstats_t st;
+    uint32_t start, elapsed;
+    char uid[24];
+    int ndevs, i;
+
+    ndevs = build_devices(wanted);
+    wait_for_acks();
+    gn.perf_reset();
+    nallocs = 0;
+    nbytes = 0;
+
+    start = micros();
+    for (i=0; i < updates; i++) {
+	data.d = 20.0 + (i % 1000) / 100.0;
+	counting = true;
+	gn.store_data_dev(i % ndevs, data);
+	gn.gn_update_device(i % ndevs);
+	counting = false;
+	/* don't outrun the tx buffer, let tcp drain it */
+	do {
+	    gn.get_txstats(&st);
+	    if (st.waiting < GN_TXBUF_SIZE / 2)
+		break;
+	    step();
+	} while (micros() - start < ACK_TIMEOUT * 1000UL);
+    }
+    wait_for_acks();
+    elapsed = micros() - start;
+
+    for (i=0; i < ndevs; i++) {
+	snprintf(uid, sizeof(uid), "bench%03d", i);
+	gn.find_dev_byuid(uid);
+    }
+    for (i=0; i < CONFIG_ROUNDS; i++) {
+	gn.save_gnhast_config();
+	gn.config_commit();
+	gn.read_gnhast_config();
+    }
+
+    fflush(stdout);
+    printf("{\"run\":{\"devices_wanted\":%d,\"devices\":%d,"
+	   "\"updates\":%d,\"elapsed_us\":%u,\"updates_per_sec\":%u,"
+	   "\"allocs\":%u,\"alloc_bytes\":%llu},\"perf\":",
+	   wanted, ndevs, updates, (unsigned)elapsed,
+	   (unsigned)((uint64_t)updates * 1000000 / (elapsed ? elapsed : 1)),
+	   (unsigned)nallocs, (unsigned long long)nbytes);
+    fflush(stdout);
+    gn.perf_json(Serial);
+    Serial.println("}");
+}
+
+int main(int argc, char **argv)
+{
+    int updates = UPDATES_PER_RUN;
+    size_t i;
+
+    if (argc > 1)
+	updates = atoi(argv[1]);
+    if (updates <= 0) {
+	fprintf(stderr, "usage: gnhast_bench [updates per run]\n");
+	return 1;
+    }
+
+    test_fs();
+    if (!test_up(gn, srv)) {
+	fprintf(stderr, "could not reach the fake gnhastd\n");
+	return 1;
+    }
+    for (i=0; i < sizeof(runs) / sizeof(runs[0]); i++)
+	bench_run(runs[i], updates);
+    return 0;
+}
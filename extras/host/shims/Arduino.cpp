@@ -0,0 +1,421 @@
+/*
+ * Host shim for the Arduino core: time, String, Print, Serial and ESP
+ */
+
+#include <time.h>
+#include <ctype.h>
+#include <malloc.h>
+#include <unistd.h>
+#include "Arduino.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+uint64_t host_slept_us;
+int host_slept_mode;
+uint32_t host_rtcmem[128];
+
+static uint64_t host_skew_us;
+
+/*
+ * Microseconds since the first call, plus the skew tests asked for
+ */
+
+static uint64_t host_now_us()
+{
+    static uint64_t base;
+    struct timespec ts;
+    uint64_t now;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    if (base == 0)
+	base = now;
+    return now - base + host_skew_us;
+}
+
+/*
+ * Both wrap at 32 bits, like on the ESP8266
+ */
+
+unsigned long millis()
+{
+    return (uint32_t)(host_now_us() / 1000);
+}
+
+unsigned long micros()
+{
+    return (uint32_t)host_now_us();
+}
+
+void host_advance(uint32_t ms)
+{
+    host_skew_us += (uint64_t)ms * 1000;
+}
+
+/*
+ * Waiting is when the network gets to run
+ */
+
+static void (*host_idle_fn)(void);
+
+void host_idle(void (*fn)(void))
+{
+    host_idle_fn = fn;
+}
+
+void delay(unsigned long ms)
+{
+    uint64_t end = host_now_us() + (uint64_t)ms * 1000;
+    uint64_t now;
+
+    host_poll(0);
+    while ((now = host_now_us()) < end)
+	host_poll((int)((end - now + 999) / 1000));
+    if (host_idle_fn)
+	host_idle_fn();
+}
+
+void yield()
+{
+    host_poll(0);
+    if (host_idle_fn)
+	host_idle_fn();
+}
+
+/* String */
+
+static std::string host_fmt_num(unsigned long val, unsigned char base)
+{
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    char buf[66];
+    int i = sizeof(buf);
+
+    if (base < 2 || base > 36)
+	base = 10;
+    buf[--i] = '\0';
+    do {
+	buf[--i] = digits[val % base];
+	val /= base;
+    } while (val);
+    return std::string(&buf[i]);
+}
+
+String::String(int val, unsigned char base)
+{
+    if (val < 0 && base == DEC)
+	_s = "-" + host_fmt_num(-(long)val, base);
+    else
+	_s = host_fmt_num((unsigned int)val, base);
+}
+
+String::String(unsigned int val, unsigned char base)
+{
+    _s = host_fmt_num(val, base);
+}
+
+String::String(long val, unsigned char base)
+{
+    if (val < 0 && base == DEC)
+	_s = "-" + host_fmt_num(-(unsigned long)val, base);
+    else
+	_s = host_fmt_num((unsigned long)val, base);
+}
+
+String::String(unsigned long val, unsigned char base)
+{
+    _s = host_fmt_num(val, base);
+}
+
+String::String(double val, unsigned char decimals)
+{
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), "%.*f", decimals, val);
+    _s = buf;
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+    size_t i = _s.find(c, from);
+
+    return (i == std::string::npos) ? -1 : (int)i;
+}
+
+int String::indexOf(const char *s, unsigned int from) const
+{
+    size_t i = _s.find(s, from);
+
+    return (i == std::string::npos) ? -1 : (int)i;
+}
+
+int String::lastIndexOf(char c) const
+{
+    size_t i = _s.rfind(c);
+
+    return (i == std::string::npos) ? -1 : (int)i;
+}
+
+bool String::startsWith(const char *s) const
+{
+    return _s.compare(0, strlen(s), s) == 0;
+}
+
+bool String::endsWith(const char *s) const
+{
+    size_t n = strlen(s);
+
+    return _s.size() >= n && _s.compare(_s.size() - n, n, s) == 0;
+}
+
+String String::substring(unsigned int from) const
+{
+    return substring(from, _s.size());
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+    if (to > _s.size())
+	to = _s.size();
+    if (from >= to)
+	return String();
+    return String(_s.substr(from, to - from));
+}
+
+void String::replace(const char *from, const char *to)
+{
+    size_t flen = strlen(from), tlen = strlen(to), i = 0;
+
+    if (flen == 0)
+	return;
+    while ((i = _s.find(from, i)) != std::string::npos) {
+	_s.replace(i, flen, to);
+	i += tlen;
+    }
+}
+
+void String::trim()
+{
+    size_t b = 0, e = _s.size();
+
+    while (b < e && isspace((unsigned char)_s[b]))
+	b++;
+    while (e > b && isspace((unsigned char)_s[e - 1]))
+	e--;
+    _s = _s.substr(b, e - b);
+}
+
+void String::toLowerCase()
+{
+    for (size_t i=0; i < _s.size(); i++)
+	_s[i] = tolower((unsigned char)_s[i]);
+}
+
+void String::toUpperCase()
+{
+    for (size_t i=0; i < _s.size(); i++)
+	_s[i] = toupper((unsigned char)_s[i]);
+}
+
+String operator+(const String &a, const String &b)
+{
+    String s(a);
+
+    s += b;
+    return s;
+}
+
+String operator+(const String &a, const char *b)
+{
+    String s(a);
+
+    s += b;
+    return s;
+}
+
+String operator+(const char *a, const String &b)
+{
+    String s(a);
+
+    s += b;
+    return s;
+}
+
+/* Print */
+
+size_t Print::write(const uint8_t *buf, size_t len)
+{
+    size_t n = 0;
+
+    while (len--)
+	n += write(*buf++);
+    return n;
+}
+
+size_t Print::printf(const char *fmt, ...)
+{
+    char sbuf[256], *buf = sbuf;
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(sbuf, sizeof(sbuf), fmt, ap);
+    va_end(ap);
+    if (len < 0)
+	return 0;
+    if ((size_t)len >= sizeof(sbuf)) {
+	buf = (char *)malloc(len + 1);
+	if (buf == NULL)
+	    return 0;
+	va_start(ap, fmt);
+	vsnprintf(buf, len + 1, fmt, ap);
+	va_end(ap);
+    }
+    len = write((const uint8_t *)buf, len);
+    if (buf != sbuf)
+	free(buf);
+    return len;
+}
+
+size_t Print::print(long val, int base)
+{
+    return print(String(val, base));
+}
+
+size_t Print::print(unsigned long val, int base)
+{
+    return print(String(val, base));
+}
+
+size_t Print::print(double val, int digits)
+{
+    return print(String(val, digits));
+}
+
+/* Serial goes to stdout */
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t len)
+{
+    return fwrite(buf, 1, len, stdout);
+}
+
+void HardwareSerial::flush()
+{
+    fflush(stdout);
+}
+
+/* ESP */
+
+/* a nominal heap, less what was malloc()ed since the first call.  The
+   shims use more than the real libraries do, so only changes in it mean
+   anything on the host. */
+#define HOST_HEAP (1024 * 1024)
+
+uint32_t EspClass::getFreeHeap()
+{
+    static size_t base;
+    size_t used = mallinfo2().uordblks;
+
+    if (base == 0)
+	base = used;
+    if (used < base)
+	return HOST_HEAP;
+    return (used - base >= HOST_HEAP) ? 0 : HOST_HEAP - (used - base);
+}
+
+/*
+ * Like the core's cont_repaint_stack(): paint HOST_STACK bytes below the
+ * caller, and count how much of the paint is still there.  The x86-64
+ * red zone just below us is left alone, so up to that much of what the
+ * callees use is not seen.
+ */
+
+#define HOST_STACK 4096
+#define HOST_STACK_REDZONE 128
+#define HOST_STACK_PAINT 0xa5
+
+static volatile char *host_stack_lo;
+
+__attribute__((noinline, no_sanitize_address))
+void EspClass::resetFreeContStack()
+{
+    volatile char here;
+    volatile char *p;
+    uintptr_t sp = (uintptr_t)&here;
+
+    host_stack_lo = (volatile char *)(sp - HOST_STACK_REDZONE - HOST_STACK);
+    for (p = host_stack_lo; p < host_stack_lo + HOST_STACK; p++)
+	*p = HOST_STACK_PAINT;
+}
+
+__attribute__((noinline, no_sanitize_address))
+uint32_t EspClass::getFreeContStack()
+{
+    volatile char *p = host_stack_lo;
+
+    if (p == NULL)
+	return HOST_STACK;
+    while (p < host_stack_lo + HOST_STACK && *p == (char)HOST_STACK_PAINT)
+	p++;
+    return p - host_stack_lo;
+}
+
+uint32_t EspClass::getChipId()
+{
+    return 0xc0ffee;
+}
+
+uint32_t EspClass::random()
+{
+    return ((uint32_t)lrand48() << 1) ^ (uint32_t)lrand48();
+}
+
+void EspClass::reset()
+{
+    printf("host: ESP.reset()\n");
+    exit(0);
+}
+
+void EspClass::restart()
+{
+    printf("host: ESP.restart()\n");
+    exit(0);
+}
+
+/*
+ * Nothing to wake up from, just note it and carry on, the test plays the
+ * next wake by making a new gnhast on the same RTC memory
+ */
+
+void EspClass::deepSleep(uint64_t time_us, RFMode mode)
+{
+    host_slept_us = time_us ? time_us : 1;
+    host_slept_mode = mode;
+}
+
+/*
+ * Offsets are in 4 byte blocks, sizes in bytes, as in the core
+ */
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t *data,
+				 size_t size)
+{
+    if (offset * 4 + size > sizeof(host_rtcmem) || (size & 3))
+	return false;
+    memcpy(data, (uint8_t *)host_rtcmem + offset * 4, size);
+    return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t *data,
+				  size_t size)
+{
+    if (offset * 4 + size > sizeof(host_rtcmem) || (size & 3))
+	return false;
+    memcpy((uint8_t *)host_rtcmem + offset * 4, data, size);
+    return true;
+}
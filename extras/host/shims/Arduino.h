@@ -0,0 +1,187 @@
+/*
+ * Host shim: just enough of the ESP8266 Arduino core to build and run
+ * the library on Linux.  Time is the real monotonic clock, plus whatever
+ * a test skipped ahead with host_advance(), see host.h.
+ */
+
+#ifndef __host_Arduino_h__
+#define __host_Arduino_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <functional>
+#include <string>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+#define DEC 10
+#define HEX 16
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+class Print;
+
+class Printable {
+ public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print &p) const = 0;
+};
+
+class String {
+ public:
+    String() {}
+    String(const char *s) : _s(s ? s : "") {}
+    String(const std::string &s) : _s(s) {}
+    String(char c) : _s(1, c) {}
+    String(int val, unsigned char base = DEC);
+    String(unsigned int val, unsigned char base = DEC);
+    String(long val, unsigned char base = DEC);
+    String(unsigned long val, unsigned char base = DEC);
+    String(double val, unsigned char decimals = 2);
+
+    const char *c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.length(); }
+    bool isEmpty() const { return _s.empty(); }
+    char charAt(unsigned int i) const { return i < _s.size() ? _s[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+
+    String &operator=(const char *s) { _s = s ? s : ""; return *this; }
+    String &operator+=(const String &s) { _s += s._s; return *this; }
+    String &operator+=(const char *s) { if (s) _s += s; return *this; }
+    String &operator+=(char c) { _s += c; return *this; }
+    bool concat(const String &s) { _s += s._s; return true; }
+    bool concat(const char *s) { if (s) _s += s; return true; }
+
+    bool operator==(const String &s) const { return _s == s._s; }
+    bool operator==(const char *s) const { return _s == (s ? s : ""); }
+    bool operator!=(const String &s) const { return _s != s._s; }
+    bool operator!=(const char *s) const { return !(*this == s); }
+    bool operator<(const String &s) const { return _s < s._s; }
+    bool equals(const String &s) const { return _s == s._s; }
+
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const char *s, unsigned int from = 0) const;
+    int indexOf(const String &s, unsigned int from = 0) const {
+	return indexOf(s.c_str(), from);
+    }
+    int lastIndexOf(char c) const;
+    bool startsWith(const char *s) const;
+    bool startsWith(const String &s) const { return startsWith(s.c_str()); }
+    bool endsWith(const char *s) const;
+    bool endsWith(const String &s) const { return endsWith(s.c_str()); }
+    String substring(unsigned int from) const;
+    String substring(unsigned int from, unsigned int to) const;
+    void replace(const char *from, const char *to);
+    void replace(const String &from, const String &to) {
+	replace(from.c_str(), to.c_str());
+    }
+    void trim();
+    void toLowerCase();
+    void toUpperCase();
+    long toInt() const { return atol(_s.c_str()); }
+    double toFloat() const { return atof(_s.c_str()); }
+    bool reserve(unsigned int n) { _s.reserve(n); return true; }
+
+ private:
+    std::string _s;
+};
+
+String operator+(const String &a, const String &b);
+String operator+(const String &a, const char *b);
+String operator+(const char *a, const String &b);
+
+class Print {
+ public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buf, size_t len);
+    size_t write(const char *str) {
+	return str ? write((const uint8_t *)str, strlen(str)) : 0;
+    }
+    size_t write(const char *buf, size_t len) {
+	return write((const uint8_t *)buf, len);
+    }
+    virtual void flush() {}
+
+    size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    size_t print(const char *s) { return write(s); }
+    size_t print(const String &s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int val, int base = DEC) { return print((long)val, base); }
+    size_t print(unsigned int val, int base = DEC) {
+	return print((unsigned long)val, base);
+    }
+    size_t print(long val, int base = DEC);
+    size_t print(unsigned long val, int base = DEC);
+    size_t print(double val, int digits = 2);
+    size_t print(const Printable &p) { return p.printTo(*this); }
+
+    size_t println() { return write("\r\n"); }
+    template<class T> size_t println(const T &val) {
+	size_t n = print(val);
+	return n + println();
+    }
+    template<class T> size_t println(const T &val, int fmt) {
+	size_t n = print(val, fmt);
+	return n + println();
+    }
+};
+
+class HardwareSerial : public Print {
+ public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    void setDebugOutput(bool on) { (void)on; }
+    int available() { return 0; }
+    int read() { return -1; }
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buf, size_t len);
+    using Print::write;
+    void flush();
+    operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+enum RFMode {
+    WAKE_RF_DEFAULT = 0,
+    WAKE_RFCAL = 1,
+    WAKE_NO_RFCAL = 2,
+    WAKE_RF_DISABLED = 4,
+};
+
+class EspClass {
+ public:
+    uint32_t getFreeHeap();
+    uint32_t getFreeContStack();
+    void resetFreeContStack();
+    uint32_t getChipId();
+    uint32_t random();
+    void reset();
+    void restart();
+    void deepSleep(uint64_t time_us, RFMode mode = WAKE_RF_DEFAULT);
+    void deepSleep(uint64_t time_us, int mode) {
+	deepSleep(time_us, (RFMode)mode);
+    }
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size);
+};
+
+extern EspClass ESP;
+
+#include "host.h"
+
+#endif /*__host_Arduino_h__*/
@@ -0,0 +1,483 @@
+/*
+ * Host shim for ArduinoJson, the tree, the parser and the serializer
+ */
+
+#include "ArduinoJson.h"
+
+JsonNode *JsonNode::member(const std::string &name, bool create)
+{
+    size_t i;
+
+    if (type != J_OBJECT && !(create && type == J_NULL))
+	return NULL;
+    for (i=0; i < kids.size(); i++)
+	if (kids[i].key == name)
+	    return &kids[i];
+    if (!create)
+	return NULL;
+    type = J_OBJECT;
+    kids.push_back(JsonNode());
+    kids.back().key = name;
+    return &kids.back();
+}
+
+JsonNode *JsonNode::item(size_t index, bool create)
+{
+    if (type != J_ARRAY && !(create && type == J_NULL))
+	return NULL;
+    if (index < kids.size())
+	return &kids[index];
+    if (!create)
+	return NULL;
+    type = J_ARRAY;
+    kids.resize(index + 1);
+    return &kids[index];
+}
+
+bool JsonConv<bool>::get(const JsonNode *n)
+{
+    if (n == NULL)
+	return false;
+    switch (n->type) {
+    case JsonNode::J_NULL: return false;
+    case JsonNode::J_BOOL: return n->b;
+    case JsonNode::J_INT: return n->i != 0;
+    case JsonNode::J_REAL: return n->d != 0;
+    default: return true;
+    }
+}
+
+JsonVariant JsonVariant::operator[](const char *key) const
+{
+    JsonVariant v(*this);
+    step s;
+
+    s.isindex = false;
+    s.key = key;
+    s.index = 0;
+    v._path.push_back(s);
+    return v;
+}
+
+JsonVariant JsonVariant::operator[](int index) const
+{
+    JsonVariant v(*this);
+    step s;
+
+    s.isindex = true;
+    s.index = index;
+    v._path.push_back(s);
+    return v;
+}
+
+/*
+ * Walk the path, creating the nodes on it if asked to
+ */
+
+JsonNode *JsonVariant::_resolve(bool create) const
+{
+    JsonNode *n = _base;
+    size_t i;
+
+    for (i=0; n && i < _path.size(); i++)
+	n = _path[i].isindex ? n->item(_path[i].index, create) :
+	    n->member(_path[i].key, create);
+    return n;
+}
+
+JsonVariant &JsonVariant::operator=(const JsonVariant &v)
+{
+    const JsonNode *src = v._resolve(false);
+    JsonNode *n = _resolve(true);
+    std::string key;
+
+    if (n == NULL || n == src)
+	return *this;
+    key = n->key;
+    if (src)
+	*n = JsonNode(*src);
+    else
+	n->clear();
+    n->key = key;
+    return *this;
+}
+
+JsonVariant &JsonVariant::operator=(const char *v)
+{
+    JsonNode *n = _resolve(true);
+
+    if (n == NULL)
+	return *this;
+    n->clear();
+    if (v) {
+	n->type = JsonNode::J_STR;
+	n->s = v;
+    }
+    return *this;
+}
+
+bool JsonVariant::isNull() const
+{
+    const JsonNode *n = _resolve(false);
+
+    return n == NULL || n->type == JsonNode::J_NULL;
+}
+
+size_t JsonVariant::size() const
+{
+    const JsonNode *n = _resolve(false);
+
+    if (n && (n->type == JsonNode::J_ARRAY || n->type == JsonNode::J_OBJECT))
+	return n->kids.size();
+    return 0;
+}
+
+const char *DeserializationError::c_str() const
+{
+    static const char *names[] = {
+	"Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory",
+    };
+
+    return names[_c];
+}
+
+/*
+ * The parser, recursive descent over a nul terminated string
+ */
+
+#define JSON_MAX_NESTING 10
+
+class JsonParser {
+ public:
+    JsonParser(const char *p) : _p(p) {}
+    DeserializationError::Code parse(JsonNode *n, int depth);
+
+ private:
+    const char *_p;
+
+    void _skip() { while (*_p && strchr(" \t\r\n", *_p)) _p++; }
+    DeserializationError::Code _string(std::string *s);
+    DeserializationError::Code _number(JsonNode *n);
+    DeserializationError::Code _word(const char *w);
+};
+
+DeserializationError::Code JsonParser::_word(const char *w)
+{
+    size_t len = strlen(w);
+
+    if (strncmp(_p, w, len) == 0) {
+	_p += len;
+	return DeserializationError::Ok;
+    }
+    if (strncmp(_p, w, strlen(_p)) == 0)
+	return DeserializationError::IncompleteInput;
+    return DeserializationError::InvalidInput;
+}
+
+static void json_put_utf8(std::string *s, unsigned c)
+{
+    if (c < 0x80) {
+	*s += (char)c;
+    } else if (c < 0x800) {
+	*s += (char)(0xc0 | (c >> 6));
+	*s += (char)(0x80 | (c & 0x3f));
+    } else {
+	*s += (char)(0xe0 | (c >> 12));
+	*s += (char)(0x80 | ((c >> 6) & 0x3f));
+	*s += (char)(0x80 | (c & 0x3f));
+    }
+}
+
+DeserializationError::Code JsonParser::_string(std::string *s)
+{
+    unsigned c;
+    int i;
+
+    _p++; /* the " */
+    while (*_p != '"') {
+	if (*_p == '\0')
+	    return DeserializationError::IncompleteInput;
+	if (*_p != '\\') {
+	    *s += *_p++;
+	    continue;
+	}
+	_p++;
+	switch (*_p) {
+	case '"': case '\\': case '/': *s += *_p; break;
+	case 'b': *s += '\b'; break;
+	case 'f': *s += '\f'; break;
+	case 'n': *s += '\n'; break;
+	case 'r': *s += '\r'; break;
+	case 't': *s += '\t'; break;
+	case 'u':
+	    c = 0;
+	    for (i=1; i <= 4; i++) {
+		if (!isxdigit((unsigned char)_p[i]))
+		    return _p[i] ? DeserializationError::InvalidInput :
+			DeserializationError::IncompleteInput;
+		c = c * 16 + (isdigit((unsigned char)_p[i]) ? _p[i] - '0' :
+			      (tolower((unsigned char)_p[i]) - 'a' + 10));
+	    }
+	    json_put_utf8(s, c);
+	    _p += 4;
+	    break;
+	case '\0': return DeserializationError::IncompleteInput;
+	default: return DeserializationError::InvalidInput;
+	}
+	_p++;
+    }
+    _p++;
+    return DeserializationError::Ok;
+}
+
+DeserializationError::Code JsonParser::_number(JsonNode *n)
+{
+    const char *start = _p;
+    bool real = false;
+
+    if (*_p == '-')
+	_p++;
+    if (!isdigit((unsigned char)*_p))
+	return DeserializationError::InvalidInput;
+    while (isdigit((unsigned char)*_p) || strchr(".eE+-", *_p)) {
+	if (!isdigit((unsigned char)*_p))
+	    real = true;
+	_p++;
+    }
+    if (real) {
+	n->type = JsonNode::J_REAL;
+	n->d = strtod(start, NULL);
+    } else {
+	n->type = JsonNode::J_INT;
+	n->i = strtoll(start, NULL, 10);
+    }
+    return DeserializationError::Ok;
+}
+
+DeserializationError::Code JsonParser::parse(JsonNode *n, int depth)
+{
+    DeserializationError::Code err;
+    std::string key;
+
+    if (depth > JSON_MAX_NESTING)
+	return DeserializationError::NoMemory;
+    _skip();
+    switch (*_p) {
+    case '\0':
+	return DeserializationError::IncompleteInput;
+    case 'n':
+	return _word("null");
+    case 't':
+	n->type = JsonNode::J_BOOL;
+	n->b = true;
+	return _word("true");
+    case 'f':
+	n->type = JsonNode::J_BOOL;
+	n->b = false;
+	return _word("false");
+    case '"':
+	n->type = JsonNode::J_STR;
+	return _string(&n->s);
+    case '[':
+	n->type = JsonNode::J_ARRAY;
+	_p++;
+	_skip();
+	if (*_p == ']') {
+	    _p++;
+	    return DeserializationError::Ok;
+	}
+	for (;;) {
+	    n->kids.push_back(JsonNode());
+	    if ((err = parse(&n->kids.back(), depth + 1)))
+		return err;
+	    _skip();
+	    if (*_p == ']') {
+		_p++;
+		return DeserializationError::Ok;
+	    }
+	    if (*_p != ',')
+		return *_p ? DeserializationError::InvalidInput :
+		    DeserializationError::IncompleteInput;
+	    _p++;
+	}
+    case '{':
+	n->type = JsonNode::J_OBJECT;
+	_p++;
+	_skip();
+	if (*_p == '}') {
+	    _p++;
+	    return DeserializationError::Ok;
+	}
+	for (;;) {
+	    _skip();
+	    if (*_p != '"')
+		return *_p ? DeserializationError::InvalidInput :
+		    DeserializationError::IncompleteInput;
+	    key.clear();
+	    if ((err = _string(&key)))
+		return err;
+	    _skip();
+	    if (*_p != ':')
+		return *_p ? DeserializationError::InvalidInput :
+		    DeserializationError::IncompleteInput;
+	    _p++;
+	    n->kids.push_back(JsonNode());
+	    n->kids.back().key = key;
+	    if ((err = parse(&n->kids.back(), depth + 1)))
+		return err;
+	    _skip();
+	    if (*_p == '}') {
+		_p++;
+		return DeserializationError::Ok;
+	    }
+	    if (*_p != ',')
+		return *_p ? DeserializationError::InvalidInput :
+		    DeserializationError::IncompleteInput;
+	    _p++;
+	}
+    default:
+	return _number(n);
+    }
+}
+
+DeserializationError deserializeJson(DynamicJsonDocument &doc,
+				     const char *json)
+{
+    DeserializationError::Code err;
+    JsonParser p(json ? json : "");
+
+    doc.clear();
+    if (json == NULL || *json == '\0')
+	return DeserializationError::EmptyInput;
+    err = p.parse(&doc._host_root(), 0);
+    if (err)
+	doc.clear();
+    return err;
+}
+
+DeserializationError deserializeJson(DynamicJsonDocument &doc,
+				     const String &json)
+{
+    return deserializeJson(doc, json.c_str());
+}
+
+DeserializationError deserializeJson(DynamicJsonDocument &doc, File &file)
+{
+    std::string buf;
+    int c;
+
+    while ((c = file.read()) >= 0)
+	buf += (char)c;
+    return deserializeJson(doc, buf.c_str());
+}
+
+/*
+ * The serializer, compact, as serializeJson() does
+ */
+
+static size_t json_put_string(const std::string &s, Print &out)
+{
+    size_t n = out.print('"');
+    size_t i;
+    char esc[8];
+
+    for (i=0; i < s.size(); i++) {
+	unsigned char c = s[i];
+
+	switch (c) {
+	case '"': n += out.print("\\\""); break;
+	case '\\': n += out.print("\\\\"); break;
+	case '\b': n += out.print("\\b"); break;
+	case '\f': n += out.print("\\f"); break;
+	case '\n': n += out.print("\\n"); break;
+	case '\r': n += out.print("\\r"); break;
+	case '\t': n += out.print("\\t"); break;
+	default:
+	    if (c < 0x20) {
+		snprintf(esc, sizeof(esc), "\\u%04x", c);
+		n += out.print(esc);
+	    } else
+		n += out.write(c);
+	}
+    }
+    return n + out.print('"');
+}
+
+static size_t json_put(const JsonNode *n, Print &out)
+{
+    char buf[32];
+    size_t len = 0;
+    size_t i;
+
+    if (n == NULL)
+	return out.print("null");
+    switch (n->type) {
+    case JsonNode::J_NULL:
+	return out.print("null");
+    case JsonNode::J_BOOL:
+	return out.print(n->b ? "true" : "false");
+    case JsonNode::J_INT:
+	snprintf(buf, sizeof(buf), "%lld", n->i);
+	return out.print(buf);
+    case JsonNode::J_REAL:
+	snprintf(buf, sizeof(buf), "%.9g", n->d);
+	return out.print(buf);
+    case JsonNode::J_STR:
+	return json_put_string(n->s, out);
+    case JsonNode::J_ARRAY:
+	len += out.print('[');
+	for (i=0; i < n->kids.size(); i++) {
+	    if (i)
+		len += out.print(',');
+	    len += json_put(&n->kids[i], out);
+	}
+	return len + out.print(']');
+    case JsonNode::J_OBJECT:
+	len += out.print('{');
+	for (i=0; i < n->kids.size(); i++) {
+	    if (i)
+		len += out.print(',');
+	    len += json_put_string(n->kids[i].key, out);
+	    len += out.print(':');
+	    len += json_put(&n->kids[i], out);
+	}
+	return len + out.print('}');
+    }
+    return 0;
+}
+
+size_t serializeJson(const JsonVariant &v, Print &out)
+{
+    return json_put(v._node(), out);
+}
+
+class JsonStringPrint : public Print {
+ public:
+    JsonStringPrint(String *s) : _s(s) {}
+    size_t write(uint8_t c) { *_s += (char)c; return 1; }
+    using Print::write;
+
+ private:
+    String *_s;
+};
+
+size_t serializeJson(const JsonVariant &v, String &out)
+{
+    JsonStringPrint p(&out);
+
+    out = "";
+    return serializeJson(v, p);
+}
+
+class JsonCountPrint : public Print {
+ public:
+    size_t write(uint8_t c) { (void)c; return 1; }
+    using Print::write;
+};
+
+size_t measureJson(const JsonVariant &v)
+{
+    JsonCountPrint p;
+
+    return serializeJson(v, p);
+}
@@ -0,0 +1,251 @@
+/*
+ * Host shim for the part of ArduinoJson 6 the library uses.
+ *
+ * A document is a tree of nodes, objects keep their members in insertion
+ * order.  A JsonVariant is a path from a node, nodes along the path are
+ * only created when something is assigned through it, so reading a key
+ * that is not there does not add it, as with the real thing.  The
+ * capacity given to DynamicJsonDocument is ignored.
+ */
+
+#ifndef __host_ArduinoJson_h__
+#define __host_ArduinoJson_h__
+
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Arduino.h"
+#include "FS.h"
+
+struct JsonNode {
+    enum {
+	J_NULL,
+	J_BOOL,
+	J_INT,
+	J_REAL,
+	J_STR,
+	J_ARRAY,
+	J_OBJECT,
+    } type;
+    bool b;
+    long long i;
+    double d;
+    std::string s; /* a string value */
+    std::string key; /* the member name, in an object */
+    std::vector<JsonNode> kids;
+
+    JsonNode() : type(J_NULL), b(false), i(0), d(0) {}
+    void clear() { type = J_NULL; s.clear(); kids.clear(); }
+    JsonNode *member(const std::string &name, bool create);
+    JsonNode *item(size_t index, bool create);
+};
+
+class JsonObject;
+
+class JsonString {
+ public:
+    JsonString(const char *s = NULL) : _s(s) {}
+    const char *c_str() const { return _s; }
+    bool isNull() const { return _s == NULL; }
+
+ private:
+    const char *_s;
+};
+
+/*
+ * Conversions of a node to and from the C types
+ */
+
+template <class T, class E = void> struct JsonConv;
+
+template <> struct JsonConv<bool> {
+    static bool get(const JsonNode *n);
+    static void set(JsonNode *n, bool v) {
+	n->clear();
+	n->type = JsonNode::J_BOOL;
+	n->b = v;
+    }
+};
+
+template <class T>
+struct JsonConv<T, typename std::enable_if<std::is_integral<T>::value &&
+					   !std::is_same<T, bool>::value>::type> {
+    static T get(const JsonNode *n) {
+	if (n && n->type == JsonNode::J_INT)
+	    return (T)n->i;
+	if (n && n->type == JsonNode::J_REAL)
+	    return (T)n->d;
+	return 0;
+    }
+    static void set(JsonNode *n, T v) {
+	n->clear();
+	n->type = JsonNode::J_INT;
+	n->i = (long long)v;
+    }
+};
+
+template <class T>
+struct JsonConv<T, typename std::enable_if<
+		       std::is_floating_point<T>::value>::type> {
+    static T get(const JsonNode *n) {
+	if (n && n->type == JsonNode::J_REAL)
+	    return (T)n->d;
+	if (n && n->type == JsonNode::J_INT)
+	    return (T)n->i;
+	return 0;
+    }
+    static void set(JsonNode *n, T v) {
+	n->clear();
+	n->type = JsonNode::J_REAL;
+	n->d = v;
+    }
+};
+
+template <> struct JsonConv<const char *> {
+    static const char *get(const JsonNode *n) {
+	return (n && n->type == JsonNode::J_STR) ? n->s.c_str() : NULL;
+    }
+};
+
+template <> struct JsonConv<String> {
+    static String get(const JsonNode *n) {
+	return String(JsonConv<const char *>::get(n));
+    }
+};
+
+class JsonVariant {
+ public:
+    JsonVariant() : _base(NULL) {}
+    JsonVariant(JsonNode *base) : _base(base) {}
+
+    JsonVariant operator[](const char *key) const;
+    JsonVariant operator[](const String &key) const {
+	return (*this)[key.c_str()];
+    }
+    JsonVariant operator[](int index) const;
+
+    JsonVariant &operator=(const JsonVariant &v);
+    JsonVariant &operator=(const char *v);
+    JsonVariant &operator=(const String &v) { return *this = v.c_str(); }
+    template <class T>
+    typename std::enable_if<std::is_arithmetic<T>::value, JsonVariant &>::type
+    operator=(T v) {
+	JsonNode *n = _resolve(true);
+
+	if (n)
+	    JsonConv<T>::set(n, v);
+	return *this;
+    }
+
+    template <class T> T as() const { return JsonConv<T>::get(_resolve(false)); }
+    template <class T> operator T() const { return as<T>(); }
+    bool isNull() const;
+    size_t size() const;
+
+    /* serializeJson() and the iterators need the node */
+    const JsonNode *_node() const { return _resolve(false); }
+
+ protected:
+    struct step {
+	bool isindex;
+	std::string key;
+	size_t index;
+    };
+    JsonNode *_base;
+    std::vector<step> _path;
+
+    JsonNode *_resolve(bool create) const;
+};
+
+class JsonPair {
+ public:
+    JsonPair(JsonNode *n) : _n(n) {}
+    JsonString key() const { return JsonString(_n->key.c_str()); }
+    JsonVariant value() const { return JsonVariant(_n); }
+
+ private:
+    JsonNode *_n;
+};
+
+class JsonObjectIterator {
+ public:
+    JsonObjectIterator(JsonNode *n) : _n(n) {}
+    JsonPair operator*() const { return JsonPair(_n); }
+    JsonObjectIterator &operator++() { _n++; return *this; }
+    bool operator!=(const JsonObjectIterator &o) const { return _n != o._n; }
+
+ private:
+    JsonNode *_n;
+};
+
+class JsonObject {
+ public:
+    JsonObject(JsonNode *n = NULL) : _n(n) {}
+    JsonObjectIterator begin() const {
+	return JsonObjectIterator(_n ? _n->kids.data() : NULL);
+    }
+    JsonObjectIterator end() const {
+	return JsonObjectIterator(_n ? _n->kids.data() + _n->kids.size() :
+				  NULL);
+    }
+    bool isNull() const { return _n == NULL; }
+    size_t size() const { return _n ? _n->kids.size() : 0; }
+
+ private:
+    JsonNode *_n;
+};
+
+template <> struct JsonConv<JsonObject> {
+    static JsonObject get(const JsonNode *n) {
+	return JsonObject((n && n->type == JsonNode::J_OBJECT) ?
+			  (JsonNode *)n : NULL);
+    }
+};
+
+class DynamicJsonDocument : public JsonVariant {
+ public:
+    DynamicJsonDocument(size_t capacity) : JsonVariant(&_root) {
+	(void)capacity;
+    }
+    DynamicJsonDocument(const DynamicJsonDocument &o)
+	: JsonVariant(&_root), _root(o._root) {}
+    DynamicJsonDocument &operator=(const DynamicJsonDocument &o) {
+	_root = o._root;
+	return *this;
+    }
+    void clear() { _root.clear(); }
+    JsonNode &_host_root() { return _root; }
+
+ private:
+    JsonNode _root;
+};
+
+class DeserializationError {
+ public:
+    enum Code {
+	Ok,
+	EmptyInput,
+	IncompleteInput,
+	InvalidInput,
+	NoMemory,
+    };
+    DeserializationError(Code c = Ok) : _c(c) {}
+    explicit operator bool() const { return _c != Ok; }
+    bool operator==(Code c) const { return _c == c; }
+    Code code() const { return _c; }
+    const char *c_str() const;
+
+ private:
+    Code _c;
+};
+
+DeserializationError deserializeJson(DynamicJsonDocument &doc,
+				     const char *json);
+DeserializationError deserializeJson(DynamicJsonDocument &doc,
+				     const String &json);
+DeserializationError deserializeJson(DynamicJsonDocument &doc, File &file);
+size_t serializeJson(const JsonVariant &v, Print &out);
+size_t serializeJson(const JsonVariant &v, String &out);
+size_t measureJson(const JsonVariant &v);
+
+#endif /*__host_ArduinoJson_h__*/
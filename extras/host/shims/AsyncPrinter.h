@@ -0,0 +1,48 @@
+/*
+ * Host shim for ESPAsyncTCP's AsyncPrinter, a Print on an AsyncClient
+ * that buffers what tcp cannot take yet
+ */
+
+#ifndef __host_AsyncPrinter_h__
+#define __host_AsyncPrinter_h__
+
+#include "ESPAsyncTCP.h"
+
+class AsyncPrinter;
+
+typedef std::function<void(void *, AsyncPrinter *, uint8_t *, size_t)>
+    ApDataHandler;
+typedef std::function<void(void *, AsyncPrinter *)> ApCloseHandler;
+
+class AsyncPrinter : public Print {
+ public:
+    AsyncPrinter();
+    AsyncPrinter(AsyncClient *client, size_t txBufLen = 1460);
+    ~AsyncPrinter();
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char *host, uint16_t port);
+    bool connected();
+    void close();
+    void onData(ApDataHandler cb, void *arg);
+    void onClose(ApCloseHandler cb, void *arg);
+
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *data, size_t len);
+    using Print::write;
+
+ private:
+    AsyncClient *_client;
+    std::string _tx;
+    size_t _txmax;
+    ApDataHandler _data_cb;
+    void *_data_arg;
+    ApCloseHandler _close_cb;
+    void *_close_arg;
+
+    void _attach();
+    void _send();
+    bool _wait_connect();
+};
+
+#endif /*__host_AsyncPrinter_h__*/
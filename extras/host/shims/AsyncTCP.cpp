@@ -0,0 +1,567 @@
+/*
+ * Host shim for ESPAsyncTCP: AsyncClient and AsyncPrinter on POSIX
+ * sockets, and host_poll(), which runs their callbacks
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+#include <vector>
+#include <algorithm>
+#include "ESPAsyncTCP.h"
+#include "AsyncPrinter.h"
+
+/* lwIP on the ESP8266 has 2 * TCP_MSS of send buffer */
+static size_t host_sndbuf = 2920;
+static size_t host_rxchunk;
+
+/* ESPAsyncTCP polls every 500 ms */
+#define HOST_POLL_MS 500
+
+static std::vector<AsyncClient *> host_clients;
+
+void host_tcp_sndbuf(size_t size)
+{
+    host_sndbuf = size;
+}
+
+void host_tcp_rxchunk(size_t size)
+{
+    host_rxchunk = size;
+}
+
+static bool host_alive(AsyncClient *c)
+{
+    return std::find(host_clients.begin(), host_clients.end(), c) !=
+	host_clients.end();
+}
+
+/*
+ * Run whatever socket callbacks are due, waiting up to wait_ms for the
+ * first one.  Callbacks that wait (delay(), yield()) do not recurse.
+ */
+
+void host_poll(int wait_ms)
+{
+    static bool polling;
+    std::vector<AsyncClient *> cl;
+    std::vector<struct pollfd> fds;
+    struct pollfd pfd;
+    struct timespec ts;
+    size_t i;
+
+    if (polling)
+	return;
+    polling = true;
+
+    for (i=0; i < host_clients.size(); i++) {
+	if (host_clients[i]->_host_fd() < 0)
+	    continue;
+	pfd.fd = host_clients[i]->_host_fd();
+	pfd.events = POLLIN;
+	if (host_clients[i]->_host_wants_write())
+	    pfd.events |= POLLOUT;
+	pfd.revents = 0;
+	fds.push_back(pfd);
+	cl.push_back(host_clients[i]);
+    }
+    if (fds.empty()) {
+	if (wait_ms > 0) {
+	    ts.tv_sec = wait_ms / 1000;
+	    ts.tv_nsec = (wait_ms % 1000) * 1000000L;
+	    nanosleep(&ts, NULL);
+	}
+    } else if (poll(&fds[0], fds.size(), wait_ms) > 0) {
+	for (i=0; i < fds.size(); i++)
+	    if (fds[i].revents && host_alive(cl[i]) &&
+		cl[i]->_host_fd() == fds[i].fd)
+		cl[i]->_host_event(fds[i].revents);
+    }
+
+    /* acks and poll callbacks, on a copy, callbacks may close clients */
+    cl = host_clients;
+    for (i=0; i < cl.size(); i++)
+	if (host_alive(cl[i]))
+	    cl[i]->_host_tick(millis());
+    polling = false;
+}
+
+AsyncClient::AsyncClient()
+    : _fd(-1), _state(HOST_TCP_CLOSED), _nodelay(false), _unacked(0),
+      _sent_at(0), _polled(0), _connect_arg(NULL), _discard_arg(NULL),
+      _ack_arg(NULL), _error_arg(NULL), _data_arg(NULL), _timeout_arg(NULL),
+      _poll_arg(NULL)
+{
+    host_clients.push_back(this);
+}
+
+AsyncClient::~AsyncClient()
+{
+    if (_fd >= 0)
+	::close(_fd);
+    host_clients.erase(std::find(host_clients.begin(), host_clients.end(),
+				 this));
+}
+
+/*
+ * Start connecting, the connect or disconnect callback says how it went
+ */
+
+bool AsyncClient::connect(IPAddress ip, uint16_t port)
+{
+    struct sockaddr_in sin;
+
+    if (_fd >= 0)
+	return false;
+    _fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_fd < 0)
+	return false;
+    setNoDelay(_nodelay);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    sin.sin_addr.s_addr = (uint32_t)ip;
+    if (::connect(_fd, (struct sockaddr *)&sin, sizeof(sin)) < 0 &&
+	errno != EINPROGRESS) {
+	::close(_fd);
+	_fd = -1;
+	return false;
+    }
+    _state = HOST_TCP_CONNECTING;
+    _out.clear();
+    _unacked = 0;
+    return true;
+}
+
+/*
+ * The real thing resolves in the background, here the lookup blocks
+ */
+
+bool AsyncClient::connect(const char *host, uint16_t port)
+{
+    struct addrinfo hints, *res;
+    uint32_t addr;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, NULL, &hints, &res) != 0)
+	return false;
+    addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(res);
+    return connect(IPAddress(addr), port);
+}
+
+/*
+ * Whatever is still buffered goes out first, as tcp_close() would
+ */
+
+void AsyncClient::close(bool now)
+{
+    (void)now;
+    if (_fd < 0)
+	return;
+    _output();
+    _closed(0);
+}
+
+/*
+ * The socket is gone, tell the owner
+ */
+
+void AsyncClient::_closed(int err)
+{
+    if (_fd >= 0)
+	::close(_fd);
+    _fd = -1;
+    _state = HOST_TCP_CLOSED;
+    _out.clear();
+    _unacked = 0;
+    if (err && _error_cb)
+	_error_cb(_error_arg, this, -err);
+    if (_discard_cb)
+	_discard_cb(_discard_arg, this);
+}
+
+size_t AsyncClient::space()
+{
+    size_t used = _out.size() + _unacked;
+
+    if (_state != HOST_TCP_UP || used >= host_sndbuf)
+	return 0;
+    return host_sndbuf - used;
+}
+
+size_t AsyncClient::add(const char *data, size_t size, uint8_t apiflags)
+{
+    size_t room = space();
+
+    (void)apiflags;
+    if (size > room)
+	size = room;
+    if (size)
+	_out.append(data, size);
+    return size;
+}
+
+bool AsyncClient::send()
+{
+    if (_state != HOST_TCP_UP)
+	return false;
+    _output();
+    return true;
+}
+
+size_t AsyncClient::write(const char *data, size_t size, uint8_t apiflags)
+{
+    size = add(data, size, apiflags);
+    if (size)
+	send();
+    return size;
+}
+
+/*
+ * Hand the socket as much as it takes
+ */
+
+void AsyncClient::_output()
+{
+    ssize_t n;
+
+    while (_fd >= 0 && _state == HOST_TCP_UP && !_out.empty()) {
+	n = ::send(_fd, _out.data(), _out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+	/* an error shows up in the next host_poll(), as it would from lwIP,
+	   never in the middle of the caller's send() */
+	if (n < 0)
+	    return;
+	if (_unacked == 0)
+	    _sent_at = millis();
+	_unacked += n;
+	_out.erase(0, n);
+    }
+}
+
+void AsyncClient::setNoDelay(bool nodelay)
+{
+    int on = nodelay;
+
+    _nodelay = nodelay;
+    if (_fd >= 0)
+	setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+IPAddress AsyncClient::remoteIP()
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+
+    if (_fd < 0 || getpeername(_fd, (struct sockaddr *)&sin, &len) < 0)
+	return IPAddress();
+    return IPAddress(sin.sin_addr.s_addr);
+}
+
+uint16_t AsyncClient::remotePort()
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+
+    if (_fd < 0 || getpeername(_fd, (struct sockaddr *)&sin, &len) < 0)
+	return 0;
+    return ntohs(sin.sin_port);
+}
+
+IPAddress AsyncClient::localIP()
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+
+    if (_fd < 0 || getsockname(_fd, (struct sockaddr *)&sin, &len) < 0)
+	return IPAddress();
+    return IPAddress(sin.sin_addr.s_addr);
+}
+
+uint16_t AsyncClient::localPort()
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+
+    if (_fd < 0 || getsockname(_fd, (struct sockaddr *)&sin, &len) < 0)
+	return 0;
+    return ntohs(sin.sin_port);
+}
+
+void AsyncClient::onConnect(AcConnectHandler cb, void *arg)
+{
+    _connect_cb = cb;
+    _connect_arg = arg;
+}
+
+void AsyncClient::onDisconnect(AcConnectHandler cb, void *arg)
+{
+    _discard_cb = cb;
+    _discard_arg = arg;
+}
+
+void AsyncClient::onAck(AcAckHandler cb, void *arg)
+{
+    _ack_cb = cb;
+    _ack_arg = arg;
+}
+
+void AsyncClient::onError(AcErrorHandler cb, void *arg)
+{
+    _error_cb = cb;
+    _error_arg = arg;
+}
+
+void AsyncClient::onData(AcDataHandler cb, void *arg)
+{
+    _data_cb = cb;
+    _data_arg = arg;
+}
+
+void AsyncClient::onTimeout(AcTimeoutHandler cb, void *arg)
+{
+    _timeout_cb = cb;
+    _timeout_arg = arg;
+}
+
+void AsyncClient::onPoll(AcConnectHandler cb, void *arg)
+{
+    _poll_cb = cb;
+    _poll_arg = arg;
+}
+
+/*
+ * The socket is ready for something
+ */
+
+void AsyncClient::_host_event(short revents)
+{
+    char buf[1460];
+    socklen_t len;
+    size_t want;
+    ssize_t n;
+    int err, fd = _fd;
+
+    if (_state == HOST_TCP_CONNECTING) {
+	err = 0;
+	len = sizeof(err);
+	getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+	if (err || (revents & (POLLERR | POLLHUP))) {
+	    _closed(err ? err : ECONNREFUSED);
+	    return;
+	}
+	if (!(revents & POLLOUT))
+	    return;
+	_state = HOST_TCP_UP;
+	_polled = millis();
+	if (_connect_cb)
+	    _connect_cb(_connect_arg, this);
+	return;
+    }
+
+    if (revents & (POLLIN | POLLHUP | POLLERR)) {
+	want = sizeof(buf);
+	if (host_rxchunk && host_rxchunk < want)
+	    want = host_rxchunk;
+	/* one segment per callback, like a pbuf; a callback may close us,
+	   or even start the next connection */
+	while (_fd == fd) {
+	    n = recv(_fd, buf, want, MSG_DONTWAIT);
+	    if (n > 0) {
+		if (_data_cb)
+		    _data_cb(_data_arg, this, buf, n);
+		continue;
+	    }
+	    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		break;
+	    _closed((n < 0) ? errno : 0);
+	    return;
+	}
+    }
+    if (_fd == fd && (revents & POLLOUT))
+	_output();
+}
+
+/*
+ * Acks for what the peer got, and the poll callback
+ */
+
+void AsyncClient::_host_tick(uint32_t now)
+{
+    size_t acked;
+    int outq = 0;
+
+    if (_state != HOST_TCP_UP)
+	return;
+    _output();
+    if (_fd >= 0 && _unacked) {
+	if (ioctl(_fd, SIOCOUTQ, &outq) < 0)
+	    outq = 0;
+	if ((size_t)outq < _unacked) {
+	    acked = _unacked - outq;
+	    _unacked = outq;
+	    if (_ack_cb)
+		_ack_cb(_ack_arg, this, acked, now - _sent_at);
+	    _sent_at = now;
+	}
+    }
+    if (_state == HOST_TCP_UP && now - _polled >= HOST_POLL_MS) {
+	_polled = now;
+	if (_poll_cb)
+	    _poll_cb(_poll_arg, this);
+    }
+}
+
+/* AsyncPrinter */
+
+AsyncPrinter::AsyncPrinter()
+    : _client(NULL), _txmax(1460), _data_arg(NULL), _close_arg(NULL)
+{
+}
+
+AsyncPrinter::AsyncPrinter(AsyncClient *client, size_t txBufLen)
+    : _client(client), _txmax(txBufLen), _data_arg(NULL), _close_arg(NULL)
+{
+    _attach();
+}
+
+AsyncPrinter::~AsyncPrinter()
+{
+    if (_client) {
+	_client->onDisconnect(NULL, NULL);
+	_client->close(true);
+	delete _client;
+    }
+}
+
+void AsyncPrinter::_attach()
+{
+    _client->onData([this](void *arg, AsyncClient *c, void *data,
+			   size_t len) {
+	    (void)arg;
+	    (void)c;
+	    if (_data_cb)
+		_data_cb(_data_arg, this, (uint8_t *)data, len);
+	}, NULL);
+    _client->onAck([this](void *arg, AsyncClient *c, size_t len,
+			  uint32_t time) {
+	    (void)arg;
+	    (void)c;
+	    (void)len;
+	    (void)time;
+	    _send();
+	}, NULL);
+    _client->onDisconnect([this](void *arg, AsyncClient *c) {
+	    (void)arg;
+	    (void)c;
+	    _tx.clear();
+	    if (_close_cb)
+		_close_cb(_close_arg, this);
+	}, NULL);
+}
+
+/*
+ * Like the real one, connect() waits until it is up
+ */
+
+bool AsyncPrinter::_wait_connect()
+{
+    while (_client->connecting())
+	delay(1);
+    return _client->connected();
+}
+
+int AsyncPrinter::connect(IPAddress ip, uint16_t port)
+{
+    if (_client == NULL) {
+	_client = new AsyncClient();
+	_attach();
+    }
+    if (!_client->connect(ip, port))
+	return 0;
+    return _wait_connect();
+}
+
+int AsyncPrinter::connect(const char *host, uint16_t port)
+{
+    if (_client == NULL) {
+	_client = new AsyncClient();
+	_attach();
+    }
+    if (!_client->connect(host, port))
+	return 0;
+    return _wait_connect();
+}
+
+bool AsyncPrinter::connected()
+{
+    return _client && _client->connected();
+}
+
+void AsyncPrinter::close()
+{
+    if (_client)
+	_client->close(true);
+}
+
+void AsyncPrinter::onData(ApDataHandler cb, void *arg)
+{
+    _data_cb = cb;
+    _data_arg = arg;
+}
+
+void AsyncPrinter::onClose(ApCloseHandler cb, void *arg)
+{
+    _close_cb = cb;
+    _close_arg = arg;
+}
+
+size_t AsyncPrinter::write(uint8_t data)
+{
+    return write(&data, 1);
+}
+
+/*
+ * Buffer up to txBufLen, then wait for tcp to make room
+ */
+
+size_t AsyncPrinter::write(const uint8_t *data, size_t len)
+{
+    size_t n, done = 0;
+
+    while (done < len && connected()) {
+	n = _txmax - _tx.size();
+	if (n > len - done)
+	    n = len - done;
+	_tx.append((const char *)data + done, n);
+	done += n;
+	_send();
+	if (done < len)
+	    delay(1);
+    }
+    return done;
+}
+
+void AsyncPrinter::_send()
+{
+    size_t n;
+
+    if (_tx.empty() || !connected())
+	return;
+    n = _client->add(_tx.data(), _tx.size());
+    if (n) {
+	_tx.erase(0, n);
+	_client->send();
+    }
+}
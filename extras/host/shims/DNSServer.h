@@ -0,0 +1,14 @@
+/*
+ * Host shim for DNSServer, only the captive portal uses it
+ */
+
+#ifndef __host_DNSServer_h__
+#define __host_DNSServer_h__
+
+class DNSServer {
+ public:
+    void processNextRequest() {}
+    void stop() {}
+};
+
+#endif /*__host_DNSServer_h__*/
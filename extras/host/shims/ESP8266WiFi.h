@@ -0,0 +1,72 @@
+/*
+ * Host shim for ESP8266WiFi: the host is always on the network (unless a
+ * test says otherwise with host_wifi_connected()), on 127.0.0.1.
+ */
+
+#ifndef __host_ESP8266WiFi_h__
+#define __host_ESP8266WiFi_h__
+
+#include "Arduino.h"
+
+/* in network byte order, as in the core, so 1.2.3.4 is 0x04030201 */
+class IPAddress : public Printable {
+ public:
+    IPAddress() : _addr(0) {}
+    IPAddress(uint32_t addr) : _addr(addr) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+	: _addr(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+
+    operator uint32_t() const { return _addr; }
+    uint8_t operator[](int i) const { return (_addr >> (8 * i)) & 0xff; }
+    bool isSet() const { return _addr != 0; }
+    bool fromString(const char *str);
+    String toString() const;
+    size_t printTo(Print &p) const { return p.print(toString()); }
+
+ private:
+    uint32_t _addr;
+};
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3,
+} WiFiMode_t;
+
+class WiFiClass {
+ public:
+    wl_status_t status();
+    String SSID();
+    String psk();
+    wl_status_t begin();
+    wl_status_t begin(const char *ssid, const char *pass = NULL,
+		      int32_t channel = 0, const uint8_t *bssid = NULL,
+		      bool connect = true);
+    bool config(IPAddress ip, IPAddress gw, IPAddress mask,
+		IPAddress dns1 = (uint32_t)0, IPAddress dns2 = (uint32_t)0);
+    bool mode(WiFiMode_t m);
+    WiFiMode_t getMode();
+    bool setAutoReconnect(bool on);
+    bool disconnect(bool wifioff = false);
+    uint8_t *BSSID();
+    int32_t channel();
+    int32_t RSSI() { return -50; }
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    IPAddress subnetMask();
+    IPAddress dnsIP(uint8_t n = 0);
+    String macAddress() { return String("de:ad:be:ef:00:01"); }
+};
+
+extern WiFiClass WiFi;
+
+#endif /*__host_ESP8266WiFi_h__*/
@@ -0,0 +1,24 @@
+/*
+ * Host shim for ESP8266mDNS: queryService() answers what a test gave
+ * host_mdns_answer(), or nothing, at once, and counts the queries
+ */
+
+#ifndef __host_ESP8266mDNS_h__
+#define __host_ESP8266mDNS_h__
+
+#include "ESP8266WiFi.h"
+
+class MDNSResponder {
+ public:
+    bool begin(const char *hostname) { (void)hostname; return true; }
+    void update() {}
+    int queryService(const char *service, const char *proto,
+		     const uint16_t timeout = 1000);
+    IPAddress IP(int i);
+    uint16_t port(int i);
+    String hostname(int i);
+};
+
+extern MDNSResponder MDNS;
+
+#endif /*__host_ESP8266mDNS_h__*/
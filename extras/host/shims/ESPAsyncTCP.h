@@ -0,0 +1,115 @@
+/*
+ * Host shim for ESPAsyncTCP, on non-blocking POSIX sockets.
+ *
+ * The callbacks behave as on the ESP8266, but run from host_poll()
+ * instead of the lwIP task.  space() reports an lwIP sized send buffer
+ * (host_tcp_sndbuf()), and bytes count as acked once the peer's tcp has
+ * acked them (SIOCOUTQ), so the library's flow control sees the same
+ * back pressure it would on the ESP.  close() calls the disconnect
+ * callback right away, as ESPAsyncTCP does.
+ */
+
+#ifndef __host_ESPAsyncTCP_h__
+#define __host_ESPAsyncTCP_h__
+
+#include "Arduino.h"
+#include "ESP8266WiFi.h"
+
+#define ASYNC_WRITE_FLAG_COPY 0x01
+#define ASYNC_WRITE_FLAG_MORE 0x02
+
+class AsyncClient;
+
+typedef std::function<void(void *, AsyncClient *)> AcConnectHandler;
+typedef std::function<void(void *, AsyncClient *, size_t len,
+			   uint32_t time)> AcAckHandler;
+typedef std::function<void(void *, AsyncClient *, int8_t error)>
+    AcErrorHandler;
+typedef std::function<void(void *, AsyncClient *, void *data, size_t len)>
+    AcDataHandler;
+typedef std::function<void(void *, AsyncClient *, uint32_t time)>
+    AcTimeoutHandler;
+
+class AsyncClient {
+ public:
+    AsyncClient();
+    ~AsyncClient();
+
+    bool connect(IPAddress ip, uint16_t port);
+    bool connect(const char *host, uint16_t port);
+    void close(bool now = false);
+    void stop() { close(false); }
+    bool connected() { return _state == HOST_TCP_UP; }
+    bool connecting() { return _state == HOST_TCP_CONNECTING; }
+    bool disconnected() { return _state == HOST_TCP_CLOSED; }
+    bool freeable() { return _state == HOST_TCP_CLOSED; }
+
+    size_t space();
+    bool canSend() { return space() > 0; }
+    size_t add(const char *data, size_t size,
+	       uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+    bool send();
+    size_t write(const char *data) { return write(data, strlen(data)); }
+    size_t write(const char *data, size_t size,
+		 uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+
+    void setNoDelay(bool nodelay);
+    bool getNoDelay() { return _nodelay; }
+    void setRxTimeout(uint32_t timeout) { (void)timeout; }
+    void setAckTimeout(uint32_t timeout) { (void)timeout; }
+
+    IPAddress remoteIP();
+    uint16_t remotePort();
+    IPAddress localIP();
+    uint16_t localPort();
+
+    void onConnect(AcConnectHandler cb, void *arg = 0);
+    void onDisconnect(AcConnectHandler cb, void *arg = 0);
+    void onAck(AcAckHandler cb, void *arg = 0);
+    void onError(AcErrorHandler cb, void *arg = 0);
+    void onData(AcDataHandler cb, void *arg = 0);
+    void onTimeout(AcTimeoutHandler cb, void *arg = 0);
+    void onPoll(AcConnectHandler cb, void *arg = 0);
+
+    /* host_poll() internals */
+    int _host_fd() { return _fd; }
+    bool _host_wants_write() {
+	return _state == HOST_TCP_CONNECTING || !_out.empty();
+    }
+    void _host_event(short revents);
+    void _host_tick(uint32_t now);
+
+ private:
+    enum {
+	HOST_TCP_CLOSED,
+	HOST_TCP_CONNECTING,
+	HOST_TCP_UP,
+    };
+    int _fd;
+    int _state;
+    bool _nodelay;
+    std::string _out; /* added, not yet written to the socket */
+    size_t _unacked; /* written to the socket, not yet acked */
+    uint32_t _sent_at; /* millis() of the first unacked write */
+    uint32_t _polled; /* millis() of the last poll callback */
+
+    AcConnectHandler _connect_cb;
+    void *_connect_arg;
+    AcConnectHandler _discard_cb;
+    void *_discard_arg;
+    AcAckHandler _ack_cb;
+    void *_ack_arg;
+    AcErrorHandler _error_cb;
+    void *_error_arg;
+    AcDataHandler _data_cb;
+    void *_data_arg;
+    AcTimeoutHandler _timeout_cb;
+    void *_timeout_arg;
+    AcConnectHandler _poll_cb;
+    void *_poll_arg;
+
+    void _output();
+    void _closed(int err);
+};
+
+#endif /*__host_ESPAsyncTCP_h__*/
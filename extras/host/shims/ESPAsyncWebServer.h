@@ -0,0 +1,191 @@
+/*
+ * Host shim for ESPAsyncWebServer.  Nothing listens: the routes are kept,
+ * and host_handle() runs a request built by a test through them, as if
+ * it came in over http, and keeps the response for the test to look at.
+ */
+
+#ifndef __host_ESPAsyncWebServer_h__
+#define __host_ESPAsyncWebServer_h__
+
+#include <list>
+#include <vector>
+#include "ESPAsyncTCP.h"
+#include "FS.h"
+
+typedef enum {
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebParameter {
+ public:
+    AsyncWebParameter(const String &name, const String &value,
+		      bool form = false, bool file = false, size_t size = 0)
+	: _name(name), _value(value), _size(size), _isForm(form),
+	  _isFile(file) {}
+    const String &name() const { return _name; }
+    const String &value() const { return _value; }
+    size_t size() const { return _size; }
+    bool isPost() const { return _isForm; }
+    bool isFile() const { return _isFile; }
+
+ private:
+    String _name;
+    String _value;
+    size_t _size;
+    bool _isForm;
+    bool _isFile;
+};
+
+class AsyncWebServerResponse {
+ public:
+    AsyncWebServerResponse(int code = 200, const String &type = String(),
+			   const String &content = String())
+	: _code(code), _type(type), _body(content) {}
+    virtual ~AsyncWebServerResponse() {}
+    void setCode(int code) { _code = code; }
+    void addHeader(const String &name, const String &value) {
+	_headers.push_back(std::make_pair(name, value));
+    }
+    int code() const { return _code; }
+    const String &contentType() const { return _type; }
+    const String &body() const { return _body; }
+    const char *header(const char *name) const;
+
+ protected:
+    int _code;
+    String _type;
+    String _body;
+    std::vector<std::pair<String, String> > _headers;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print {
+ public:
+    AsyncResponseStream(const String &type, size_t bufferSize = 1460)
+	: AsyncWebServerResponse(200, type) { (void)bufferSize; }
+    size_t write(uint8_t c) { _body += (char)c; return 1; }
+    size_t write(const uint8_t *buf, size_t len) {
+	_body += String(std::string((const char *)buf, len));
+	return len;
+    }
+    using Print::write;
+};
+
+class AsyncWebServerRequest {
+ public:
+    AsyncWebServerRequest(WebRequestMethodComposite method, const char *url)
+	: _method(method), _url(url), _contentLength(0), _response(NULL),
+	  _upload_data(NULL), _upload_len(0) {}
+    ~AsyncWebServerRequest();
+
+    WebRequestMethodComposite method() const { return _method; }
+    const String &url() const { return _url; }
+    size_t contentLength() const { return _contentLength; }
+
+    size_t params() const { return _params.size(); }
+    bool hasParam(const char *name, bool post = false,
+		  bool file = false) const;
+    bool hasParam(const String &name, bool post = false,
+		  bool file = false) const {
+	return hasParam(name.c_str(), post, file);
+    }
+    AsyncWebParameter *getParam(const char *name, bool post = false,
+				bool file = false) const;
+    AsyncWebParameter *getParam(const String &name, bool post = false,
+				bool file = false) const {
+	return getParam(name.c_str(), post, file);
+    }
+    AsyncWebParameter *getParam(size_t i) const {
+	return (i < _params.size()) ? _params[i] : NULL;
+    }
+
+    void send(AsyncWebServerResponse *response);
+    void send(int code, const String &type = String(),
+	      const String &content = String()) {
+	send(beginResponse(code, type, content));
+    }
+    void send(FSClass &fs, const String &path, const String &type = String(),
+	      bool download = false);
+    void redirect(const char *url);
+    AsyncWebServerResponse *beginResponse(int code,
+					  const String &type = String(),
+					  const String &content = String()) {
+	return new AsyncWebServerResponse(code, type, content);
+    }
+    AsyncResponseStream *beginResponseStream(const String &type,
+					     size_t bufferSize = 1460) {
+	return new AsyncResponseStream(type, bufferSize);
+    }
+
+    /* host: set up the request, and see what was sent back */
+    void host_param(const char *name, const char *value, bool post = false);
+    void host_upload(const char *filename, const uint8_t *data, size_t len);
+    AsyncWebServerResponse *host_response() const { return _response; }
+
+ private:
+    friend class AsyncWebServer;
+    WebRequestMethodComposite _method;
+    String _url;
+    size_t _contentLength;
+    std::vector<AsyncWebParameter *> _params;
+    AsyncWebServerResponse *_response;
+    String _upload_name;
+    const uint8_t *_upload_data;
+    size_t _upload_len;
+};
+
+typedef std::function<void(AsyncWebServerRequest *request)>
+    ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request,
+			   const String &filename, size_t index,
+			   uint8_t *data, size_t len, bool final)>
+    ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, uint8_t *data,
+			   size_t len, size_t index, size_t total)>
+    ArBodyHandlerFunction;
+
+class AsyncCallbackWebHandler {
+ public:
+    String uri;
+    WebRequestMethodComposite method;
+    ArRequestHandlerFunction onRequest;
+    ArUploadHandlerFunction onUpload;
+    ArBodyHandlerFunction onBody;
+};
+
+class AsyncWebServer {
+ public:
+    AsyncWebServer(uint16_t port) : _port(port) {}
+    void begin() {}
+    void end() {}
+    void reset() { _handlers.clear(); _notfound = NULL; }
+
+    AsyncCallbackWebHandler &on(const char *uri,
+				ArRequestHandlerFunction onRequest) {
+	return on(uri, HTTP_ANY, onRequest);
+    }
+    AsyncCallbackWebHandler &on(const char *uri,
+				WebRequestMethodComposite method,
+				ArRequestHandlerFunction onRequest,
+				ArUploadHandlerFunction onUpload = NULL,
+				ArBodyHandlerFunction onBody = NULL);
+    void onNotFound(ArRequestHandlerFunction fn) { _notfound = fn; }
+
+    /* host: run req through the routes, the response is then in req */
+    AsyncWebServerResponse *host_handle(AsyncWebServerRequest *req);
+
+ private:
+    uint16_t _port;
+    std::list<AsyncCallbackWebHandler> _handlers;
+    ArRequestHandlerFunction _notfound;
+};
+
+#endif /*__host_ESPAsyncWebServer_h__*/
@@ -0,0 +1,54 @@
+/*
+ * Host shim for ESPAsyncWiFiManager: the network is always there, so
+ * autoConnect() succeeds and the portal never gets a visitor.  The
+ * parameters keep the defaults they were given.
+ */
+
+#ifndef __host_ESPAsyncWiFiManager_h__
+#define __host_ESPAsyncWiFiManager_h__
+
+#include "ESPAsyncWebServer.h"
+#include "DNSServer.h"
+
+class AsyncWiFiManagerParameter {
+ public:
+    AsyncWiFiManagerParameter(const char *id, const char *placeholder,
+			      const char *defvalue, int length)
+	: _id(id), _value(defvalue ? defvalue : "") {
+	(void)placeholder;
+	if (_value.size() > (size_t)length)
+	    _value.resize(length);
+    }
+    const char *getID() { return _id.c_str(); }
+    const char *getValue() { return _value.c_str(); }
+
+ private:
+    std::string _id;
+    std::string _value;
+};
+
+class AsyncWiFiManager {
+ public:
+    AsyncWiFiManager(AsyncWebServer *server, DNSServer *dns) {
+	(void)server;
+	(void)dns;
+    }
+    void setDebugOutput(bool on) { (void)on; }
+    void setMinimumSignalQuality(int quality = 8) { (void)quality; }
+    void setSaveConfigCallback(std::function<void()> cb) { (void)cb; }
+    void addParameter(AsyncWiFiManagerParameter *p) { (void)p; }
+    bool autoConnect(const char *ap, const char *pass = NULL) {
+	(void)ap;
+	(void)pass;
+	return true;
+    }
+    void startConfigPortalModeless(const char *ap, const char *pass) {
+	(void)ap;
+	(void)pass;
+	host_wifi_portals++;
+    }
+    void loop() {}
+    void resetSettings() {}
+};
+
+#endif /*__host_ESPAsyncWiFiManager_h__*/
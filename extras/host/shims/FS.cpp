@@ -0,0 +1,211 @@
+/*
+ * Host shim for SPIFFS, on top of a plain directory.  SPIFFS has no
+ * directories, so a path is flattened into one file name.
+ */
+
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "FS.h"
+
+FSClass SPIFFS;
+
+static std::string host_fs_dir;
+
+void host_fs_root(const char *dir)
+{
+    host_fs_dir = dir;
+}
+
+static const char *host_fs_dirname()
+{
+    const char *env;
+
+    if (host_fs_dir.empty()) {
+	env = getenv("GN_HOST_FS");
+	host_fs_dir = (env && *env) ? env : "./spiffs";
+    }
+    return host_fs_dir.c_str();
+}
+
+/*
+ * Where path lives on the host, "/a/b.json" is <root>/a%b.json
+ */
+
+const char *host_fs_path(const char *path, char *buf, size_t len)
+{
+    std::string name;
+
+    if (*path == '/')
+	path++;
+    for (; *path; path++)
+	name += (*path == '/') ? '%' : *path;
+    snprintf(buf, len, "%s/%s", host_fs_dirname(), name.c_str());
+    return buf;
+}
+
+File::File(FILE *fp, const char *name)
+    : _fp(fp, fclose), _name(name)
+{
+}
+
+size_t File::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t *buf, size_t len)
+{
+    if (!_fp)
+	return 0;
+    return fwrite(buf, 1, len, _fp.get());
+}
+
+int File::read()
+{
+    uint8_t c;
+
+    return (read(&c, 1) == 1) ? c : -1;
+}
+
+size_t File::read(uint8_t *buf, size_t len)
+{
+    if (!_fp)
+	return 0;
+    return fread(buf, 1, len, _fp.get());
+}
+
+int File::peek()
+{
+    int c;
+
+    if (!_fp)
+	return -1;
+    c = getc(_fp.get());
+    if (c != EOF)
+	ungetc(c, _fp.get());
+    return (c == EOF) ? -1 : c;
+}
+
+int File::available()
+{
+    if (!_fp)
+	return 0;
+    return size() - position();
+}
+
+void File::flush()
+{
+    if (_fp)
+	fflush(_fp.get());
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+    static const int whence[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+
+    if (!_fp)
+	return false;
+    return fseek(_fp.get(), pos, whence[mode]) == 0;
+}
+
+size_t File::position() const
+{
+    long pos;
+
+    if (!_fp)
+	return 0;
+    pos = ftell(_fp.get());
+    return (pos < 0) ? 0 : pos;
+}
+
+size_t File::size() const
+{
+    struct stat st;
+
+    if (!_fp)
+	return 0;
+    fflush(_fp.get());
+    if (fstat(fileno(_fp.get()), &st) < 0)
+	return 0;
+    return st.st_size;
+}
+
+void File::close()
+{
+    _fp.reset();
+}
+
+bool FSClass::begin()
+{
+    const char *dir = host_fs_dirname();
+
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+	perror(dir);
+	return false;
+    }
+    return true;
+}
+
+/*
+ * Remove everything
+ */
+
+bool FSClass::format()
+{
+    char path[512];
+    struct dirent *de;
+    DIR *d;
+
+    d = opendir(host_fs_dirname());
+    if (d == NULL)
+	return begin();
+    while ((de = readdir(d)) != NULL) {
+	if (de->d_name[0] == '.')
+	    continue;
+	snprintf(path, sizeof(path), "%s/%s", host_fs_dirname(), de->d_name);
+	unlink(path);
+    }
+    closedir(d);
+    return true;
+}
+
+bool FSClass::exists(const char *path)
+{
+    char buf[512];
+
+    return access(host_fs_path(path, buf, sizeof(buf)), F_OK) == 0;
+}
+
+/*
+ * The core only takes "r", "w", "a" and their "+" forms, so does fopen
+ */
+
+File FSClass::open(const char *path, const char *mode)
+{
+    char buf[512];
+    FILE *fp;
+
+    fp = fopen(host_fs_path(path, buf, sizeof(buf)), mode);
+    if (fp == NULL)
+	return File();
+    return File(fp, path);
+}
+
+bool FSClass::remove(const char *path)
+{
+    char buf[512];
+
+    return unlink(host_fs_path(path, buf, sizeof(buf))) == 0;
+}
+
+bool FSClass::rename(const char *from, const char *to)
+{
+    char fbuf[512], tbuf[512];
+
+    if (exists(to))
+	return false;
+    return ::rename(host_fs_path(from, fbuf, sizeof(fbuf)),
+		    host_fs_path(to, tbuf, sizeof(tbuf))) == 0;
+}
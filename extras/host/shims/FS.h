@@ -0,0 +1,64 @@
+/*
+ * Host shim for the ESP8266 FS: SPIFFS is a directory, see host_fs_root().
+ * Like SPIFFS, rename() will not replace an existing file.
+ */
+
+#ifndef __host_FS_h__
+#define __host_FS_h__
+
+#include <memory>
+#include "Arduino.h"
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2,
+};
+
+class File : public Print {
+ public:
+    File() {}
+    File(FILE *fp, const char *name);
+
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buf, size_t len);
+    using Print::write;
+    int read();
+    size_t read(uint8_t *buf, size_t len);
+    int peek();
+    int available();
+    void flush();
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    const char *name() const { return _name.c_str(); }
+    void close();
+    explicit operator bool() const { return (bool)_fp; }
+
+ private:
+    std::shared_ptr<FILE> _fp;
+    std::string _name;
+};
+
+class FSClass {
+ public:
+    bool begin();
+    void end() {}
+    bool format();
+    bool exists(const char *path);
+    bool exists(const String &path) { return exists(path.c_str()); }
+    File open(const char *path, const char *mode);
+    File open(const String &path, const char *mode) {
+	return open(path.c_str(), mode);
+    }
+    bool remove(const char *path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char *from, const char *to);
+    bool rename(const String &from, const String &to) {
+	return rename(from.c_str(), to.c_str());
+    }
+};
+
+extern FSClass SPIFFS;
+
+#endif /*__host_FS_h__*/
@@ -0,0 +1,42 @@
+/*
+ * Host shim for the OTA updater: takes the image and throws it away
+ */
+
+#ifndef __host_Updater_h__
+#define __host_Updater_h__
+
+#include "Arduino.h"
+
+#define U_FLASH 0
+#define U_SPIFFS 100
+
+class UpdaterClass {
+ public:
+    void runAsync(bool async) { (void)async; }
+    bool begin(size_t size, int command = U_FLASH) {
+	(void)command;
+	_size = size;
+	_progress = 0;
+	return true;
+    }
+    size_t write(uint8_t *data, size_t len) {
+	(void)data;
+	_progress += len;
+	return len;
+    }
+    bool end(bool even_if_remaining = false) {
+	return even_if_remaining || _progress == _size;
+    }
+    size_t progress() { return _progress; }
+    size_t size() { return _size; }
+    bool hasError() { return false; }
+    void printError(Print &out) { out.println("host: no update error"); }
+
+ private:
+    size_t _size = 0;
+    size_t _progress = 0;
+};
+
+extern UpdaterClass Update;
+
+#endif /*__host_Updater_h__*/
@@ -0,0 +1,144 @@
+/*
+ * Host shim for ESPAsyncWebServer, the routing and the responses
+ */
+
+#include "ESPAsyncWebServer.h"
+
+const char *AsyncWebServerResponse::header(const char *name) const
+{
+    size_t i;
+
+    for (i=0; i < _headers.size(); i++)
+	if (_headers[i].first == name)
+	    return _headers[i].second.c_str();
+    return NULL;
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest()
+{
+    size_t i;
+
+    for (i=0; i < _params.size(); i++)
+	delete _params[i];
+    delete _response;
+}
+
+bool AsyncWebServerRequest::hasParam(const char *name, bool post,
+				     bool file) const
+{
+    return getParam(name, post, file) != NULL;
+}
+
+AsyncWebParameter *AsyncWebServerRequest::getParam(const char *name,
+						   bool post,
+						   bool file) const
+{
+    size_t i;
+
+    for (i=0; i < _params.size(); i++)
+	if (_params[i]->name() == name && _params[i]->isPost() == post &&
+	    _params[i]->isFile() == file)
+	    return _params[i];
+    return NULL;
+}
+
+/*
+ * Only the first response counts, as on the real thing
+ */
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response)
+{
+    if (_response) {
+	delete response;
+	return;
+    }
+    _response = response;
+}
+
+void AsyncWebServerRequest::send(FSClass &fs, const String &path,
+				 const String &type, bool download)
+{
+    AsyncResponseStream *r;
+    uint8_t buf[256];
+    size_t n;
+    File f;
+
+    (void)download;
+    f = fs.open(path, "r");
+    if (!f) {
+	send(404);
+	return;
+    }
+    r = beginResponseStream(type);
+    while ((n = f.read(buf, sizeof(buf))) > 0)
+	r->write(buf, n);
+    f.close();
+    send(r);
+}
+
+void AsyncWebServerRequest::redirect(const char *url)
+{
+    AsyncWebServerResponse *r = beginResponse(302);
+
+    r->addHeader("Location", url);
+    send(r);
+}
+
+void AsyncWebServerRequest::host_param(const char *name, const char *value,
+				       bool post)
+{
+    _params.push_back(new AsyncWebParameter(name, value, post));
+    if (post)
+	_contentLength += strlen(name) + strlen(value) + 2;
+}
+
+/*
+ * The upload is handed over in one piece, index 0 and final
+ */
+
+void AsyncWebServerRequest::host_upload(const char *filename,
+					const uint8_t *data, size_t len)
+{
+    _upload_name = filename;
+    _upload_data = data;
+    _upload_len = len;
+    _contentLength = len;
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri,
+					    WebRequestMethodComposite method,
+					    ArRequestHandlerFunction onRequest,
+					    ArUploadHandlerFunction onUpload,
+					    ArBodyHandlerFunction onBody)
+{
+    AsyncCallbackWebHandler h;
+
+    h.uri = uri;
+    h.method = method;
+    h.onRequest = onRequest;
+    h.onUpload = onUpload;
+    h.onBody = onBody;
+    _handlers.push_back(h);
+    return _handlers.back();
+}
+
+AsyncWebServerResponse *AsyncWebServer::host_handle(AsyncWebServerRequest *req)
+{
+    std::list<AsyncCallbackWebHandler>::iterator h;
+
+    for (h = _handlers.begin(); h != _handlers.end(); ++h) {
+	if (!(h->method & req->method()) || h->uri != req->url())
+	    continue;
+	if (req->_upload_data && h->onUpload)
+	    h->onUpload(req, req->_upload_name, 0,
+			(uint8_t *)req->_upload_data, req->_upload_len, true);
+	if (h->onRequest)
+	    h->onRequest(req);
+	return req->host_response();
+    }
+    if (_notfound)
+	_notfound(req);
+    else
+	req->send(404);
+    return req->host_response();
+}
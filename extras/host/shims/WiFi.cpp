@@ -0,0 +1,176 @@
+/*
+ * Host shim for the network side of the core: WiFi, MDNS and Update
+ */
+
+#include <arpa/inet.h>
+#include "ESP8266WiFi.h"
+#include "ESP8266mDNS.h"
+#include "Updater.h"
+
+WiFiClass WiFi;
+MDNSResponder MDNS;
+UpdaterClass Update;
+
+int host_wifi_portals;
+
+static bool host_wifi_up = true;
+static uint8_t host_bssid[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static uint32_t host_mdns_ip;
+static uint16_t host_mdns_port;
+int host_mdns_queries;
+uint16_t host_mdns_timeout;
+
+void host_wifi_connected(bool up)
+{
+    host_wifi_up = up;
+}
+
+void host_mdns_answer(const char *ip, uint16_t port)
+{
+    host_mdns_ip = inet_addr(ip);
+    host_mdns_port = port;
+}
+
+bool IPAddress::fromString(const char *str)
+{
+    struct in_addr in;
+
+    if (inet_aton(str, &in) == 0)
+	return false;
+    _addr = in.s_addr;
+    return true;
+}
+
+String IPAddress::toString() const
+{
+    char buf[16];
+
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1],
+	     (*this)[2], (*this)[3]);
+    return String(buf);
+}
+
+wl_status_t WiFiClass::status()
+{
+    return host_wifi_up ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+String WiFiClass::SSID()
+{
+    return String("host");
+}
+
+String WiFiClass::psk()
+{
+    return String("hostpass");
+}
+
+wl_status_t WiFiClass::begin()
+{
+    return status();
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *pass,
+			     int32_t channel, const uint8_t *bssid,
+			     bool connect)
+{
+    (void)ssid;
+    (void)pass;
+    (void)channel;
+    (void)bssid;
+    (void)connect;
+    return status();
+}
+
+bool WiFiClass::config(IPAddress ip, IPAddress gw, IPAddress mask,
+		       IPAddress dns1, IPAddress dns2)
+{
+    (void)ip;
+    (void)gw;
+    (void)mask;
+    (void)dns1;
+    (void)dns2;
+    return true;
+}
+
+bool WiFiClass::mode(WiFiMode_t m)
+{
+    (void)m;
+    return true;
+}
+
+WiFiMode_t WiFiClass::getMode()
+{
+    return WIFI_STA;
+}
+
+bool WiFiClass::setAutoReconnect(bool on)
+{
+    (void)on;
+    return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff)
+{
+    (void)wifioff;
+    return true;
+}
+
+uint8_t *WiFiClass::BSSID()
+{
+    return host_bssid;
+}
+
+int32_t WiFiClass::channel()
+{
+    return 1;
+}
+
+IPAddress WiFiClass::localIP()
+{
+    return IPAddress(127, 0, 0, 1);
+}
+
+IPAddress WiFiClass::gatewayIP()
+{
+    return IPAddress(127, 0, 0, 1);
+}
+
+IPAddress WiFiClass::subnetMask()
+{
+    return IPAddress(255, 0, 0, 0);
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t n)
+{
+    (void)n;
+    return IPAddress(127, 0, 0, 1);
+}
+
+int MDNSResponder::queryService(const char *service, const char *proto,
+				const uint16_t timeout)
+{
+    (void)service;
+    (void)proto;
+    host_mdns_queries++;
+    host_mdns_timeout = timeout;
+    return host_mdns_port ? 1 : 0;
+}
+
+IPAddress MDNSResponder::IP(int i)
+{
+    (void)i;
+    return IPAddress(host_mdns_ip);
+}
+
+uint16_t MDNSResponder::port(int i)
+{
+    (void)i;
+    return host_mdns_port;
+}
+
+String MDNSResponder::hostname(int i)
+{
+    (void)i;
+    return String("gnhastd.local");
+}
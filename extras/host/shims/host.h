@@ -0,0 +1,61 @@
+/*
+ * Controls for the host shims, for tests and profiling runs.  Nothing
+ * here exists on the ESP8266.
+ *
+ * On the ESP8266 the tcp callbacks run from the lwIP task, behind the
+ * sketch's back.  On the host they only run from host_poll(), which
+ * delay() and yield() call too, so a test drives the network explicitly:
+ *
+ *	while (!done) {
+ *	    gn.handle();
+ *	    host_poll(10);
+ *	}
+ */
+
+#ifndef __host_h__
+#define __host_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* run the socket callbacks that are ready, waiting up to wait_ms for one */
+void host_poll(int wait_ms);
+
+/* called from delay() and yield() after host_poll(), so a test can run
+   its fake gnhastd while the library waits in a loop of its own */
+void host_idle(void (*fn)(void));
+
+/* move millis() and micros() ahead, without waiting */
+void host_advance(uint32_t ms);
+
+/* directory SPIFFS lives in, created if need be.  Default: $GN_HOST_FS,
+   or ./spiffs */
+void host_fs_root(const char *dir);
+const char *host_fs_path(const char *path, char *buf, size_t len);
+
+/* the tcp send buffer AsyncClient::space() reports, 2920 like lwIP on the
+   ESP8266, and the most bytes handed to one onData() call, 0 no limit */
+void host_tcp_sndbuf(size_t size);
+void host_tcp_rxchunk(size_t size);
+
+/* whether WiFi.status() says we are connected, the default */
+void host_wifi_connected(bool up);
+
+/* how many times a modeless config portal was started */
+extern int host_wifi_portals;
+
+/* answer MDNS.queryService() with one gnhastd, port 0 for no answer */
+void host_mdns_answer(const char *ip, uint16_t port);
+
+/* how many times MDNS.queryService() was called, and the last timeout */
+extern int host_mdns_queries;
+extern uint16_t host_mdns_timeout;
+
+/* the last ESP.deepSleep(), 0 us if it was not called */
+extern uint64_t host_slept_us;
+extern int host_slept_mode;
+
+/* RTC user memory behind ESP.rtcUserMemoryRead/Write, 512 bytes */
+extern uint32_t host_rtcmem[128];
+
+#endif /*__host_h__*/
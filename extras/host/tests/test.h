@@ -0,0 +1,251 @@
+/*
+ * What the host tests share: CHECK(), a scratch SPIFFS directory, and a
+ * fake gnhastd on a real loopback socket, driven from the same loop as
+ * the library, so nothing runs behind anybody's back.
+ */
+
+#ifndef __host_test_h__
+#define __host_test_h__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+#include "gnhast_async.h"
+
+static int test_failures;
+
+#define CHECK(cond) do {						\
+	if (!(cond)) {							\
+	    fprintf(stderr, "%s:%d: CHECK(%s) failed\n",		\
+		    __FILE__, __LINE__, #cond);				\
+	    test_failures++;						\
+	}								\
+    } while (0)
+
+static inline std::string test_s(const char *s)
+{
+    return s ? s : "(null)";
+}
+
+static inline std::string test_s(const std::string &s)
+{
+    return s;
+}
+
+#define CHECK_STR(a, b) do {						\
+	std::string _a = test_s(a), _b = test_s(b);			\
+	if (_a != _b) {							\
+	    fprintf(stderr, "%s:%d: \"%s\" != \"%s\"\n",		\
+		    __FILE__, __LINE__, _a.c_str(), _b.c_str());	\
+	    test_failures++;						\
+	}								\
+    } while (0)
+
+static inline int test_done()
+{
+    fprintf(stderr, "%s\n", test_failures ? "FAILED" : "ok");
+    return test_failures ? 1 : 0;
+}
+
+/*
+ * Point SPIFFS at an empty scratch directory
+ */
+
+static inline void test_fs()
+{
+    char dir[] = "/tmp/gnhast_test.XXXXXX";
+
+    if (mkdtemp(dir) == NULL) {
+	perror("mkdtemp");
+	exit(1);
+    }
+    host_fs_root(dir);
+}
+
+static inline bool test_fs_exists(const char *path)
+{
+    char buf[512];
+
+    return access(host_fs_path(path, buf, sizeof(buf)), F_OK) == 0;
+}
+
+/*
+ * The fake gnhastd.  One client at a time, a new one replaces the old.
+ * Every line received is kept, without the newline, until clear().
+ */
+
+class test_server {
+ public:
+    std::vector<std::string> lines;
+    int accepts;
+
+    test_server() : accepts(0), _lfd(-1), _cfd(-1), _port(0), _paused(false) {
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	/* find a free port, listen() can then start and stop on it */
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bind(fd, (struct sockaddr *)&sin, sizeof(sin));
+	getsockname(fd, (struct sockaddr *)&sin, &len);
+	_port = ntohs(sin.sin_port);
+	close(fd);
+    }
+    ~test_server() { stop(); }
+
+    int port() const { return _port; }
+
+    bool listen() {
+	struct sockaddr_in sin;
+	int on = 1;
+
+	_lfd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(_lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(_port);
+	if (bind(_lfd, (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+	    ::listen(_lfd, 4) < 0) {
+	    perror("test_server");
+	    return false;
+	}
+	fcntl(_lfd, F_SETFL, O_NONBLOCK);
+	return true;
+    }
+
+    /* drop the client, and stop listening */
+    void stop() {
+	drop();
+	if (_lfd >= 0)
+	    close(_lfd);
+	_lfd = -1;
+    }
+
+    void drop() {
+	if (_cfd >= 0)
+	    close(_cfd);
+	_cfd = -1;
+	_partial.clear();
+    }
+
+    bool listening() const { return _lfd >= 0; }
+    bool connected() const { return _cfd >= 0; }
+
+    /* stop reading, so the client's send buffer fills */
+    void pause(bool on) { _paused = on; }
+
+    void send(const char *s) {
+	if (_cfd >= 0 && write(_cfd, s, strlen(s)) < 0)
+	    perror("test_server write");
+    }
+
+    void clear() { lines.clear(); }
+
+    /* how many lines start with prefix */
+    int count(const char *prefix) const {
+	int n = 0;
+	size_t i;
+
+	for (i=0; i < lines.size(); i++)
+	    if (lines[i].compare(0, strlen(prefix), prefix) == 0)
+		n++;
+	return n;
+    }
+
+    /* accept and read whatever is there, never blocks */
+    void poll() {
+	char buf[1024];
+	ssize_t n;
+	size_t nl;
+	int fd;
+
+	if (_lfd >= 0 && (fd = accept(_lfd, NULL, NULL)) >= 0) {
+	    drop();
+	    _cfd = fd;
+	    fcntl(_cfd, F_SETFL, O_NONBLOCK);
+	    accepts++;
+	}
+	if (_cfd < 0 || _paused)
+	    return;
+	while ((n = read(_cfd, buf, sizeof(buf))) > 0)
+	    _partial.append(buf, n);
+	while ((nl = _partial.find('\n')) != std::string::npos) {
+	    lines.push_back(_partial.substr(0, nl));
+	    _partial.erase(0, nl + 1);
+	}
+	if (n == 0)
+	    drop();
+    }
+
+ private:
+    int _lfd;
+    int _cfd;
+    int _port;
+    bool _paused;
+    std::string _partial;
+};
+
+/*
+ * Run the library and the server until done() says so, or for ms of real
+ * time.  Returns whether done() did.
+ */
+
+template <class F>
+static bool test_run(gnhast &gn, test_server &srv, uint32_t ms, F done)
+{
+    uint32_t start = millis();
+
+    while (millis() - start < ms) {
+	gn.handle();
+	host_poll(2);
+	srv.poll();
+	if (done())
+	    return true;
+    }
+    return done();
+}
+
+/*
+ * Point gn at srv, and wait until it has said hello
+ */
+
+static inline bool test_up(gnhast &gn, test_server &srv)
+{
+    gn.set_server((char *)"127.0.0.1", srv.port());
+    if (!srv.listening() && !srv.listen())
+	return false;
+    gn.connect();
+    return test_run(gn, srv, 2000, [&]() {
+	    return gn.conn_state() == GN_CONN_UP && srv.count("getapiv");
+	});
+}
+
+static inline gn_data_t test_u(uint32_t u)
+{
+    gn_data_t d;
+
+    d.u64 = 0;
+    d.u = u;
+    return d;
+}
+
+static inline gn_data_t test_d(double v)
+{
+    gn_data_t d;
+
+    d.d = v;
+    return d;
+}
+
+#endif /*__host_test_h__*/
@@ -0,0 +1,128 @@
+/*
+ * Aggregated devices: samples are folded into min, max, mean and last,
+ * nothing goes out until the window closes, then each statistic goes to
+ * its device, output devices past 127 included.  Built with 200 devices.
+ */
+
+#include "test.h"
+
+static gnhast gn("agg", 1);
+static test_server srv;
+
+static int mkdev(const char *uid, int subtype, int datatype)
+{
+    int dev = gn.generic_build_device(strdup(uid), strdup(uid),
+				      PROTO_GENERIC, DEVICE_SENSOR, subtype,
+				      datatype, 0, NULL);
+
+    gn.set_dev_precision(dev, 1);
+    gn.gn_register_device(dev);
+    return dev;
+}
+
+/* give the upds time to arrive */
+static void settle()
+{
+    test_run(gn, srv, 20, []() { return false; });
+}
+
+/* the last upd for uid, or "" */
+static std::string last(const char *uid)
+{
+    char prefix[32];
+    size_t i, plen;
+
+    snprintf(prefix, sizeof(prefix), "upd uid:%s ", uid);
+    plen = strlen(prefix);
+    for (i=srv.lines.size(); i > 0; i--)
+	if (srv.lines[i - 1].compare(0, plen, prefix) == 0)
+	    return srv.lines[i - 1];
+    return "";
+}
+
+int main()
+{
+    char uid[16];
+    int cur, cmin, cmax, clast, other, i;
+
+    test_fs();
+    cur = mkdev("cur", SUBTYPE_TEMP, DATATYPE_DOUBLE);
+    cmin = mkdev("cmin", SUBTYPE_COUNTER, DATATYPE_UINT);
+    clast = mkdev("clast", SUBTYPE_COUNTER, DATATYPE_UINT);
+    for (i=0; i < 150; i++) {
+	snprintf(uid, sizeof(uid), "pad%d", i);
+	mkdev(uid, SUBTYPE_COUNTER, DATATYPE_UINT);
+    }
+    cmax = mkdev("cmax", SUBTYPE_TEMP, DATATYPE_DOUBLE);
+    other = mkdev("other", SUBTYPE_COUNTER, DATATYPE_UINT);
+    CHECK(cmax > 127);
+    CHECK(test_up(gn, srv));
+
+    CHECK(gn.set_dev_aggregate(cur, 1000, GN_AGG_MEAN));
+    CHECK(gn.add_agg_output(cur, GN_AGG_MIN, cmin));
+    CHECK(gn.add_agg_output(cur, GN_AGG_MAX, cmax));
+    CHECK(gn.add_agg_output(cur, GN_AGG_LAST, clast));
+
+    /* not for a device that is not aggregated, an aggregated output, a
+       bad stat or a device that does not exist */
+    CHECK(!gn.add_agg_output(other, GN_AGG_MAX, cmax));
+    CHECK(!gn.add_agg_output(cur, GN_AGG_MAX, cur));
+    CHECK(!gn.add_agg_output(cur, GN_AGG_NSTATS, cmax));
+    CHECK(!gn.add_agg_output(cur, GN_AGG_MAX, other + 1));
+    CHECK(!gn.set_dev_aggregate(other, 1000, -1));
+
+    /* samples are held until the window closes */
+    srv.clear();
+    gn.store_data_dev(cur, test_d(2.0));
+    gn.gn_update_device(cur);
+    gn.store_data_dev(cur, test_d(9.0));
+    gn.gn_update_device(cur);
+    gn.store_data_dev(cur, test_d(1.0));
+    gn.store_data_dev(cur, test_d(4.0));
+    gn.gn_update_device(cur);
+    settle();
+    CHECK(srv.count("upd uid:") == 0);
+    host_advance(800);
+    settle();
+    CHECK(srv.count("upd uid:") == 0);
+
+    host_advance(200);
+    settle();
+    CHECK(srv.count("upd uid:") == 4);
+    CHECK_STR(last("cur"), "upd uid:cur temp:4.0");
+    CHECK_STR(last("cmin"), "upd uid:cmin count:1");
+    CHECK_STR(last("cmax"), "upd uid:cmax temp:9.0");
+    CHECK_STR(last("clast"), "upd uid:clast count:4");
+
+    /* an empty window sends nothing, the next opens with its sample */
+    srv.clear();
+    host_advance(5000);
+    settle();
+    CHECK(srv.count("upd uid:") == 0);
+    gn.store_data_dev(cur, test_d(7.0));
+    host_advance(800);
+    settle();
+    CHECK(srv.count("upd uid:") == 0);
+    host_advance(200);
+    settle();
+    CHECK_STR(last("cur"), "upd uid:cur temp:7.0");
+    CHECK_STR(last("cmin"), "upd uid:cmin count:7");
+    CHECK_STR(last("cmax"), "upd uid:cmax temp:7.0");
+
+    /* switched off, it is an ordinary device again */
+    CHECK(gn.set_dev_aggregate(cur, 0, GN_AGG_MEAN));
+    srv.clear();
+    gn.store_data_dev(cur, test_d(3.5));
+    gn.gn_update_device(cur);
+    settle();
+    CHECK_STR(last("cur"), "upd uid:cur temp:3.5");
+    CHECK(srv.count("upd uid:") == 1);
+
+    /* only GN_MAX_AGG at once, a freed slot is reused */
+    for (i=0; i < GN_MAX_AGG; i++)
+	CHECK(gn.set_dev_aggregate(cmin + i, 1000, GN_AGG_MAX));
+    CHECK(!gn.set_dev_aggregate(other, 1000, GN_AGG_MAX));
+    CHECK(gn.set_dev_aggregate(cmin, 0, GN_AGG_MAX));
+    CHECK(gn.set_dev_aggregate(other, 1000, GN_AGG_MAX));
+    return test_done();
+}
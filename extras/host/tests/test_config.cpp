@@ -0,0 +1,179 @@
+/*
+ * Smoke test of the whole boot: config from SPIFFS, init_wifi(), the web
+ * server, connecting to gnhastd.  Then the config round trips, through
+ * the web UI and through config_commit() into a fresh instance.  Built
+ * twice, with the json config and with GN_CFG_BINARY.
+ */
+
+#include "test.h"
+
+static gnhast gn("cfg", 2);
+static test_server srv;
+
+static void put_file(const char *path, const char *contents)
+{
+    File f = SPIFFS.open(path, "w");
+
+    f.print(contents);
+    f.close();
+}
+
+static std::string get_file(const char *path)
+{
+    File f = SPIFFS.open(path, "r");
+    std::string s;
+    int c;
+
+    while (f && (c = f.read()) >= 0)
+	s += (char)c;
+    return s;
+}
+
+/* run a request through the web server, the response stays in req */
+static AsyncWebServerResponse *web(AsyncWebServerRequest &req)
+{
+    AsyncWebServerResponse *r = gn.server->host_handle(&req);
+
+    if (r == NULL) {
+	fprintf(stderr, "no response to %s\n", req.url().c_str());
+	exit(1);
+    }
+    return r;
+}
+
+static bool valid_json(const String &s)
+{
+    DynamicJsonDocument doc(JSON_CONFIG_FILE_SIZE);
+
+    return !deserializeJson(doc, s) && doc.as<JsonObject>().size() > 0;
+}
+
+int main()
+{
+    DynamicJsonDocument doc(JSON_CONFIG_FILE_SIZE);
+    static gnhast fresh("cfg", 2);
+    char json[128];
+    int t1, h1;
+
+    test_fs();
+    CHECK(SPIFFS.begin());
+    snprintf(json, sizeof(json),
+	     "{\"gnhast_server\":\"127.0.0.1\",\"gnhast_port\":\"%d\"}",
+	     srv.port());
+    put_file("/config.json", json);
+    put_file("/gnhast.json", "{\"t1\":{\"name\":\"Kitchen\"}}");
+    put_file("/index.html", "<html>hi</html>");
+
+    /* boot as a sketch does */
+    gn.init_wifi();
+    CHECK(gn.wifi_state() == GN_WIFI_UP);
+    gn.init_server();
+    CHECK(gn.init_webserver());
+    CHECK(gn.config_dev_name("t1") != NULL);
+    CHECK_STR(gn.config_dev_name("t1"), "Kitchen");
+    t1 = gn.generic_build_device((char *)"t1",
+				 (char *)gn.config_dev_name("t1"),
+				 PROTO_GENERIC, DEVICE_SENSOR, SUBTYPE_TEMP,
+				 DATATYPE_DOUBLE, TSCALE_C, NULL);
+    h1 = gn.generic_build_device((char *)"h1", (char *)"Humidity",
+				 PROTO_GENERIC, DEVICE_SENSOR, SUBTYPE_HUMID,
+				 DATATYPE_DOUBLE, 0, NULL);
+    gn.set_dev_precision(t1, 2);
+    gn.gn_register_device(t1);
+    gn.gn_register_device(h1);
+    CHECK(srv.listen());
+    CHECK(test_run(gn, srv, 2000, []() { return srv.count("getapiv"); }));
+    gn.store_data_dev(t1, test_d(21.625));
+    gn.gn_update_device(t1);
+    CHECK(test_run(gn, srv, 1000, []() {
+		return srv.count("upd uid:t1 temp:21.62") == 1;
+	    }));
+
+    /* the json pages parse */
+    {
+	AsyncWebServerRequest req(HTTP_GET, "/stats");
+
+	CHECK(web(req)->code() == 200);
+	CHECK(valid_json(web(req)->body()));
+    }
+    {
+	AsyncWebServerRequest req(HTTP_GET, "/boot");
+
+	CHECK(valid_json(web(req)->body()));
+	deserializeJson(doc, web(req)->body());
+	CHECK((uint32_t)doc["connect"]["end"] != 0);
+    }
+
+    /* files from SPIFFS, and what is not there */
+    {
+	AsyncWebServerRequest req(HTTP_GET, "/index.html");
+
+	CHECK(web(req)->code() == 200);
+	CHECK_STR(web(req)->contentType().c_str(), "text/html");
+	CHECK_STR(web(req)->body().c_str(), "<html>hi</html>");
+    }
+    {
+	AsyncWebServerRequest req(HTTP_GET, "/nope.html");
+
+	CHECK(web(req)->code() == 404);
+    }
+
+    /* rename through the web UI, gnhastd hears of it */
+    {
+	AsyncWebServerRequest req(HTTP_POST, "/modcfg");
+
+	req.host_param("uid", "h1", true);
+	req.host_param("chgdevname", "Bathroom", true);
+	CHECK(strstr(web(req)->body().c_str(), "complete") != NULL);
+	CHECK(test_run(gn, srv, 1000, []() {
+		    return srv.count("mod uid:h1 name:\"Bathroom\"") == 1;
+		}));
+    }
+    {
+	AsyncWebServerRequest req(HTTP_POST, "/modcfg");
+
+	req.host_param("uid", "zz", true);
+	req.host_param("chgdevname", "Nope", true);
+	CHECK(strstr(web(req)->body().c_str(), "Incorrect") != NULL);
+    }
+
+    /* export has it all, import takes it back, bad json is refused */
+    {
+	AsyncWebServerRequest req(HTTP_GET, "/cfg_export");
+
+	deserializeJson(doc, web(req)->body());
+	CHECK_STR((const char *)doc["gnhast_server"], "127.0.0.1");
+	CHECK_STR((const char *)doc["h1"]["name"], "Bathroom");
+	CHECK_STR((const char *)doc["t1"]["name"], "Kitchen");
+	CHECK_STR((const char *)doc["collector_name"], "cfg");
+    }
+    {
+	AsyncWebServerRequest req(HTTP_POST, "/cfg_import");
+
+	req.host_param("config", "{\"t1\":{\"name\":\"Larder\"}}", true);
+	CHECK(strstr(web(req)->body().c_str(), "imported") != NULL);
+	CHECK_STR(gn.get_dev_byindex(t1)->name, "Larder");
+	CHECK(test_run(gn, srv, 1000, []() {
+		    return srv.count("mod uid:t1 name:\"Larder\"") == 1;
+		}));
+    }
+    {
+	AsyncWebServerRequest req(HTTP_POST, "/cfg_import");
+
+	req.host_param("config", "{\"t1\":", true);
+	CHECK(strstr(web(req)->body().c_str(), "Bad") != NULL);
+	CHECK_STR(gn.get_dev_byindex(t1)->name, "Larder");
+    }
+
+    /* nothing is written until the delay is up, or config_commit() */
+    CHECK(!test_fs_exists(GN_CFG_BLOB_FILE));
+    CHECK(get_file("/gnhast.json").find("Larder") == std::string::npos);
+    gn.config_commit();
+    CHECK(test_fs_exists(GN_CFG_BLOB_FILE) == GN_CFG_BINARY);
+    if (!GN_CFG_BINARY)
+	CHECK(get_file("/gnhast.json").find("Larder") != std::string::npos);
+    CHECK_STR(fresh.config_dev_name("t1"), "Larder");
+    CHECK_STR(fresh.config_dev_name("h1"), "Bathroom");
+    CHECK(fresh.config_dev_name("zz") == NULL);
+    return test_done();
+}
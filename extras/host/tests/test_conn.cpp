@@ -0,0 +1,162 @@
+/*
+ * The connection state machine against a real socket: the first connect,
+ * backoff while gnhastd is down, replay on reconnect, a chg confirmation
+ * while a line is half sent, the ping timeout, and disconnect()
+ */
+
+#include "test.h"
+
+static gnhast gn("conn", 7);
+static test_server srv;
+
+static bool chg_cb(int dev, gn_data_t data)
+{
+    (void)dev;
+    (void)data;
+    return true;
+}
+
+static int mkdev(const char *uid, const char *name, int subtype)
+{
+    int dev = gn.generic_build_device((char *)uid, (char *)name,
+				      PROTO_GENERIC, DEVICE_SENSOR, subtype,
+				      DATATYPE_UINT, 0, NULL);
+
+    gn.gn_register_device(dev);
+    return dev;
+}
+
+/* every line is one the library could have sent, nothing spliced */
+static bool lines_whole()
+{
+    static const char *verbs[] = {
+	"client ", "getapiv", "reg uid:", "upd uid:", "imalive", NULL,
+    };
+    size_t i;
+    int v;
+
+    for (i=0; i < srv.lines.size(); i++) {
+	for (v=0; verbs[v]; v++)
+	    if (srv.lines[i].compare(0, strlen(verbs[v]), verbs[v]) == 0)
+		break;
+	if (verbs[v] == NULL) {
+	    fprintf(stderr, "spliced line: %s\n", srv.lines[i].c_str());
+	    return false;
+	}
+    }
+    return true;
+}
+
+int main()
+{
+    gn_txstats_t st;
+    char uid[16];
+    int t1, c1, sw, i, n;
+
+    test_fs();
+    gn.set_server((char *)"127.0.0.1", srv.port());
+
+    /* nobody listening: the reg kicks off a connect, which fails */
+    t1 = mkdev("t1", "Temp 1", SUBTYPE_TEMP);
+    c1 = mkdev("c1", "Count 1", SUBTYPE_COUNTER);
+    CHECK(test_run(gn, srv, 1000, []() {
+		return gn.conn_state() == GN_CONN_BACKOFF;
+	    }));
+    gn.store_data_dev(t1, test_u(20));
+    gn.gn_update_device(t1);
+    gn.store_data_dev(t1, test_u(21));
+    gn.gn_update_device(t1);
+    CHECK(gn.pending_count() == 1);
+
+    /* gnhastd comes up, we get there once the backoff is over */
+    CHECK(srv.listen());
+    test_run(gn, srv, 100, []() { return false; });
+    CHECK(srv.accepts == 0);
+    host_advance(GN_BACKOFF_MAX);
+    CHECK(test_run(gn, srv, 2000, []() {
+		return srv.count("upd uid:t1") == 1;
+	    }));
+    CHECK(gn.conn_state() == GN_CONN_UP);
+    CHECK_STR(srv.lines[0], "client client:conn-007");
+    CHECK_STR(srv.lines[1], "getapiv");
+    CHECK(srv.count("reg uid:t1 name:\"Temp 1\"") == 1);
+    CHECK(srv.count("reg uid:c1 name:\"Count 1\"") == 1);
+    CHECK_STR(srv.lines.back(), "upd uid:t1 temp:21");
+    CHECK(gn.pending_count() == 0);
+
+    /* live updates go straight out */
+    gn.store_data_dev(c1, test_u(5));
+    gn.gn_update_device(c1);
+    CHECK(test_run(gn, srv, 1000, []() {
+		return srv.count("upd uid:c1 count:5") == 1;
+	    }));
+
+    /* gnhastd goes away, and comes back: everything is replayed */
+    srv.drop();
+    CHECK(test_run(gn, srv, 1000, []() {
+		return gn.conn_state() == GN_CONN_BACKOFF;
+	    }));
+    gn.store_data_dev(c1, test_u(6));
+    gn.gn_update_device(c1);
+    srv.clear();
+    host_advance(GN_BACKOFF_MAX);
+    CHECK(test_run(gn, srv, 2000, []() {
+		return srv.count("upd uid:c1 count:6") == 1;
+	    }));
+    CHECK(srv.accepts == 2);
+    CHECK(srv.count("client ") == 1 && srv.count("reg uid:") == 2);
+
+    /* a tiny tcp window, lines go out in pieces.  A chg confirmation
+       that jumps the queue must still land between two lines. */
+    sw = gn.generic_build_device((char *)"sw1", (char *)"Switch 1",
+				 PROTO_GENERIC, DEVICE_SWITCH,
+				 SUBTYPE_SWITCH, DATATYPE_UINT, 0, NULL);
+    gn.set_chg_callback(sw, chg_cb);
+    host_tcp_sndbuf(7);
+    srv.clear();
+    for (i=0; i < 10; i++) {
+	snprintf(uid, sizeof(uid), "x%d", i);
+	n = gn.generic_build_device(strdup(uid), strdup(uid), PROTO_GENERIC,
+				    DEVICE_SENSOR, SUBTYPE_COUNTER,
+				    DATATYPE_UINT, 0, NULL);
+	gn.store_data_dev(n, test_u(1000000 + i));
+	gn.gn_update_device(n);
+    }
+    for (i=0; i < 3; i++) {
+	srv.send(i & 1 ? "chg uid:sw1 switch:0\n" : "chg uid:sw1 switch:1\n");
+	test_run(gn, srv, 20, []() { return false; });
+    }
+    CHECK(test_run(gn, srv, 3000, []() {
+		return srv.count("upd uid:x") == 10 &&
+		    srv.count("upd uid:sw1") == 3;
+	    }));
+    CHECK(lines_whole());
+    gn.get_txstats(&st);
+    CHECK(st.waiting == 0);
+    host_tcp_sndbuf(2920);
+
+    /* once gnhastd pings, it has to keep doing so */
+    srv.clear();
+    srv.send("ping\n");
+    CHECK(test_run(gn, srv, 1000, []() { return srv.count("imalive"); }));
+    host_advance(GN_PING_TIMEOUT / 2);
+    test_run(gn, srv, 50, []() { return false; });
+    CHECK(srv.accepts == 2);
+    host_advance(GN_PING_TIMEOUT / 2 + 1000);
+    test_run(gn, srv, 100, []() { return false; });
+    host_advance(GN_BACKOFF_MAX);
+    CHECK(test_run(gn, srv, 2000, []() {
+		return srv.accepts == 3 && srv.count("getapiv") == 1;
+	    }));
+
+    /* a nice goodbye, and no coming back */
+    gn.disconnect();
+    CHECK(test_run(gn, srv, 1000, []() {
+		return srv.count("disconnect") == 1 && !srv.connected();
+	    }));
+    CHECK(gn.conn_state() == GN_CONN_IDLE);
+    host_advance(GN_BACKOFF_MAX);
+    test_run(gn, srv, 100, []() { return false; });
+    CHECK(srv.accepts == 3);
+    return test_done();
+}
@@ -0,0 +1,104 @@
+/*
+ * Dirty tracking and flush_dirty(): only what changed is sent, once, and
+ * what changes while gnhastd is away is queued for the reconnect
+ */
+
+#include "test.h"
+
+static gnhast gn("dirty", 1);
+static test_server srv;
+
+static int mkdev(const char *uid, double deadband)
+{
+    int dev = gn.generic_build_device((char *)uid, (char *)uid,
+				      PROTO_GENERIC, DEVICE_SENSOR,
+				      SUBTYPE_COUNTER, DATATYPE_UINT, 0, NULL,
+				      deadband);
+
+    gn.gn_register_device(dev);
+    return dev;
+}
+
+/* flush, and let the lines get there */
+static int flush()
+{
+    int n = gn.flush_dirty();
+
+    test_run(gn, srv, 50, []() { return false; });
+    return n;
+}
+
+int main()
+{
+    uint32_t changed;
+    int a, b, c, db;
+
+    test_fs();
+    a = mkdev("a", 0);
+    b = mkdev("b", 0);
+    c = mkdev("c", 0);
+    db = mkdev("db", 5);
+    CHECK(test_up(gn, srv));
+
+    /* never sent counts as changed, even with nothing stored */
+    srv.clear();
+    gn.store_data_dev(a, test_u(1));
+    gn.store_data_dev(b, test_u(2));
+    gn.store_data_dev(c, test_u(3));
+    gn.store_data_dev(db, test_u(100));
+    CHECK(flush() == 4);
+    CHECK(srv.count("upd uid:") == 4);
+    CHECK_STR(srv.lines[0], "upd uid:a count:1");
+    CHECK_STR(srv.lines[3], "upd uid:db count:100");
+
+    /* nothing changed, nothing sent */
+    srv.clear();
+    CHECK(flush() == 0);
+    CHECK(srv.lines.size() == 0);
+
+    /* the same value again is not a change, and does not move changed */
+    changed = gn.get_dev_byindex(a)->changed;
+    host_advance(10);
+    gn.store_data_dev(a, test_u(1));
+    CHECK(gn.get_dev_byindex(a)->changed == changed);
+    gn.store_data_dev(b, test_u(20));
+    CHECK(gn.get_dev_byindex(b)->changed != gn.get_dev_byindex(a)->changed);
+    CHECK(flush() == 1);
+    CHECK(srv.lines.size() == 1);
+    CHECK_STR(srv.lines[0], "upd uid:b count:20");
+
+    /* changed twice between flushes, only the latest is sent */
+    srv.clear();
+    gn.store_data_dev(c, test_u(30));
+    gn.store_data_dev(c, test_u(31));
+    CHECK(flush() == 1);
+    CHECK_STR(srv.lines[0], "upd uid:c count:31");
+
+    /* a change inside the deadband leaves it dirty, but is not news */
+    srv.clear();
+    gn.store_data_dev(db, test_u(102));
+    CHECK(flush() == 0);
+    CHECK(srv.lines.size() == 0);
+
+    /* gnhastd goes away: what changed is queued, with the same policy,
+       and sent after the regs on the reconnect */
+    srv.drop();
+    CHECK(test_run(gn, srv, 1000, []() {
+		return gn.conn_state() != GN_CONN_UP;
+	    }));
+    gn.store_data_dev(a, test_u(10));
+    gn.store_data_dev(db, test_u(103));
+    CHECK(gn.flush_dirty() == 0);
+    CHECK(gn.pending_count() == 1);
+    host_advance(GN_BACKOFF_MAX);
+    CHECK(test_run(gn, srv, 2000, []() {
+		return srv.count("upd uid:") == 1;
+	    }));
+    test_run(gn, srv, 100, []() { return false; });
+    CHECK(srv.count("upd uid:") == 1);
+    CHECK_STR(srv.lines.back(), "upd uid:a count:10");
+    CHECK(srv.count("reg uid:") == 4);
+    CHECK(gn.pending_count() == 0);
+    CHECK(flush() == 0);
+    return test_done();
+}
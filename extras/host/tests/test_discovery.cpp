@@ -0,0 +1,100 @@
+/*
+ * Finding gnhastd by mDNS: the query is made from handle(), never from
+ * connect(), with a short timeout, the answer is cached in RTC memory
+ * until it is GN_DISC_TTL old, deep sleep counting, and init_server()
+ * does not leak the name it copies.
+ */
+
+#include "test.h"
+
+static gn_rtcmem_ram ram;
+static test_server srv;
+
+static gnhast *mkgn()
+{
+    gnhast *gn = new gnhast("disc", 1);
+
+    gn->set_rtcmem(&ram);
+    gn->set_discovery(true);
+    gn->init_server();
+    return gn;
+}
+
+/* a wake that sends nothing, then sleeps for s seconds */
+static void nap(uint32_t s)
+{
+    gnhast *gn = new gnhast("disc", 2);
+
+    gn->set_rtcmem(&ram);
+    gn->set_discovery(true);
+    gn->sleep_begin(1000);
+    gn->sleep_end(s * 1000000ULL);
+}
+
+int main()
+{
+    gnhast *gn;
+    uint32_t heap;
+    int i;
+
+    test_fs();
+    CHECK(srv.listen());
+    host_mdns_answer("127.0.0.1", srv.port());
+
+    /* nothing cached: connect() leaves the query to handle() */
+    gn = mkgn();
+    gn->connect();
+    CHECK(host_mdns_queries == 0);
+    CHECK(gn->conn_state() == GN_CONN_BACKOFF);
+    gn->handle();
+    CHECK(host_mdns_queries == 1);
+    CHECK(host_mdns_timeout == GN_DISC_QUERY_MS);
+    CHECK(test_run(*gn, srv, 2000, [&]() {
+		return gn->conn_state() == GN_CONN_UP &&
+		    srv.count("getapiv");
+	    }));
+    gn->disconnect();
+
+    /* the next boot uses the cache */
+    gn = mkgn();
+    gn->connect();
+    CHECK(gn->conn_state() == GN_CONN_CONNECTING);
+    CHECK(test_run(*gn, srv, 2000, [&]() {
+		return gn->conn_state() == GN_CONN_UP;
+	    }));
+    CHECK(host_mdns_queries == 1);
+    gn->disconnect();
+
+    /* time in deep sleep adds up, until the answer is too old to use */
+    nap(GN_DISC_TTL / 2);
+    gn = mkgn();
+    gn->connect();
+    CHECK(gn->conn_state() == GN_CONN_CONNECTING);
+    gn->disconnect();
+    nap(GN_DISC_TTL / 2 + 1);
+    gn = mkgn();
+    gn->connect();
+    CHECK(gn->conn_state() == GN_CONN_BACKOFF);
+    gn->handle();
+    CHECK(host_mdns_queries == 2);
+
+    /* nothing answers: the stale answer is dropped, not used next boot */
+    nap(GN_DISC_TTL);
+    host_mdns_answer("127.0.0.1", 0);
+    gn = mkgn();
+    gn->connect();
+    gn->handle();
+    CHECK(host_mdns_queries == 3);
+    gn = mkgn();
+    gn->connect();
+    CHECK(gn->conn_state() == GN_CONN_BACKOFF);
+
+    /* init_server() and set_server() again and again cost nothing */
+    heap = ESP.getFreeHeap();
+    for (i=0; i < 1000; i++) {
+	gn->init_server();
+	gn->set_server((char *)"127.0.0.1", srv.port());
+    }
+    CHECK(heap - ESP.getFreeHeap() < 1024);
+    return test_done();
+}
@@ -0,0 +1,74 @@
+/*
+ * Failover between two gnhastd: the primary goes down and we move to the
+ * standby at once, and once the primary has been forgiven its failure
+ * we try it again, coming straight back while it is still down, and
+ * staying on it once it is up
+ */
+
+#include "test.h"
+
+static gnhast gn("failover", 1);
+static test_server primary, standby;
+
+/* run the library and both servers until done(), or for ms */
+template <class F>
+static bool run(uint32_t ms, F done)
+{
+    uint32_t start = millis();
+
+    while (millis() - start < ms) {
+	gn.handle();
+	host_poll(2);
+	primary.poll();
+	standby.poll();
+	if (done())
+	    return true;
+    }
+    return done();
+}
+
+/* up on srv, with it having heard our getapiv */
+static bool on(test_server &srv)
+{
+    return gn.conn_state() == GN_CONN_UP && srv.connected() &&
+	srv.count("getapiv");
+}
+
+int main()
+{
+    int accepts;
+
+    test_fs();
+    CHECK(primary.listen());
+    CHECK(standby.listen());
+    gn.set_server((char *)"127.0.0.1", primary.port());
+    CHECK(gn.add_server("127.0.0.1", standby.port()) == 1);
+    gn.connect();
+    CHECK(run(2000, []() { return on(primary); }));
+
+    /* the primary dies, the standby takes over without a backoff */
+    primary.stop();
+    primary.clear();
+    CHECK(run(500, []() { return on(standby); }));
+    CHECK(standby.accepts == 1);
+
+    /* not forgiven yet, so we stay put */
+    host_advance(GN_SRV_FORGIVE - 1000);
+    run(100, []() { return false; });
+    CHECK(standby.accepts == 1);
+
+    /* forgiven, but still down: one try, then straight back */
+    standby.clear();
+    host_advance(1000);
+    CHECK(run(500, []() { return standby.accepts == 2 && on(standby); }));
+
+    /* up again: the next forgiveness fails back to it, and there we stay */
+    CHECK(primary.listen());
+    accepts = standby.accepts;
+    host_advance(GN_SRV_FORGIVE);
+    CHECK(run(500, []() { return on(primary); }));
+    run(200, []() { return false; });
+    CHECK(on(primary));
+    CHECK(standby.accepts == accepts);
+    return test_done();
+}
@@ -0,0 +1,96 @@
+/*
+ * The per device filter chains, through store_data_dev()
+ */
+
+#include "test.h"
+
+static gnhast gn("filter", 1);
+
+static int mkdev(const char *uid, int datatype)
+{
+    return gn.generic_build_device((char *)uid, (char *)uid, PROTO_GENERIC,
+				   DEVICE_SENSOR, SUBTYPE_NUMBER, datatype,
+				   0, NULL);
+}
+
+int main()
+{
+    gn_dev_t *d;
+    int ema, med, rate, both;
+    int i;
+
+    test_fs();
+    ema = mkdev("ema", DATATYPE_DOUBLE);
+    med = mkdev("median", DATATYPE_UINT);
+    rate = mkdev("rate", DATATYPE_DOUBLE);
+    both = mkdev("both", DATATYPE_DOUBLE);
+
+    /* params that make no sense are refused */
+    CHECK(!gn.add_dev_filter(ema, GN_FILT_EMA, 0));
+    CHECK(!gn.add_dev_filter(ema, GN_FILT_EMA, 16));
+    CHECK(!gn.add_dev_filter(med, GN_FILT_MEDIAN, 4));
+    CHECK(!gn.add_dev_filter(med, GN_FILT_MEDIAN, GN_FILT_MEDIAN_MAX + 2));
+    CHECK(!gn.add_dev_filter(rate, GN_FILT_RATE, 0));
+    CHECK(!gn.add_dev_filter(rate, 99, 1));
+
+    /* ema, 1/2 weight: the first sample primes it, then halfway */
+    CHECK(gn.add_dev_filter(ema, GN_FILT_EMA, 1));
+    d = gn.get_dev_byindex(ema);
+    gn.store_data_dev(ema, test_d(10));
+    CHECK(d->data.d == 10);
+    gn.store_data_dev(ema, test_d(20));
+    CHECK(d->data.d == 15);
+    gn.store_data_dev(ema, test_d(-1));
+    CHECK(d->data.d == 7);
+
+    /* median of 3 drops a single spike */
+    CHECK(gn.add_dev_filter(med, GN_FILT_MEDIAN, 3));
+    d = gn.get_dev_byindex(med);
+    gn.store_data_dev(med, test_u(5));
+    gn.store_data_dev(med, test_u(6));
+    gn.store_data_dev(med, test_u(1000));
+    CHECK(d->data.u == 6);
+    gn.store_data_dev(med, test_u(7));
+    CHECK(d->data.u == 7);
+
+    /* a counter into a rate per second, the first sample is held back */
+    CHECK(gn.add_dev_filter(rate, GN_FILT_RATE, 1000, DATATYPE_LL));
+    d = gn.get_dev_byindex(rate);
+    d->data.d = -1;
+    {
+	gn_data_t c;
+
+	c.u64 = 1000;
+	gn.store_data_dev(rate, c);
+	CHECK(d->data.d == -1);
+	host_advance(2000);
+	c.u64 = 1500;
+	gn.store_data_dev(rate, c);
+	CHECK(d->data.d == 250);
+    }
+
+    /* chains run in order, the chain holds GN_FILT_STAGES */
+    CHECK(gn.add_dev_filter(both, GN_FILT_MEDIAN, 3));
+    CHECK(gn.add_dev_filter(both, GN_FILT_EMA, 1));
+    for (i=2; i < GN_FILT_STAGES; i++)
+	CHECK(gn.add_dev_filter(both, GN_FILT_EMA, 1));
+    CHECK(!gn.add_dev_filter(both, GN_FILT_EMA, 1));
+    gn.clear_dev_filters(both);
+    CHECK(gn.add_dev_filter(both, GN_FILT_MEDIAN, 3));
+    CHECK(gn.add_dev_filter(both, GN_FILT_EMA, 2));
+    d = gn.get_dev_byindex(both);
+    gn.store_data_dev(both, test_d(8));
+    CHECK(d->data.d == 8);
+    /* the median of two is the larger, 8 + 92/4 */
+    gn.store_data_dev(both, test_d(100));
+    CHECK(d->data.d == 31);
+    /* the spike is gone, 31 - 23/4 */
+    gn.store_data_dev(both, test_d(8));
+    CHECK(d->data.d == 25.25);
+
+    /* no filters, the value goes straight in */
+    gn.clear_dev_filters(both);
+    gn.store_data_dev(both, test_d(3.25));
+    CHECK(d->data.d == 3.25);
+    return test_done();
+}
@@ -0,0 +1,117 @@
+/*
+ * Store and forward of a keep-all counter: the pending ring spills to
+ * the SPIFFS journal, and it all comes back in order, paced, once
+ * gnhastd is reachable.  Then a journal left by a previous boot.
+ */
+
+#include "test.h"
+
+static test_server srv;
+
+/* ring, two journal pages, and a few in the page buffer */
+#define NSAMPLES (GN_PENDQ_SIZE + 2 * GN_JNL_PAGE / 16 + 5)
+
+static int mkcounter(gnhast &gn)
+{
+    int dev = gn.generic_build_device((char *)"cnt", (char *)"Counter",
+				      PROTO_GENERIC, DEVICE_SENSOR,
+				      SUBTYPE_COUNTER, DATATYPE_UINT, 0,
+				      NULL);
+
+    gn.set_dev_keepall(dev, true);
+    gn.gn_register_device(dev);
+    return dev;
+}
+
+static void store(gnhast &gn, int dev, int n, uint32_t base)
+{
+    int i;
+
+    for (i=0; i < n; i++) {
+	gn.store_data_dev(dev, test_u(base + i));
+	gn.gn_update_device(dev);
+    }
+}
+
+/* the upds arrived, in order, starting at base */
+static bool in_order(uint32_t base, int n)
+{
+    char want[32];
+    size_t i;
+    int k = 0;
+
+    for (i=0; i < srv.lines.size(); i++) {
+	if (srv.lines[i].compare(0, 8, "upd uid:") != 0)
+	    continue;
+	snprintf(want, sizeof(want), "upd uid:cnt count:%u",
+		 (unsigned)(base + k));
+	if (srv.lines[i] != want) {
+	    fprintf(stderr, "got %s, wanted %s\n", srv.lines[i].c_str(),
+		    want);
+	    return false;
+	}
+	k++;
+    }
+    return k == n;
+}
+
+int main()
+{
+    static gnhast gn("jnl", 1);
+    static gnhast gn2("jnl", 1);
+    static gnhast rebooted("jnl", 1);
+    uint32_t start;
+    int dev;
+
+    test_fs();
+    gn.set_server((char *)"127.0.0.1", srv.port());
+    dev = mkcounter(gn);
+    store(gn, dev, NSAMPLES, 100);
+    CHECK(gn.pending_count() == NSAMPLES);
+    CHECK(test_fs_exists(GN_JNL_FILE));
+
+    /* replayed oldest first, GN_REPLAY_BATCH at a time */
+    CHECK(srv.listen());
+    host_advance(GN_BACKOFF_MAX);
+    CHECK(test_run(gn, srv, 1000, []() {
+		return srv.count("upd uid:") >= GN_REPLAY_BATCH;
+	    }));
+    CHECK(srv.count("upd uid:") == GN_REPLAY_BATCH);
+    start = millis();
+    CHECK(test_run(gn, srv, 5000, []() {
+		return srv.count("upd uid:") == NSAMPLES;
+	    }));
+    /* the ring and the journal may share a batch, so this is loose */
+    CHECK(millis() - start >=
+	  NSAMPLES / GN_REPLAY_BATCH / 2 * GN_REPLAY_INTERVAL);
+    CHECK(in_order(100, NSAMPLES));
+    CHECK(gn.pending_count() == 0);
+    CHECK(!test_fs_exists(GN_JNL_FILE));
+
+    /* a live sample after the replay goes out as usual */
+    store(gn, dev, 1, 100 + NSAMPLES);
+    CHECK(test_run(gn, srv, 1000, []() {
+		return srv.count("upd uid:") == NSAMPLES + 1;
+	    }));
+    gn.disconnect();
+    test_run(gn, srv, 200, []() { return !srv.connected(); });
+    srv.stop();
+    srv.clear();
+
+    /* what reached the journal file outlives a reboot, what was still in
+       RAM does not */
+    gn2.set_server((char *)"127.0.0.1", srv.port());
+    dev = mkcounter(gn2);
+    store(gn2, dev, NSAMPLES, 500);
+    CHECK(test_fs_exists(GN_JNL_FILE));
+
+    rebooted.set_server((char *)"127.0.0.1", srv.port());
+    dev = mkcounter(rebooted);
+    CHECK(test_up(rebooted, srv));
+    CHECK(test_run(rebooted, srv, 5000, []() {
+		return srv.count("upd uid:") == 2 * GN_JNL_PAGE / 16;
+	    }));
+    CHECK(in_order(500, 2 * GN_JNL_PAGE / 16));
+    CHECK(!test_fs_exists(GN_JNL_FILE));
+    return test_done();
+}
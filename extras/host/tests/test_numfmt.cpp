@@ -0,0 +1,112 @@
+/*
+ * gn_numfmt against snprintf, edge cases and a random sweep
+ */
+
+#include <inttypes.h>
+#include "test.h"
+
+static void check_u32(uint32_t v)
+{
+    char ours[GN_FMT_BUFSIZE], libc[GN_FMT_BUFSIZE];
+    int len = gn_fmt_u32(ours, v);
+
+    snprintf(libc, sizeof(libc), "%" PRIu32, v);
+    CHECK_STR(ours, libc);
+    CHECK(len == (int)strlen(libc));
+}
+
+static void check_u64(uint64_t v)
+{
+    char ours[GN_FMT_BUFSIZE], libc[GN_FMT_BUFSIZE];
+    int len = gn_fmt_u64(ours, v);
+
+    snprintf(libc, sizeof(libc), "%" PRIu64, v);
+    CHECK_STR(ours, libc);
+    CHECK(len == (int)strlen(libc));
+}
+
+/* too big for 64 bits: %e, and nothing past GN_FMT_BUFSIZE touched */
+static void check_huge(double v, int prec)
+{
+    char ours[GN_FMT_BUFSIZE + 16], libc[64];
+    int len;
+
+    memset(ours, 'Z', sizeof(ours));
+    len = gn_fmt_fixed(ours, v, prec);
+    snprintf(libc, sizeof(libc), "%.*e", prec, v);
+    CHECK_STR(ours, libc);
+    CHECK(len == (int)strlen(libc));
+    CHECK(len < GN_FMT_BUFSIZE);
+    CHECK(ours[GN_FMT_BUFSIZE] == 'Z');
+}
+
+static void check_fixed(double v, int prec)
+{
+    char ours[GN_FMT_BUFSIZE], libc[GN_FMT_BUFSIZE];
+    int len = gn_fmt_fixed(ours, v, prec);
+
+    snprintf(libc, sizeof(libc), "%.*f", prec, v);
+    CHECK_STR(ours, libc);
+    CHECK(len == (int)strlen(libc));
+}
+
+int main()
+{
+    static const double dvals[] = {
+	0, 0.5, 1.5, 2.5, -2.5, 0.125, 0.0625, 1e-10, -1e-10,
+	21.6875, -40.0625, 99.995, 1234567.891, 4294967295.5, 1e15,
+	-1e15, 0.1, 0.2, 0.3, 1.0 / 3,
+    };
+    uint64_t v64;
+    size_t i;
+    int prec;
+
+    check_u32(0);
+    check_u32(9);
+    check_u32(10);
+    check_u32(99);
+    check_u32(100);
+    check_u32(4294967295u);
+    check_u64(0);
+    check_u64(18446744073709551615ull);
+    for (v64 = 1; v64 && v64 < 18446744073709551615ull / 10; v64 *= 10) {
+	check_u64(v64 - 1);
+	check_u64(v64);
+    }
+
+    for (i=0; i < sizeof(dvals) / sizeof(dvals[0]); i++)
+	for (prec = 0; prec <= GN_FMT_MAXPREC; prec++)
+	    check_fixed(dvals[i], prec);
+
+    /* unlike printf, a negative zero has no sign, it is the same value */
+    {
+	char ours[GN_FMT_BUFSIZE];
+
+	gn_fmt_fixed(ours, -0.0, 2);
+	CHECK_STR(ours, "0.00");
+    }
+
+    /* too many digits asked for is the most there are */
+    {
+	char ours[GN_FMT_BUFSIZE], libc[GN_FMT_BUFSIZE];
+
+	gn_fmt_fixed(ours, 1.25, 20);
+	snprintf(libc, sizeof(libc), "%.*f", GN_FMT_MAXPREC, 1.25);
+	CHECK_STR(ours, libc);
+    }
+
+    check_huge(1e300, 2);
+    check_huge(-1e25, 6);
+    check_huge(18446744073709551616.0, 0);
+    check_huge(-1.7976931348623157e308, GN_FMT_MAXPREC);
+    check_huge(1.0 / 0.0, 3);
+    check_huge(-1.0 / 0.0, 3);
+
+    srand48(1);
+    for (i=0; i < 200000; i++) {
+	check_u32((uint32_t)mrand48());
+	check_u64(((uint64_t)mrand48() << 32) ^ (uint32_t)mrand48());
+	check_fixed((drand48() - 0.5) * 2e6, i % (GN_FMT_MAXPREC + 1));
+    }
+    return test_done();
+}
@@ -0,0 +1,104 @@
+/*
+ * The rx line parser: lines split across segments, CRLF, over-long
+ * lines, ping, chg, and a partial line left by a dropped connection
+ */
+
+#include "test.h"
+
+static gnhast gn("parser", 1);
+static test_server srv;
+
+static int chg_calls;
+static bool chg_accept = true;
+static uint32_t chg_value;
+
+static bool chg_cb(int dev, gn_data_t data)
+{
+    (void)dev;
+    chg_calls++;
+    chg_value = data.u;
+    return chg_accept;
+}
+
+/* send s from the server, and run until n lines start with prefix */
+static bool expect(const char *s, const char *prefix, int n)
+{
+    srv.send(s);
+    return test_run(gn, srv, 1000, [&]() { return srv.count(prefix) >= n; });
+}
+
+/* let whatever s causes happen */
+static void settle(const char *s)
+{
+    srv.send(s);
+    test_run(gn, srv, 100, []() { return false; });
+}
+
+int main()
+{
+    std::string longline(GN_RXLINE_SIZE + 50, 'x');
+    int sw;
+
+    test_fs();
+    sw = gn.generic_build_device((char *)"sw1", (char *)"Switch 1",
+				 PROTO_GENERIC, DEVICE_SWITCH, SUBTYPE_SWITCH,
+				 DATATYPE_UINT, 0, NULL);
+    gn.set_chg_callback(sw, chg_cb);
+    CHECK(test_up(gn, srv));
+
+    /* whole lines, and a line in pieces */
+    CHECK(expect("ping\n", "imalive", 1));
+    host_tcp_rxchunk(3);
+    CHECK(expect("ping\nping\n", "imalive", 3));
+    host_tcp_rxchunk(0);
+
+    /* CRLF, and junk that is not a command */
+    CHECK(expect("ping\r\n", "imalive", 4));
+    settle("\n\r\nbogus verb\nbogus\n");
+    CHECK(srv.lines.size() == 6);
+
+    /* an over-long line is dropped whole, the next one is fine */
+    longline += " ping\n";
+    settle(longline.c_str());
+    CHECK(srv.count("imalive") == 4);
+    CHECK(expect("ping\n", "imalive", 5));
+    host_tcp_rxchunk(16);
+    settle(longline.c_str());
+    CHECK(srv.count("imalive") == 5);
+    CHECK(expect("ping\n", "imalive", 6));
+    host_tcp_rxchunk(0);
+
+    /* chg: the callback gets the value, the upd confirms it */
+    srv.clear();
+    CHECK(expect("chg uid:sw1 switch:1\n", "upd uid:sw1", 1));
+    CHECK(chg_calls == 1 && chg_value == 1);
+    CHECK_STR(srv.lines.back(), "upd uid:sw1 switch:1");
+    CHECK(gn.get_dev_byindex(sw)->data.u == 1);
+
+    /* refused, the upd says what we kept */
+    chg_accept = false;
+    CHECK(expect("chg uid:sw1 switch:0\n", "upd uid:sw1", 2));
+    CHECK(chg_calls == 2 && chg_value == 0);
+    CHECK_STR(srv.lines.back(), "upd uid:sw1 switch:1");
+    chg_accept = true;
+
+    /* unknown uid, no value, no uid: ignored */
+    settle("chg uid:nope switch:1\nchg uid:sw1 temp:4\nchg switch:1\n");
+    CHECK(chg_calls == 2);
+    CHECK(srv.lines.size() == 2);
+
+    /* the start of a line, then the connection drops.  The rest arriving
+       on the next connection is no line at all */
+    settle("chg uid:s");
+    srv.drop();
+    test_run(gn, srv, 500, []() {
+	    return gn.conn_state() != GN_CONN_UP;
+	});
+    host_advance(GN_BACKOFF_MAX);
+    srv.clear();
+    CHECK(test_run(gn, srv, 2000, []() { return srv.count("getapiv"); }));
+    settle("w1 switch:0\n");
+    CHECK(chg_calls == 2);
+    CHECK(expect("ping\n", "imalive", 1));
+    return test_done();
+}
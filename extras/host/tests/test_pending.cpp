@@ -0,0 +1,100 @@
+/*
+ * Updates while gnhastd is unreachable: a keep-all device keeps every
+ * sample, in order, the others only their latest value, and a live
+ * update made during the replay goes behind the history
+ */
+
+#include "test.h"
+
+static gnhast gn("pending", 1);
+static test_server srv;
+
+/* the values of the upds for uid, in the order they arrived */
+static std::vector<uint32_t> upds(const char *uid)
+{
+    std::vector<uint32_t> v;
+    char prefix[32];
+    size_t i, plen;
+
+    snprintf(prefix, sizeof(prefix), "upd uid:%s count:", uid);
+    plen = strlen(prefix);
+    for (i=0; i < srv.lines.size(); i++)
+	if (srv.lines[i].compare(0, plen, prefix) == 0)
+	    v.push_back(strtoul(srv.lines[i].c_str() + plen, NULL, 10));
+    return v;
+}
+
+static int mkdev(const char *uid, bool keepall)
+{
+    int dev = gn.generic_build_device((char *)uid, (char *)uid,
+				      PROTO_GENERIC, DEVICE_SENSOR,
+				      SUBTYPE_COUNTER, DATATYPE_UINT, 0, NULL);
+
+    gn.set_dev_keepall(dev, keepall);
+    gn.gn_register_device(dev);
+    return dev;
+}
+
+int main()
+{
+    std::vector<uint32_t> v;
+    int k1, k2, last, i;
+
+    test_fs();
+    k1 = mkdev("k1", true);
+    k2 = mkdev("k2", true);
+    last = mkdev("last", false);
+    CHECK(test_up(gn, srv));
+    srv.drop();
+    CHECK(test_run(gn, srv, 1000, []() {
+		return gn.conn_state() != GN_CONN_UP;
+	    }));
+
+    /* two keep-all devices interleaved, and one that only keeps its
+       latest value */
+    for (i=0; i < 10; i++) {
+	gn.store_data_dev(k1, test_u(100 + i));
+	gn.gn_update_device(k1);
+	gn.store_data_dev(last, test_u(200 + i));
+	gn.gn_update_device(last);
+	if (i & 1) {
+	    gn.store_data_dev(k2, test_u(300 + i));
+	    gn.gn_update_device(k2);
+	}
+    }
+    CHECK(gn.pending_count() == 10 + 5 + 1);
+
+    /* back: the regs, then the history oldest first, then the latest */
+    srv.clear();
+    host_advance(GN_BACKOFF_MAX);
+    CHECK(test_run(gn, srv, 2000, []() {
+		return srv.count("upd uid:") >= 1;
+	    }));
+
+    /* a live sample while the replay is under way waits its turn */
+    gn.store_data_dev(k1, test_u(110));
+    gn.gn_update_device(k1);
+    CHECK(test_run(gn, srv, 3000, []() {
+		return srv.count("upd uid:") == 10 + 5 + 1 + 1;
+	    }));
+    CHECK(gn.pending_count() == 0);
+
+    v = upds("k1");
+    CHECK(v.size() == 11);
+    for (i=0; i < (int)v.size(); i++)
+	CHECK(v[i] == (uint32_t)(100 + i));
+    v = upds("k2");
+    CHECK(v.size() == 5);
+    for (i=0; i < (int)v.size(); i++)
+	CHECK(v[i] == (uint32_t)(301 + 2 * i));
+    v = upds("last");
+    CHECK(v.size() == 1 && v[0] == 209);
+
+    /* the regs came first, and the interleaving was kept */
+    for (i=0; i < 3; i++)
+	CHECK(srv.lines[2 + i].compare(0, 8, "reg uid:") == 0);
+    CHECK_STR(srv.lines[5], "upd uid:k1 count:100");
+    CHECK_STR(srv.lines[6], "upd uid:k1 count:101");
+    CHECK_STR(srv.lines[7], "upd uid:k2 count:301");
+    return test_done();
+}
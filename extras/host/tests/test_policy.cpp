@@ -0,0 +1,93 @@
+/*
+ * Per-device reporting policy: absolute and percent deadbands, the
+ * minimum interval between reports, and the max_interval heartbeat
+ */
+
+#include "test.h"
+
+static gnhast gn("policy", 1);
+static test_server srv;
+
+/* update dev, and say whether an upd for it went out */
+static bool sent(int dev)
+{
+    int before = srv.count("upd uid:");
+
+    gn.gn_update_device(dev);
+    test_run(gn, srv, 30, [&]() { return srv.count("upd uid:") > before; });
+    return srv.count("upd uid:") > before;
+}
+
+int main()
+{
+    int abs, pct, slow, hb;
+
+    test_fs();
+    abs = gn.generic_build_device((char *)"abs", (char *)"abs",
+				  PROTO_GENERIC, DEVICE_SENSOR, SUBTYPE_TEMP,
+				  DATATYPE_DOUBLE, TSCALE_C, NULL,
+				  0.5, GN_DEADBAND_ABS);
+    pct = gn.generic_build_device((char *)"pct", (char *)"pct",
+				  PROTO_GENERIC, DEVICE_SENSOR,
+				  SUBTYPE_COUNTER, DATATYPE_UINT, 0, NULL,
+				  10, GN_DEADBAND_PCT);
+    slow = gn.generic_build_device((char *)"slow", (char *)"slow",
+				   PROTO_GENERIC, DEVICE_SENSOR,
+				   SUBTYPE_COUNTER, DATATYPE_UINT, 0, NULL,
+				   0, GN_DEADBAND_ABS, 1000);
+    hb = gn.generic_build_device((char *)"hb", (char *)"hb",
+				 PROTO_GENERIC, DEVICE_SENSOR,
+				 SUBTYPE_COUNTER, DATATYPE_UINT, 0, NULL,
+				 1000, GN_DEADBAND_ABS, 0, 5000);
+    gn.set_dev_precision(abs, 1);
+    CHECK(test_up(gn, srv));
+
+    /* absolute: measured from the last value sent, not the last stored */
+    gn.store_data_dev(abs, test_d(20.0));
+    CHECK(sent(abs));
+    gn.store_data_dev(abs, test_d(20.3));
+    CHECK(!sent(abs));
+    gn.store_data_dev(abs, test_d(20.6));
+    CHECK(sent(abs));
+    CHECK_STR(srv.lines.back(), "upd uid:abs temp:20.6");
+    gn.store_data_dev(abs, test_d(20.2));
+    CHECK(!sent(abs));
+    gn.store_data_dev(abs, test_d(20.0));
+    CHECK(sent(abs));
+
+    /* percent of the last value sent */
+    gn.store_data_dev(pct, test_u(100));
+    CHECK(sent(pct));
+    gn.store_data_dev(pct, test_u(109));
+    CHECK(!sent(pct));
+    gn.store_data_dev(pct, test_u(110));
+    CHECK(sent(pct));
+    gn.store_data_dev(pct, test_u(100));
+    CHECK(!sent(pct));
+
+    /* no more often than min_interval, however much it changes */
+    gn.store_data_dev(slow, test_u(1));
+    CHECK(sent(slow));
+    gn.store_data_dev(slow, test_u(2));
+    CHECK(!sent(slow));
+    host_advance(800);
+    CHECK(!sent(slow));
+    host_advance(200);
+    CHECK(sent(slow));
+    CHECK_STR(srv.lines.back(), "upd uid:slow count:2");
+
+    /* nothing new, but max_interval makes flush_dirty() send it anyway */
+    gn.store_data_dev(hb, test_u(7));
+    CHECK(sent(hb));
+    CHECK(gn.flush_dirty() == 0);
+    host_advance(4000);
+    gn.store_data_dev(hb, test_u(8));
+    CHECK(gn.flush_dirty() == 0);
+    host_advance(1000);
+    srv.clear();
+    CHECK(gn.flush_dirty() == 1);
+    CHECK(test_run(gn, srv, 1000, []() { return srv.count("upd uid:hb"); }));
+    CHECK_STR(srv.lines.back(), "upd uid:hb count:8");
+    CHECK(gn.flush_dirty() == 0);
+    return test_done();
+}
@@ -0,0 +1,47 @@
+/*
+ * gn_rtcmem_ram, the host fake, and gn_rtcmem_esp on the ESP shim
+ */
+
+#include "test.h"
+
+static void check_rtcmem(gn_rtcmem *rtc)
+{
+    uint32_t in[4] = { 0x01020304, 0xdeadbeef, 0, 0xffffffff };
+    uint32_t out[4];
+
+    CHECK(rtc->write(GN_RTCMEM_RESERVED, in, sizeof(in)));
+    memset(out, 0, sizeof(out));
+    CHECK(rtc->read(GN_RTCMEM_RESERVED, out, sizeof(out)));
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+
+    /* the very end fits, one word more does not */
+    CHECK(rtc->write(GN_RTCMEM_SIZE - 4, in, 4));
+    CHECK(rtc->read(GN_RTCMEM_SIZE - 4, out, 4));
+    CHECK(out[0] == in[0]);
+    CHECK(!rtc->write(GN_RTCMEM_SIZE - 4, in, 8));
+    CHECK(!rtc->read(GN_RTCMEM_SIZE, out, 4));
+}
+
+int main()
+{
+    gn_rtcmem_ram ram;
+    uint8_t zero[GN_RTCMEM_SIZE];
+    gn_fastconn_t fc;
+    gn_disc_t disc;
+    gn_sleepstate_t ss;
+
+    memset(zero, 0, sizeof(zero));
+    CHECK(memcmp(ram.mem, zero, sizeof(zero)) == 0);
+    check_rtcmem(&ram);
+    CHECK(memcmp(&ram.mem[GN_RTCMEM_RESERVED], "\x04\x03\x02\x01", 4) == 0);
+
+    check_rtcmem(&gn_rtcmem_default);
+    CHECK(host_rtcmem[GN_RTCMEM_RESERVED / 4 + 1] == 0xdeadbeef);
+
+    /* the library's caches fit above the core's part, in order */
+    CHECK(GN_RTC_FAST_OFFSET >= GN_RTCMEM_RESERVED);
+    CHECK(GN_RTC_FAST_OFFSET + sizeof(fc) <= GN_RTC_DISC_OFFSET);
+    CHECK(GN_RTC_DISC_OFFSET + sizeof(disc) <= GN_RTC_SLEEP_OFFSET);
+    CHECK(GN_RTC_SLEEP_OFFSET + sizeof(ss) <= GN_RTCMEM_SIZE);
+    return test_done();
+}
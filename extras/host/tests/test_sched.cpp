@@ -0,0 +1,143 @@
+/*
+ * The sensor scheduler: a slow conversion is started, not waited on, and
+ * read when it is ready, sensors without a start are just read, the
+ * cadence holds, a failing read is counted, and what one pass reads goes
+ * out together
+ */
+
+#include "test.h"
+
+static gnhast gn("sched", 1);
+static test_server srv;
+
+typedef struct {
+    int dev;
+    uint32_t convert; /* ms a conversion takes */
+    int starts;
+    int reads;
+    uint32_t last_start;
+    bool fail;
+} sensor_t;
+
+static uint32_t start_cb(void *arg)
+{
+    sensor_t *s = (sensor_t *)arg;
+
+    s->starts++;
+    s->last_start = millis();
+    return s->convert;
+}
+
+static bool read_cb(void *arg)
+{
+    sensor_t *s = (sensor_t *)arg;
+
+    s->reads++;
+    if (s->fail)
+	return false;
+    gn.store_data_dev(s->dev, test_u(s->reads));
+    return true;
+}
+
+static int mkdev(const char *uid)
+{
+    int dev = gn.generic_build_device((char *)uid, (char *)uid,
+				      PROTO_GENERIC, DEVICE_SENSOR,
+				      SUBTYPE_COUNTER, DATATYPE_UINT, 0, NULL);
+
+    gn.gn_register_device(dev);
+    return dev;
+}
+
+/* move on ms, and run handle() once */
+static void tick(uint32_t ms)
+{
+    host_advance(ms);
+    gn.handle();
+}
+
+/* move on to ms after t, and run handle() once */
+static void at(uint32_t t, uint32_t ms)
+{
+    if ((int32_t)(t + ms - millis()) > 0)
+	host_advance(t + ms - millis());
+    gn.handle();
+}
+
+int main()
+{
+    static sensor_t slow, quick;
+    uint32_t t0, us;
+    int s1, s2;
+
+    test_fs();
+    slow.dev = mkdev("slow");
+    slow.convert = 750;
+    quick.dev = mkdev("quick");
+    CHECK(test_up(gn, srv));
+
+    s1 = gn.add_sensor(start_cb, read_cb, &slow, 2000);
+    s2 = gn.add_sensor(NULL, read_cb, &quick, 1000);
+    CHECK(s1 == 0 && s2 == 1);
+
+    /* started on the first handle(), which does not wait for it */
+    us = micros();
+    gn.handle();
+    CHECK(micros() - us < 50000);
+    CHECK(slow.starts == 1 && slow.reads == 0);
+    t0 = slow.last_start;
+
+    /* no start, so read as soon as it is due, staggered 10 ms behind */
+    tick(10);
+    CHECK(quick.reads == 1);
+    CHECK(test_run(gn, srv, 500, []() { return srv.count("upd uid:quick"); }));
+
+    /* read once the conversion is done, not before */
+    at(t0, 700);
+    CHECK(slow.reads == 0);
+    at(t0, 750);
+    CHECK(slow.reads == 1);
+    CHECK(test_run(gn, srv, 500, []() { return srv.count("upd uid:slow"); }));
+
+    /* the next start is a period after the last one, not after the read */
+    at(t0, 1900);
+    CHECK(slow.starts == 1);
+    at(t0, 2000);
+    CHECK(slow.starts == 2 && slow.last_start - t0 < 2050);
+
+    /* failing reads are counted, and forgotten by the next good one */
+    quick.fail = true;
+    tick(1000);
+    tick(1000);
+    CHECK(gn.sensor_fails(s2) == 2);
+    CHECK(gn.sensor_fails(s1) == 0);
+    quick.fail = false;
+    tick(1000);
+    CHECK(gn.sensor_fails(s2) == 0);
+    CHECK(gn.sensor_fails(5) == 0);
+
+    /* a whole period behind: run now, then a period from now, no burst */
+    quick.reads = 0;
+    tick(10000);
+    CHECK(quick.reads == 1);
+    tick(900);
+    CHECK(quick.reads == 1);
+    tick(100);
+    CHECK(quick.reads == 2);
+
+    /* both read in one pass go out together */
+    test_run(gn, srv, 500, []() {
+	    gn_txstats_t st;
+
+	    gn.get_txstats(&st);
+	    return st.waiting == 0 && st.inflight == 0;
+	});
+    srv.clear();
+    slow.convert = 0;
+    slow.fail = quick.fail = false;
+    tick(2000);
+    CHECK(test_run(gn, srv, 500, []() { return srv.lines.size() >= 2; }));
+    CHECK(srv.count("upd uid:slow") == 1);
+    CHECK(srv.count("upd uid:quick") == 1);
+    return test_done();
+}
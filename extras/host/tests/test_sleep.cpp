@@ -0,0 +1,127 @@
+/*
+ * Deep sleep batching across wakes, each wake a fresh gnhast on the same
+ * RTC memory: samples leave the ring only once gnhastd has acked them,
+ * a connection lost mid-send is picked up again, and the regs go again
+ * after a drop, and every GN_SLEEP_REREG sends.
+ */
+
+#include "test.h"
+
+static gn_rtcmem_ram ram;
+static test_server srv;
+static int drop_after; /* drop the client after this many upds, 0 never */
+static bool hurry; /* make the send time out */
+
+/* runs while sleep_end() waits on the network */
+static void idle()
+{
+    srv.poll();
+    if (drop_after && srv.count("upd uid:") >= drop_after) {
+	drop_after = 0;
+	srv.drop();
+    }
+    if (hurry)
+	host_advance(1000);
+}
+
+static void put_file(const char *path, const char *contents)
+{
+    File f = SPIFFS.open(path, "w");
+
+    f.print(contents);
+    f.close();
+}
+
+/* one wake: n samples of s1, from first up, then sleep */
+static void wake(int n, uint32_t first)
+{
+    gnhast *gn = new gnhast("sleep", 1);
+    int dev, i;
+
+    gn->set_rtcmem(&ram);
+    gn->sleep_begin(1);
+    dev = gn->generic_build_device((char *)"s1", (char *)"s1",
+				   PROTO_GENERIC, DEVICE_SENSOR,
+				   SUBTYPE_COUNTER, DATATYPE_UINT, 0, NULL);
+    gn->gn_register_device(dev);
+    for (i=0; i < n; i++) {
+	gn->store_data_dev(dev, test_u(first + i));
+	gn->gn_update_device(dev);
+    }
+    srv.clear();
+    host_slept_us = 0;
+    gn->sleep_end(60 * 1000000ULL);
+    CHECK(host_slept_us == 60 * 1000000ULL);
+}
+
+/* did s1 count:value reach gnhastd? */
+static bool got(uint32_t value)
+{
+    char line[64];
+    size_t i;
+
+    snprintf(line, sizeof(line), "upd uid:s1 count:%u", (unsigned)value);
+    for (i=0; i < srv.lines.size(); i++)
+	if (srv.lines[i] == line)
+	    return true;
+    return false;
+}
+
+int main()
+{
+    char json[128];
+    int accepts, last, i;
+
+    test_fs();
+    snprintf(json, sizeof(json),
+	     "{\"gnhast_server\":\"127.0.0.1\",\"gnhast_port\":\"%d\"}",
+	     srv.port());
+    put_file("/config.json", json);
+    CHECK(srv.listen());
+    host_idle(idle);
+    /* a line or two in flight at a time, the rest waits in the ring */
+    host_tcp_sndbuf(48);
+
+    /* first wake: nothing known, so the reg goes with the sample */
+    wake(1, 1);
+    CHECK(srv.count("reg uid:s1") == 1);
+    CHECK(got(1));
+
+    /* gnhastd goes away part way: nothing is lost, and the reconnect
+       registers again, it may be a new gnhastd */
+    accepts = srv.accepts;
+    drop_after = 3;
+    wake(8, 100);
+    CHECK(srv.accepts == accepts + 2);
+    for (i=0; i < 8; i++)
+	CHECK(got(100 + i));
+    CHECK(srv.count("reg uid:s1") == 1);
+
+    /* nothing was left behind in the ring */
+    accepts = srv.accepts;
+    wake(0, 0);
+    CHECK(srv.accepts == accepts);
+
+    /* a send that fails keeps its samples for the next one */
+    srv.stop();
+    hurry = true;
+    wake(2, 200);
+    hurry = false;
+    CHECK(srv.listen());
+    wake(1, 202);
+    CHECK(got(200) && got(201) && got(202));
+
+    /* the regs are sent again every GN_SLEEP_REREG sends */
+    last = -1;
+    for (i=0; i < 3 * GN_SLEEP_REREG; i++) {
+	wake(1, 300 + i);
+	CHECK(got(300 + i));
+	if (srv.count("reg uid:s1") == 0)
+	    continue;
+	if (last >= 0)
+	    CHECK(i - last == GN_SLEEP_REREG);
+	last = i;
+    }
+    CHECK(last >= GN_SLEEP_REREG);
+    return test_done();
+}
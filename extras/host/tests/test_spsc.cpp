@@ -0,0 +1,71 @@
+/*
+ * post_data_dev(): what is not a device is refused, a full queue refuses
+ * and keeps what it has, handle() drains GN_SPSC_BATCH at a time, in
+ * order, and the value keeps the time it was posted
+ */
+
+#include "test.h"
+
+static gnhast gn("spsc", 1);
+static test_server srv;
+
+static int mkdev(const char *uid)
+{
+    int dev = gn.generic_build_device((char *)uid, (char *)uid,
+				      PROTO_GENERIC, DEVICE_SENSOR,
+				      SUBTYPE_COUNTER, DATATYPE_UINT, 0, NULL);
+
+    gn.gn_register_device(dev);
+    return dev;
+}
+
+int main()
+{
+    uint32_t posted;
+    size_t i;
+    int a, b;
+
+    test_fs();
+    a = mkdev("a");
+    b = mkdev("b");
+    CHECK(test_up(gn, srv));
+    gn.store_data_dev(a, test_u(1000));
+    srv.clear();
+
+    /* not devices, and not wrapped onto one either */
+    CHECK(!gn.post_data_dev(-1, test_u(1)));
+    CHECK(!gn.post_data_dev(b + 1, test_u(1)));
+    CHECK(!gn.post_data_dev(256, test_u(1)));
+    CHECK(!gn.post_data_dev(256 + a, test_u(1)));
+    gn.handle();
+    CHECK(gn.get_dev_byindex(a)->data.u == 1000);
+
+    /* fill it, one more is refused */
+    for (i=0; i < GN_SPSC_SIZE; i++)
+	CHECK(gn.post_data_dev(a, test_u(i)));
+    CHECK(!gn.post_data_dev(b, test_u(99)));
+
+    /* a batch per handle() */
+    gn.handle();
+    CHECK(gn.get_dev_byindex(a)->data.u == GN_SPSC_BATCH - 1);
+    CHECK(gn.post_data_dev(b, test_u(99)));
+    CHECK(test_run(gn, srv, 1000, []() {
+		return srv.count("upd uid:") == GN_SPSC_SIZE + 1;
+	    }));
+    for (i=0; i < GN_SPSC_SIZE; i++) {
+	char line[32];
+
+	snprintf(line, sizeof(line), "upd uid:a count:%u", (unsigned)i);
+	CHECK_STR(srv.lines[i], line);
+    }
+    CHECK_STR(srv.lines[GN_SPSC_SIZE], "upd uid:b count:99");
+
+    /* stored when it was posted, not when handle() got to it */
+    posted = micros();
+    CHECK(gn.post_data_dev(b, test_u(100)));
+    host_advance(5000);
+    gn.handle();
+    CHECK(gn.get_dev_byindex(b)->data.u == 100);
+    CHECK(gn.get_dev_byindex(b)->stored - posted < 1000000);
+    return test_done();
+}
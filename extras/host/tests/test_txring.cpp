@@ -0,0 +1,127 @@
+/*
+ * The outbound ring: a burst bigger than the ring drops whole lines and
+ * counts them, and a priority line waits for the line tcp is in the
+ * middle of, then jumps the rest of the queue
+ */
+
+#include "test.h"
+
+static gnhast gn("txring", 1);
+static test_server srv;
+
+static bool chg_cb(int dev, gn_data_t data)
+{
+    (void)dev;
+    (void)data;
+    return true;
+}
+
+/* every upd arrived whole, with values going up from base */
+static bool upds_whole(const char *uid, uint32_t base, int *n)
+{
+    char want[64];
+    uint32_t v, last = 0;
+    size_t i, plen;
+    char *end;
+
+    snprintf(want, sizeof(want), "upd uid:%s count:", uid);
+    plen = strlen(want);
+    *n = 0;
+    for (i=0; i < srv.lines.size(); i++) {
+	if (srv.lines[i].compare(0, 8, "upd uid:") != 0)
+	    continue;
+	if (srv.lines[i].compare(0, 11, "upd uid:sw1") == 0)
+	    continue;
+	if (srv.lines[i].compare(0, plen, want) != 0)
+	    goto spliced;
+	v = strtoul(srv.lines[i].c_str() + plen, &end, 10);
+	if (*end != '\0' || v < base || (*n && v <= last))
+	    goto spliced;
+	last = v;
+	(*n)++;
+    }
+    return true;
+
+ spliced:
+    fprintf(stderr, "bad line: %s\n", srv.lines[i].c_str());
+    return false;
+}
+
+int main()
+{
+    gn_txstats_t st;
+    int c1, sw, i, n, swat;
+    uint32_t hiwat;
+
+    test_fs();
+    c1 = gn.generic_build_device((char *)"c1", (char *)"Count 1",
+				 PROTO_GENERIC, DEVICE_SENSOR, SUBTYPE_COUNTER,
+				 DATATYPE_UINT, 0, NULL);
+    sw = gn.generic_build_device((char *)"sw1", (char *)"Switch 1",
+				 PROTO_GENERIC, DEVICE_SWITCH, SUBTYPE_SWITCH,
+				 DATATYPE_UINT, 0, NULL);
+    gn.set_chg_callback(sw, chg_cb);
+    gn.gn_register_device(c1);
+    CHECK(test_up(gn, srv));
+    CHECK(test_run(gn, srv, 1000, []() {
+		gn_txstats_t s;
+
+		gn.get_txstats(&s);
+		return s.waiting == 0 && s.inflight == 0;
+	    }));
+
+    /* a tight loop with a 7 byte tcp window: the ring fills, what does
+       not fit is dropped a line at a time, and the rest goes out whole */
+    host_tcp_sndbuf(7);
+    srv.clear();
+    for (i=0; i < 100; i++) {
+	gn.store_data_dev(c1, test_u(1000000 + i));
+	gn.gn_update_device(c1);
+    }
+    gn.get_txstats(&st);
+    CHECK(st.drop_lines > 0);
+    CHECK(st.waiting <= GN_TXBUF_SIZE);
+    CHECK(st.hiwat <= GN_TXBUF_SIZE);
+    hiwat = st.hiwat;
+    CHECK(test_run(gn, srv, 5000, []() {
+		gn_txstats_t s;
+
+		gn.get_txstats(&s);
+		return s.waiting == 0 && s.inflight == 0;
+	    }));
+    CHECK(upds_whole("c1", 1000000, &n));
+    gn.get_txstats(&st);
+    CHECK(n + (int)st.drop_lines == 100);
+    CHECK(st.queued == st.acked);
+    CHECK(st.sent == st.acked);
+    CHECK(st.hiwat == hiwat);
+
+    /* a chg confirmation while tcp is part way into a line: the line is
+       finished, then the confirmation, then the rest of the queue */
+    srv.clear();
+    for (i=0; i < 10; i++) {
+	gn.store_data_dev(c1, test_u(2000000 + i));
+	gn.gn_update_device(c1);
+    }
+    test_run(gn, srv, 10, []() { return false; });
+    srv.send("chg uid:sw1 switch:1\n");
+    CHECK(test_run(gn, srv, 3000, []() {
+		return srv.count("upd uid:c1") == 10 &&
+		    srv.count("upd uid:sw1") == 1;
+	    }));
+    CHECK(upds_whole("c1", 2000000, &n));
+    CHECK(n == 10);
+    for (swat = 0; swat < (int)srv.lines.size(); swat++)
+	if (srv.lines[swat] == "upd uid:sw1 switch:1")
+	    break;
+    CHECK(swat < (int)srv.lines.size() - 1);
+    host_tcp_sndbuf(2920);
+
+    /* a line of the sketch's own, only while connected */
+    CHECK(gn.send_line("ping"));
+    CHECK(test_run(gn, srv, 1000, []() { return srv.count("ping") == 1; }));
+    gn.disconnect();
+    test_run(gn, srv, 1000, []() { return !srv.connected(); });
+    CHECK(!gn.send_line("ping"));
+    return test_done();
+}
@@ -0,0 +1,74 @@
+/*
+ * WiFi bring-up: init_wifi_async() connects in the background, and falls
+ * back to the modeless portal after enough failed attempts.  init_wifi()
+ * blocks, and a link lost later is only ever retried, its portal is long
+ * gone by then.
+ */
+
+#include "test.h"
+
+/* run handle() across n wifi attempts that time out */
+static void fail_attempts(gnhast &gn, int n)
+{
+    int i;
+
+    for (i=0; i < n; i++) {
+	gn.handle();
+	host_advance(GN_WIFI_TIMEOUT);
+	gn.handle();
+    }
+}
+
+int main()
+{
+    static gnhast blocking("wifi", 1);
+    static gnhast async("wifi", 2);
+    int dev;
+
+    test_fs();
+    blocking.set_server((char *)"127.0.0.1", 1);
+
+    /* blocking: up when it returns, and no portal when the link drops */
+    blocking.init_wifi();
+    CHECK(blocking.wifi_state() == GN_WIFI_UP);
+    host_wifi_connected(false);
+    fail_attempts(blocking, GN_WIFI_PORTAL_AFTER + 2);
+    CHECK(blocking.wifi_state() == GN_WIFI_CONNECTING);
+    CHECK(host_wifi_portals == 0);
+    host_wifi_connected(true);
+    blocking.handle();
+    CHECK(blocking.wifi_state() == GN_WIFI_UP);
+
+    /* async: returns at once, updates are held while the wifi is down */
+    host_wifi_connected(false);
+    async.set_server((char *)"127.0.0.1", 1);
+    async.init_wifi_async();
+    CHECK(async.wifi_state() == GN_WIFI_CONNECTING);
+    dev = async.generic_build_device((char *)"c1", (char *)"c1",
+				     PROTO_GENERIC, DEVICE_SENSOR,
+				     SUBTYPE_COUNTER, DATATYPE_UINT, 0, NULL);
+    async.store_data_dev(dev, test_u(1));
+    async.gn_update_device(dev);
+    CHECK(async.pending_count() == 1);
+
+    /* the AP blocking cached in RTC memory is tried first, quickly, and
+       that does not count.  The portal comes after GN_WIFI_PORTAL_AFTER
+       failed attempts. */
+    host_advance(GN_WIFI_FAST_TIMEOUT);
+    async.handle();
+    fail_attempts(async, GN_WIFI_PORTAL_AFTER - 1);
+    CHECK(async.wifi_state() == GN_WIFI_CONNECTING);
+    fail_attempts(async, 1);
+    CHECK(async.wifi_state() == GN_WIFI_PORTAL);
+    CHECK(host_wifi_portals == 1);
+    fail_attempts(async, 2);
+    CHECK(async.wifi_state() == GN_WIFI_PORTAL);
+    CHECK(host_wifi_portals == 1);
+
+    /* the network turns up while the portal is open */
+    host_wifi_connected(true);
+    async.handle();
+    CHECK(async.wifi_state() == GN_WIFI_UP);
+    CHECK(async.pending_count() == 1);
+    return test_done();
+}
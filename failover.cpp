@@ -0,0 +1,213 @@
+/*
+ * Failover between several gnhastd.
+ *
+ * The server from set_server() or init_server() is the primary, entry 0,
+ * and add_server() adds standbys.  Each connect attempt goes to the
+ * healthiest one: the fewest failures in a row, then the lowest round
+ * trip, then the order they were added in.  A failed connect, or gnhastd
+ * going quiet (no ping for GN_PING_TIMEOUT), counts as a failure, and if
+ * another server is not known to be down we switch to it at once instead
+ * of backing off.  A server's failures are forgiven once it pings us or
+ * answers a getapiv, and while we are on another, one every
+ * GN_SRV_FORGIVE ms.  When that brings one back to no failures, and it is
+ * the one we would pick, we fail back to it once nothing is in flight.
+ * If it is still down, that is a failure again, and we come straight
+ * back.  The round trip is the time from our getapiv to the
+ * apiv reply, sent on connect and, if there is a standby, every
+ * GN_SRV_PROBE_INTERVAL ms after, smoothed, so it is only known for
+ * servers we have been connected to.
+ */
+
+#include "gnhast_async.h"
+
+/*!
+ * @brief Add a standby gnhastd to fail over to.  Returns its index, or
+ * -1 if there are already GN_MAX_SERVERS.
+ */
+
+int gnhast::add_server(const char *server, int port)
+{
+    gn_server_t *s;
+
+    /* entry 0 is always the primary */
+    if (_srv_count == 0)
+	_srv_primary();
+    if (_srv_count == GN_MAX_SERVERS) {
+	Serial.println("Too many gnhastd servers, ignoring");
+	return -1;
+    }
+    s = &_srv[_srv_count];
+    s->host = strdup(server);
+    s->port = port;
+    s->fails = 0;
+    s->rtt_ms = 0;
+    return _srv_count++;
+}
+
+/*
+ * _server and _port were just set as the primary, make them entry 0
+ */
+
+void gnhast::_srv_primary()
+{
+    gn_server_t *s = &_srv[0];
+
+    if (_srv_count == 0)
+	_srv_count = 1;
+    if (s->host == NULL || strcmp(s->host, _server) != 0 ||
+	s->port != _port) {
+	s->fails = 0;
+	s->rtt_ms = 0;
+    }
+    /* the same server may be a new copy of the name */
+    s->host = _server;
+    s->port = _port;
+    _srv_cur = 0;
+}
+
+/*
+ * Which server to try next
+ */
+
+int gnhast::_srv_pick()
+{
+    gn_server_t *s, *b;
+    uint32_t srtt, brtt;
+    int i, best = 0;
+
+    for (i=1; i < _srv_count; i++) {
+	s = &_srv[i];
+	b = &_srv[best];
+	if (s->fails != b->fails) {
+	    if (s->fails < b->fails)
+		best = i;
+	    continue;
+	}
+	srtt = s->rtt_ms ? s->rtt_ms : GN_SRV_RTT_UNKNOWN;
+	brtt = b->rtt_ms ? b->rtt_ms : GN_SRV_RTT_UNKNOWN;
+	if (srtt < brtt)
+	    best = i;
+    }
+    return best;
+}
+
+/*
+ * Point _server and _port at server i
+ */
+
+void gnhast::_srv_use(int i)
+{
+    if (_srv_count == 0)
+	return;
+    if (i != _srv_cur)
+	Serial.printf("Switching to gnhastd %s:%d\n", _srv[i].host,
+		      _srv[i].port);
+    _srv_cur = i;
+    _server = (char *)_srv[i].host;
+    _port = _srv[i].port;
+}
+
+/*
+ * The server we were on failed.  Returns true if there is another one not
+ * known to be down, worth trying right away.
+ */
+
+bool gnhast::_srv_failed()
+{
+    int next;
+
+    if (_srv_count < 2)
+	return false;
+    if (_srv[_srv_cur].fails < 0xffff)
+	_srv[_srv_cur].fails++;
+    _srv_probe_at = 0;
+    /* the others get a full period from here */
+    _srv_forgive_last = millis();
+    _srv_failback = false;
+    next = _srv_pick();
+    return next != _srv_cur && _srv[next].fails == 0;
+}
+
+/*
+ * The server we are on is alive
+ */
+
+void gnhast::_srv_healthy()
+{
+    if (_srv_count)
+	_srv[_srv_cur].fails = 0;
+}
+
+/*
+ * Time the server we are on again, if it is due.  The getapiv goes in the
+ * priority lane, so queued telemetry does not count against it.  The rtt
+ * only picks between servers, so with no standby there is nothing to time.
+ */
+
+void gnhast::_srv_probe(uint32_t now)
+{
+    if (GN_SRV_PROBE_INTERVAL == 0 || _srv_count < 2 || _srv_probe_at ||
+	now - _srv_probe_last < GN_SRV_PROBE_INTERVAL)
+	return;
+    _ln_begin(true);
+    _ln_puts("getapiv");
+    if (_ln_end())
+	_srv_probe_at = now | 1;
+}
+
+/*
+ * The apiv reply to a getapiv came in
+ */
+
+void gnhast::_srv_answer()
+{
+    gn_server_t *s;
+    uint32_t now = millis(), rtt;
+
+    _srv_healthy();
+    if (_srv_count == 0 || _srv_probe_at == 0)
+	return;
+    s = &_srv[_srv_cur];
+    /* _srv_probe_at is odd, an answer in the same ms can look early */
+    rtt = now - _srv_probe_at;
+    if ((int32_t)rtt <= 0)
+	rtt = 1;
+    s->rtt_ms = s->rtt_ms ? (3 * s->rtt_ms + rtt) / 4 : rtt;
+    _srv_probe_at = 0;
+    _srv_probe_last = now;
+    if (_debug)
+	Serial.printf("gnhastd %s rtt %u ms\n", s->host, (unsigned)s->rtt_ms);
+}
+
+/*
+ * Forgive the servers we are not on a failure, if it is time, and fail
+ * back to one that is now the best.  Not a failure of the one we are on,
+ * so it is closed without counting against it, or backing off.
+ */
+
+void gnhast::_srv_forgive(uint32_t now)
+{
+    int i, best;
+
+    if (_srv_count < 2)
+	return;
+    if (now - _srv_forgive_last >= GN_SRV_FORGIVE) {
+	_srv_forgive_last = now;
+	for (i=0; i < _srv_count; i++)
+	    if (i != _srv_cur && _srv[i].fails && --_srv[i].fails == 0)
+		_srv_failback = true;
+    }
+    /* wait until everything sent is acked, so nothing is lost */
+    if (!_srv_failback || _tx_snd != _tx_wr || _tx_inflight ||
+	_tx_prio_len)
+	return;
+    _srv_failback = false;
+    best = _srv_pick();
+    if (best == _srv_cur || _srv[best].fails)
+	return;
+    Serial.printf("Failing back to gnhastd %s:%d\n", _srv[best].host,
+		  _srv[best].port);
+    _conn_state = GN_CONN_BACKOFF;
+    _conn_next = now;
+    client->close(true);
+}
@@ -0,0 +1,169 @@
+/*
+ * Fast reconnect cache.
+ *
+ * Joining a network the slow way costs a scan and a DHCP exchange, and
+ * reaching gnhastd by name costs a DNS lookup, seconds in all on a bad
+ * day.  So once we get through, we remember the AP (BSSID and channel),
+ * the IP lease, and gnhastd's address, in RTC memory, which survives a
+ * reset and deep sleep, but not a power cycle.  The next time the fast
+ * path is tried first: join that exact AP with a static IP, connect to
+ * gnhastd by address.  If that does not work out, the cached bits are
+ * dropped and we fall back to the slow path.  The lease is reused at
+ * most GN_FAST_MAX_USES times in a row, then we ask DHCP again, so it
+ * does not go stale.
+ */
+
+#include "gnhast_async.h"
+
+#define GN_FAST_MAGIC 0x47464331 /* "GFC1" */
+
+static_assert(sizeof(gn_fastconn_t) % 4 == 0,
+	      "RTC memory is read and written in 4 byte blocks");
+static_assert(GN_RTC_FAST_OFFSET % 4 == 0,
+	      "RTC memory is read and written in 4 byte blocks");
+static_assert(GN_RTC_FAST_OFFSET >= GN_RTCMEM_RESERVED,
+	      "fast reconnect cache overlaps the OTA eboot command");
+static_assert(GN_RTC_FAST_OFFSET + sizeof(gn_fastconn_t) <= GN_RTCMEM_SIZE,
+	      "fast reconnect cache does not fit in RTC memory");
+
+/*
+ * Check a cache record
+ */
+
+static uint16_t gn_fc_crc(gn_fastconn_t *fc)
+{
+    return gn_crc16((uint8_t *)fc + offsetof(gn_fastconn_t, bssid),
+		    sizeof(*fc) - offsetof(gn_fastconn_t, bssid));
+}
+
+/*
+ * Read the cache from RTC memory, once
+ */
+
+void gnhast::_fc_load()
+{
+    if (_fc_loaded)
+	return;
+    _fc_loaded = true;
+    if (!_rtc->read(GN_RTC_FAST_OFFSET, &_fc, sizeof(_fc)) ||
+	_fc.magic != GN_FAST_MAGIC || _fc.crc != gn_fc_crc(&_fc)) {
+	memset(&_fc, 0, sizeof(_fc));
+	return;
+    }
+    if (_debug)
+	Serial.println("Found fast reconnect cache");
+}
+
+/*
+ * Write the cache back to RTC memory
+ */
+
+void gnhast::_fc_save()
+{
+    _fc.magic = GN_FAST_MAGIC;
+    _fc.crc = gn_fc_crc(&_fc);
+    _rtc->write(GN_RTC_FAST_OFFSET, &_fc, sizeof(_fc));
+}
+
+/*
+ * Start joining the cached AP with the cached lease.  Returns false if
+ * there is nothing usable cached, the caller then goes the slow way.
+ */
+
+bool gnhast::_wifi_fast_begin()
+{
+    _fc_load();
+    if (!(_fc.flags & GN_FC_WIFI) || _fc.uses >= GN_FAST_MAX_USES ||
+	WiFi.SSID().length() == 0)
+	return false;
+
+    Serial.printf("Fast connecting to wifi %s, channel %d\n",
+		  WiFi.SSID().c_str(), _fc.channel);
+    WiFi.config(IPAddress(_fc.ip), IPAddress(_fc.gw), IPAddress(_fc.mask),
+		IPAddress(_fc.dns));
+    WiFi.begin(WiFi.SSID().c_str(), WiFi.psk().c_str(), _fc.channel,
+	       _fc.bssid, true);
+    _wifi_fast = true;
+    return true;
+}
+
+/*
+ * The fast path did not get us on the network, forget it, and put DHCP
+ * back for the slow path
+ */
+
+void gnhast::_wifi_fast_failed()
+{
+    Serial.println("Fast wifi connect failed, falling back");
+    _wifi_fast = false;
+    _fc.flags &= ~GN_FC_WIFI;
+    _fc_save();
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0),
+		IPAddress((uint32_t)0));
+}
+
+/*
+ * We are on the network, remember how we got there
+ */
+
+void gnhast::_fc_wifi_up()
+{
+    _fc_load();
+    if (_wifi_fast) {
+	_fc.uses++;
+    } else {
+	memcpy(_fc.bssid, WiFi.BSSID(), sizeof(_fc.bssid));
+	_fc.channel = WiFi.channel();
+	_fc.ip = WiFi.localIP();
+	_fc.gw = WiFi.gatewayIP();
+	_fc.mask = WiFi.subnetMask();
+	_fc.dns = WiFi.dnsIP();
+	_fc.uses = 0;
+	_fc.flags |= GN_FC_WIFI;
+    }
+    _wifi_fast = false;
+    _fc_save();
+}
+
+/*
+ * Cached address of _server:_port, returns false if we have none
+ */
+
+bool gnhast::_fc_server(IPAddress &ip)
+{
+    _fc_load();
+    if (!(_fc.flags & GN_FC_SERVER) || _fc.server_port != _port ||
+	_fc.server_crc != gn_crc16(_server, strlen(_server)))
+	return false;
+    ip = IPAddress(_fc.server_ip);
+    return true;
+}
+
+/*
+ * Connected to gnhastd, remember its address
+ */
+
+void gnhast::_fc_server_up(IPAddress ip)
+{
+    if ((_fc.flags & GN_FC_SERVER) && _fc.server_ip == (uint32_t)ip &&
+	_fc.server_port == _port)
+	return;
+    _fc.server_ip = ip;
+    _fc.server_port = _port;
+    _fc.server_crc = gn_crc16(_server, strlen(_server));
+    _fc.flags |= GN_FC_SERVER;
+    _fc_save();
+}
+
+/*
+ * The cached gnhastd address did not work, look it up next time
+ */
+
+void gnhast::_fc_server_failed()
+{
+    if (!(_fc.flags & GN_FC_SERVER))
+	return;
+    Serial.println("Cached gnhastd address failed, resolving again");
+    _fc.flags &= ~GN_FC_SERVER;
+    _fc_save();
+}
@@ -0,0 +1,177 @@
+/*
+ * Per device filter chains, run by store_data_dev().
+ *
+ * Up to GN_FILT_STAGES cheap filters, applied in the order they were
+ * added, before the value reaches the device (or its aggregation window):
+ *
+ *	GN_FILT_EMA	exponential moving average, each sample moves the
+ *			average 1/2^param of the way, a shift, no multiply
+ *	GN_FILT_MEDIAN	median of the last param (odd, up to
+ *			GN_FILT_MEDIAN_MAX) samples, drops single spikes
+ *	GN_FILT_RATE	change since the previous sample, per param ms, so
+ *			a SUBTYPE_WATTSEC counter stored into a SUBTYPE_WATT
+ *			device with param 1000 reports watts
+ *
+ * The ESP8266 has no FPU, so the chain works in 48.16 fixed point, and
+ * only converts from and to a double at either end, for double devices.
+ * Smoother values mean fewer upds cross the deadband for nothing.
+ */
+
+#include "gnhast_async.h"
+
+#define GN_FIX_SHIFT 16
+#define GN_FIX_ONE ((int64_t)1 << GN_FIX_SHIFT)
+
+static int64_t gn_fix_from(int datatype, gn_data_t data)
+{
+    switch (datatype) {
+    case DATATYPE_UINT:
+	return (int64_t)data.u << GN_FIX_SHIFT;
+    case DATATYPE_LL:
+	return (int64_t)data.u64 << GN_FIX_SHIFT;
+    default:
+	return (int64_t)(data.d * GN_FIX_ONE);
+    }
+}
+
+static void gn_fix_to(int datatype, int64_t v, gn_data_t *data)
+{
+    switch (datatype) {
+    case DATATYPE_UINT:
+	data->u = (v < 0) ? 0 : (uint32_t)((v + GN_FIX_ONE / 2) >> GN_FIX_SHIFT);
+	break;
+    case DATATYPE_LL:
+	data->u64 = (v < 0) ? 0 : (uint64_t)((v + GN_FIX_ONE / 2) >> GN_FIX_SHIFT);
+	break;
+    default:
+	data->d = (double)v / GN_FIX_ONE;
+	break;
+    }
+}
+
+/*!
+ * @brief Add a filter (enum gn_filter_type) to the end of dev's chain.
+ * in_datatype says how values stored into dev are to be read, if not
+ * as its own datatype (a DATATYPE_LL counter into a DATATYPE_DOUBLE rate
+ * device), it is taken from the first filter added.  Returns false if
+ * the chain is full, or param makes no sense.
+ */
+
+bool gnhast::add_dev_filter(int dev, int type, int32_t param,
+			    int in_datatype)
+{
+    gn_dev_t *d = &_devices[dev];
+    gn_filtstage_t *st;
+
+    switch (type) {
+    case GN_FILT_EMA:
+	if (param < 1 || param > 15)
+	    return false;
+	break;
+    case GN_FILT_MEDIAN:
+	if (param < 3 || param > GN_FILT_MEDIAN_MAX || !(param & 1))
+	    return false;
+	break;
+    case GN_FILT_RATE:
+	if (param < 1)
+	    return false;
+	break;
+    default:
+	return false;
+    }
+
+    if (d->filt == NULL) {
+	d->filt = (gn_filter_t *)calloc(1, sizeof(gn_filter_t));
+	if (d->filt == NULL)
+	    return false;
+	d->filt->datatype = (in_datatype < 0) ? d->datatype : in_datatype;
+    }
+    if (d->filt->nstages == GN_FILT_STAGES) {
+	Serial.println("Filter chain full, increase GN_FILT_STAGES");
+	return false;
+    }
+    st = &d->filt->st[d->filt->nstages++];
+    memset(st, 0, sizeof(*st));
+    st->type = type;
+    st->param = param;
+    return true;
+}
+
+/*!
+ * @brief Remove all of dev's filters
+ */
+
+void gnhast::clear_dev_filters(int dev)
+{
+    free(_devices[dev].filt);
+    _devices[dev].filt = NULL;
+}
+
+/*
+ * Median of the samples held, by insertion sort of a copy, n is tiny
+ */
+
+static int64_t gn_filt_median(gn_filtstage_t *st)
+{
+    int64_t v[GN_FILT_MEDIAN_MAX], t;
+    int i, j;
+
+    for (i=0; i < st->n; i++) {
+	t = st->hist[i];
+	for (j=i; j > 0 && v[j-1] > t; j--)
+	    v[j] = v[j-1];
+	v[j] = t;
+    }
+    return v[st->n / 2];
+}
+
+/*
+ * Run a stored value through dev's chain.  Returns false if there is
+ * nothing to store yet.
+ */
+
+bool gnhast::_filt_run(int dev, gn_data_t *data)
+{
+    gn_filter_t *f = _devices[dev].filt;
+    gn_filtstage_t *st;
+    uint32_t now = millis(), dt;
+    int64_t v = gn_fix_from(f->datatype, *data), prev;
+    int i;
+
+    for (i=0; i < f->nstages; i++) {
+	st = &f->st[i];
+	switch (st->type) {
+	case GN_FILT_EMA:
+	    if (st->n == 0) {
+		st->state = v;
+		st->n = 1;
+	    } else
+		st->state += (v - st->state) >> st->param;
+	    v = st->state;
+	    break;
+	case GN_FILT_MEDIAN:
+	    st->hist[st->pos] = v;
+	    st->pos = (st->pos + 1) % st->param;
+	    if (st->n < st->param)
+		st->n++;
+	    v = gn_filt_median(st);
+	    break;
+	case GN_FILT_RATE:
+	    prev = st->state;
+	    dt = now - st->ms;
+	    st->state = v;
+	    st->ms = now;
+	    if (st->n == 0) {
+		st->n = 1;
+		return false;
+	    }
+	    /* a counter that went backwards was reset, start over */
+	    if (dt == 0 || v < prev)
+		return false;
+	    v = (v - prev) * st->param / dt;
+	    break;
+	}
+    }
+    gn_fix_to(_devices[dev].datatype, v, data);
+    return true;
+}
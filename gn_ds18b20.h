@@ -0,0 +1,258 @@
+/*!
+ * @file gn_ds18b20.h
+ * A gnhast collector for a string of DS18B20 (and DS1822) sensors
+ *
+ * Finds every sensor on a 1-Wire bus, builds and registers a device for
+ * each (named from gnhast.json if it has a name there), and hands the bus
+ * to the gnhast sensor scheduler.  A reading is one conversion for the
+ * whole bus (skip ROM), a wait that depends on the resolution, which the
+ * scheduler does not block on, and then one pass that reads every
+ * sensor's scratchpad.  So a string of N sensors costs one conversion
+ * time per reading, not N.
+ *
+ * Only needs OneWire.  This file is not included by gnhast_async.h, so
+ * sketches that do not use it do not need OneWire either:
+ *
+ *	#include <gnhast_async.h>
+ *	#include <gn_ds18b20.h>
+ *
+ *	OneWire ow(14);
+ *	gn_ds18b20 ds(&gnhast, &ow);
+ *	...
+ *	ds.begin(12, 0.2);
+ *	ds.schedule(60 * 1000);
+ */
+
+#ifndef __gn_ds18b20_h__
+#define __gn_ds18b20_h__
+
+#include "gnhast_async.h"
+#include <OneWire.h>
+
+#ifndef GN_DS_MAX
+#define GN_DS_MAX gn_MAX_DEVICES
+#endif
+
+/* DS18B20 commands */
+#define GN_DS_CONVERT 0x44
+#define GN_DS_READ_SCRATCH 0xBE
+#define GN_DS_WRITE_SCRATCH 0x4E
+#define GN_DS_READ_POWER 0xB4
+
+/* family codes we know the scratchpad of */
+#define GN_DS_FAMILY_18B20 0x28
+#define GN_DS_FAMILY_1822 0x22
+
+typedef struct _gn_ds_sensor {
+    uint8_t addr[8];
+    int dev; /* gnhast device index */
+} gn_ds_sensor_t;
+
+class gn_ds18b20 {
+ public:
+    gn_ds18b20(gnhast *gn, OneWire *ow);
+    int begin(int resolution = 12, double deadband = 0, int scale = TSCALE_F,
+	      uint32_t heartbeat = 0, int proto = PROTO_SENSOR_INDOOR);
+    int schedule(uint32_t period);
+    int count() { return _count; }
+    uint32_t conversion_ms();
+
+ private:
+    gnhast *_gn;
+    OneWire *_ow;
+    gn_ds_sensor_t _s[GN_DS_MAX];
+    int _count;
+    int _res; /* bits, 9 to 12 */
+    int _scale; /* TSCALE_F or TSCALE_C */
+    bool _parasite; /* something on the bus is parasite powered */
+
+    static void _uid(char *buf, const uint8_t *addr);
+    bool _read_one(gn_ds_sensor_t *s);
+    static uint32_t _start_cb(void *arg);
+    static bool _read_cb(void *arg);
+};
+
+/*!
+ * @brief A DS18B20 collector on the 1-Wire bus ow, reporting to gn
+ */
+
+inline gn_ds18b20::gn_ds18b20(gnhast *gn, OneWire *ow)
+{
+    _gn = gn;
+    _ow = ow;
+    _count = 0;
+    _res = 12;
+    _scale = TSCALE_F;
+    _parasite = false;
+}
+
+/*
+ * The uid of a sensor: its ROM code in hex, the same as the ds18b20
+ * example always made, formatted into buf (17 bytes)
+ */
+
+inline void gn_ds18b20::_uid(char *buf, const uint8_t *addr)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    int i;
+
+    for (i=0; i < 8; i++) {
+	*buf++ = hex[addr[i] >> 4];
+	*buf++ = hex[addr[i] & 0xf];
+    }
+    *buf = '\0';
+}
+
+/*!
+ * @brief Find the sensors, and build and register a device for each.
+ * resolution is in bits (9 to 12), deadband in degrees, heartbeat the
+ * max_interval in ms.  Returns how many sensors were found.
+ */
+
+inline int gn_ds18b20::begin(int resolution, double deadband, int scale,
+			     uint32_t heartbeat, int proto)
+{
+    gn_ds_sensor_t *s;
+    const char *cname;
+    char uid[17], name[40];
+    uint8_t addr[8];
+    int dev;
+
+    _res = (resolution < 9) ? 9 : (resolution > 12) ? 12 : resolution;
+    _scale = scale;
+
+    _ow->reset_search();
+    while (_count < GN_DS_MAX && _ow->search(addr)) {
+	if (OneWire::crc8(addr, 7) != addr[7] ||
+	    (addr[0] != GN_DS_FAMILY_18B20 && addr[0] != GN_DS_FAMILY_1822))
+	    continue;
+	s = &_s[_count];
+	memcpy(s->addr, addr, sizeof(s->addr));
+	_uid(uid, addr);
+	cname = _gn->config_dev_name(uid);
+	if (cname)
+	    snprintf(name, sizeof(name), "%s", cname);
+	else
+	    snprintf(name, sizeof(name), "ESP DS18B20 dev #%d", _count);
+	dev = _gn->generic_build_device(uid, name, proto, DEVICE_SENSOR,
+					SUBTYPE_TEMP, DATATYPE_DOUBLE, _scale,
+					s->addr, deadband, GN_DEADBAND_ABS,
+					0, heartbeat);
+	if (dev < 0)
+	    break;
+	/* good to 1/16 of a degree, 2 decimals is plenty */
+	_gn->set_dev_precision(dev, 2);
+	_gn->gn_register_device(dev);
+	s->dev = dev;
+	_count++;
+    }
+    Serial.printf("Found %d DS18B20 sensors\n", _count);
+    if (_count == 0)
+	return 0;
+
+    /* does anything need the bus held high while it converts? */
+    _ow->reset();
+    _ow->skip();
+    _ow->write(GN_DS_READ_POWER);
+    _parasite = (_ow->read_bit() == 0);
+
+    /* set the resolution on all of them at once, alarms unused */
+    _ow->reset();
+    _ow->skip();
+    _ow->write(GN_DS_WRITE_SCRATCH);
+    _ow->write(0x4B);
+    _ow->write(0x46);
+    _ow->write(((_res - 9) << 5) | 0x1F);
+    _ow->reset();
+
+    /* only written if a sensor is new, or the names changed */
+    _gn->save_gnhast_config();
+    return _count;
+}
+
+/*!
+ * @brief How long a conversion takes at our resolution, ms
+ */
+
+inline uint32_t gn_ds18b20::conversion_ms()
+{
+    static const uint16_t ms[] = { 94, 188, 375, 750 };
+
+    return ms[_res - 9];
+}
+
+/*!
+ * @brief Read the whole bus every period ms, from gnhast.handle().
+ * Returns the scheduler's sensor index, for gnhast.sensor_fails().
+ */
+
+inline int gn_ds18b20::schedule(uint32_t period)
+{
+    if (_count == 0)
+	return -1;
+    return _gn->add_sensor(_start_cb, _read_cb, this, period);
+}
+
+/*
+ * Read one sensor's scratchpad, and store it
+ */
+
+inline bool gn_ds18b20::_read_one(gn_ds_sensor_t *s)
+{
+    uint8_t sp[9];
+    int16_t raw;
+    gn_data_t data;
+    int i;
+
+    if (!_ow->reset())
+	return false;
+    _ow->select(s->addr);
+    _ow->write(GN_DS_READ_SCRATCH);
+    for (i=0; i < 9; i++)
+	sp[i] = _ow->read();
+    /* a missing sensor reads all ones, and all zeros passes the crc */
+    if (OneWire::crc8(sp, 8) != sp[8] || (sp[4] & 0x1F) != 0x1F)
+	return false;
+
+    raw = (int16_t)((sp[1] << 8) | sp[0]);
+    /* the low bits are undefined below 12 bit resolution */
+    raw &= ~((1 << (12 - _res)) - 1);
+    data.d = raw / 16.0;
+    if (_scale == TSCALE_F)
+	data.d = data.d * 1.8 + 32.0;
+    _gn->store_data_dev(s->dev, data);
+    return true;
+}
+
+/*
+ * Scheduler steps: convert the whole bus, then read it all
+ */
+
+inline uint32_t gn_ds18b20::_start_cb(void *arg)
+{
+    gn_ds18b20 *ds = (gn_ds18b20 *)arg;
+
+    ds->_ow->reset();
+    ds->_ow->skip();
+    /* parasite powered sensors need the line held up while converting */
+    ds->_ow->write(GN_DS_CONVERT, ds->_parasite ? 1 : 0);
+    return ds->conversion_ms();
+}
+
+inline bool gn_ds18b20::_read_cb(void *arg)
+{
+    gn_ds18b20 *ds = (gn_ds18b20 *)arg;
+    int i, good = 0;
+
+    if (ds->_parasite)
+	ds->_ow->depower();
+    for (i=0; i < ds->_count; i++) {
+	if (ds->_read_one(&ds->_s[i]))
+	    good++;
+	else if (ds->_gn->is_debug())
+	    Serial.printf("DS18B20 #%d did not answer\n", i);
+    }
+    return good > 0;
+}
+
+#endif /*__gn_ds18b20_h__*/
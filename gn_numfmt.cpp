@@ -0,0 +1,196 @@
+/*
+ * Integer and fixed point number formatting.
+ *
+ * newlib's %f path is slow and eats a lot of stack on the ESP8266, and
+ * there is no cheap way to print a uint64_t with it.  These write digits
+ * two at a time from a lookup table, and do the fixed point conversion
+ * with a single scale and round of the fractional part, settling near-ties
+ * exactly, so the output matches "%.*f".  All of them NUL terminate, and
+ * return the length written, buf must be at least GN_FMT_BUFSIZE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "gn_numfmt.h"
+
+static const char gn_digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint32_t gn_pow10[GN_FMT_MAXPREC + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+    1000000000,
+};
+
+/*
+ * Write exactly width digits of val (zero padded), or as many as needed
+ * if width is 0.  Returns the number of digits.
+ */
+
+static int gn_fmt_digits(char *buf, uint32_t val, int width)
+{
+    char tmp[10];
+    int i = sizeof(tmp);
+    int len;
+
+    while (val >= 100) {
+	i -= 2;
+	memcpy(&tmp[i], &gn_digit_pairs[(val % 100) * 2], 2);
+	val /= 100;
+    }
+    if (val >= 10) {
+	i -= 2;
+	memcpy(&tmp[i], &gn_digit_pairs[val * 2], 2);
+    } else
+	tmp[--i] = '0' + val;
+
+    while ((int)sizeof(tmp) - i < width)
+	tmp[--i] = '0';
+
+    len = sizeof(tmp) - i;
+    memcpy(buf, &tmp[i], len);
+    return len;
+}
+
+/*!
+ * @brief Format an unsigned 32 bit integer
+ */
+
+int gn_fmt_u32(char *buf, uint32_t val)
+{
+    int len = gn_fmt_digits(buf, val, 0);
+
+    buf[len] = '\0';
+    return len;
+}
+
+/*!
+ * @brief Format an unsigned 64 bit integer
+ * Stays in 32 bit math unless the value actually needs more.
+ */
+
+int gn_fmt_u64(char *buf, uint64_t val)
+{
+    int len = 0;
+
+    if (val >> 32 == 0)
+	return gn_fmt_u32(buf, (uint32_t)val);
+
+    /* at most 20 digits, split in chunks of 9 */
+    if (val >= 1000000000000000000ULL) {
+	len = gn_fmt_digits(buf, (uint32_t)(val / 1000000000000000000ULL), 0);
+	val %= 1000000000000000000ULL;
+	len += gn_fmt_digits(buf + len, (uint32_t)(val / 1000000000), 9);
+    } else
+	len = gn_fmt_digits(buf, (uint32_t)(val / 1000000000), 0);
+    len += gn_fmt_digits(buf + len, (uint32_t)(val % 1000000000), 9);
+    buf[len] = '\0';
+    return len;
+}
+
+/*
+ * frac * scale lands within rounding error of a .5, work out exactly which
+ * side of it the true product is on (Dekker's error free product, no fma on
+ * the ESP8266).  Returns <0, 0 or >0 like a compare against k + 0.5.
+ */
+
+static int gn_fmt_tie(double frac, uint32_t scale, uint32_t k)
+{
+    const double split = 134217729.0; /* 2^27 + 1 */
+    double b = scale;
+    double p, t, ah, al, bh, bl, e, r;
+
+    p = frac * b;
+    t = split * frac;
+    ah = t - (t - frac);
+    al = frac - ah;
+    t = split * b;
+    bh = t - (t - b);
+    bl = b - bh;
+    e = ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+
+    /* p is close to k + 0.5, so this subtraction is exact */
+    r = (p - ((double)k + 0.5)) + e;
+    return (r > 0) - (r < 0);
+}
+
+/*!
+ * @brief Format a double with prec digits after the decimal point
+ * Rounds the way "%.*f" does, halfway cases go to even.  Values too big
+ * for 64 bits come out as "%.*e".
+ */
+
+int gn_fmt_fixed(char *buf, double val, int prec)
+{
+    uint64_t ip;
+    uint32_t scale, k;
+    double frac, x, d;
+    int len = 0, tie, n;
+
+    if (prec < 0)
+	prec = 0;
+    if (prec > GN_FMT_MAXPREC)
+	prec = GN_FMT_MAXPREC;
+
+    if (val != val) {
+	memcpy(buf, "nan", 4);
+	return 3;
+    }
+    if (val < 0) {
+	buf[len++] = '-';
+	val = -val;
+    }
+
+    /*
+     * Too big (or inf) to do in 64 bits.  %f of up to 1e308 does not fit
+     * the buffer, and there is no precision in those digits anyway, so
+     * let libc write it as %e.  snprintf returns what it would have
+     * written, count only what it did.
+     */
+    if (val >= 18446744073709551616.0) {
+	n = snprintf(buf + len, GN_FMT_BUFSIZE - len, "%.*e", prec, val);
+	if (n < 0)
+	    n = 0;
+	if (n > GN_FMT_BUFSIZE - 1 - len)
+	    n = GN_FMT_BUFSIZE - 1 - len;
+	return len + n;
+    }
+
+    scale = gn_pow10[prec];
+    ip = (uint64_t)val;
+    frac = val - (double)ip; /* exact */
+    x = frac * scale;
+    k = (uint32_t)x;
+    d = x - k;
+
+    if (d > 0.5 + 1e-6)
+	k++;
+    else if (d >= 0.5 - 1e-6) {
+	tie = gn_fmt_tie(frac, scale, k);
+	if (tie > 0 || (tie == 0 && (prec ? k : (uint32_t)ip) & 1))
+	    k++;
+    }
+    if (k >= scale) {
+	k -= scale;
+	ip++;
+    }
+
+    if (ip >> 32 == 0)
+	len += gn_fmt_digits(buf + len, (uint32_t)ip, 0);
+    else
+	len += gn_fmt_u64(buf + len, ip);
+    if (prec) {
+	buf[len++] = '.';
+	len += gn_fmt_digits(buf + len, k, prec);
+    }
+    buf[len] = '\0';
+    return len;
+}
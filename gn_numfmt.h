@@ -0,0 +1,26 @@
+/*!
+ * @file gn_numfmt.h
+ * Fast integer and fixed point formatting, used in place of printf
+ *
+ * This file has no Arduino dependencies, so it can be built and
+ * benchmarked on a normal host as well.
+ */
+
+#ifndef __gn_numfmt_h__
+#define __gn_numfmt_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* big enough for any value any of these can produce, plus the NUL.
+   gn_fmt_fixed() writes values of 2^64 and up as %e, so they fit too. */
+#define GN_FMT_BUFSIZE 32
+
+/* most digits after the decimal point gn_fmt_fixed will do */
+#define GN_FMT_MAXPREC 9
+
+int gn_fmt_u32(char *buf, uint32_t val);
+int gn_fmt_u64(char *buf, uint64_t val);
+int gn_fmt_fixed(char *buf, double val, int prec);
+
+#endif /*__gn_numfmt_h__*/
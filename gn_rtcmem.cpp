@@ -0,0 +1,22 @@
+/*
+ * RTC user memory on the ESP8266, which counts in 4 byte blocks
+ */
+
+#include <Arduino.h>
+#include "gn_rtcmem.h"
+
+gn_rtcmem_esp gn_rtcmem_default;
+
+bool gn_rtcmem_esp::read(uint32_t off, void *buf, size_t len)
+{
+    if ((off | len) & 3 || off + len > GN_RTCMEM_SIZE)
+	return false;
+    return ESP.rtcUserMemoryRead(off / 4, (uint32_t *)buf, len);
+}
+
+bool gn_rtcmem_esp::write(uint32_t off, const void *buf, size_t len)
+{
+    if ((off | len) & 3 || off + len > GN_RTCMEM_SIZE)
+	return false;
+    return ESP.rtcUserMemoryWrite(off / 4, (uint32_t *)buf, len);
+}
@@ -0,0 +1,61 @@
+/*!
+ * @file gn_rtcmem.h
+ * RTC user memory, behind a small interface
+ *
+ * The ESP8266 keeps 512 bytes of RTC user memory across resets and deep
+ * sleep.  The library only touches it through gn_rtcmem, so it can be
+ * swapped for gn_rtcmem_ram when running the state logic on a host.
+ * Offsets and lengths are in bytes, and must be multiples of 4.  The
+ * first GN_RTCMEM_RESERVED bytes belong to the ESP8266 core (eboot reads
+ * its OTA command from there), so the library only uses the 384 after it.
+ *
+ * This file has no Arduino dependencies.
+ */
+
+#ifndef __gn_rtcmem_h__
+#define __gn_rtcmem_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define GN_RTCMEM_SIZE 512
+/* the core keeps the OTA eboot command in the first 128 bytes, hands off */
+#define GN_RTCMEM_RESERVED 128
+
+class gn_rtcmem {
+ public:
+    virtual bool read(uint32_t off, void *buf, size_t len) = 0;
+    virtual bool write(uint32_t off, const void *buf, size_t len) = 0;
+};
+
+/* The real thing, gn_rtcmem.cpp */
+class gn_rtcmem_esp : public gn_rtcmem {
+ public:
+    bool read(uint32_t off, void *buf, size_t len);
+    bool write(uint32_t off, const void *buf, size_t len);
+};
+
+/* A fake, plain RAM that outlives nothing, for host tests */
+class gn_rtcmem_ram : public gn_rtcmem {
+ public:
+    uint8_t mem[GN_RTCMEM_SIZE];
+
+    gn_rtcmem_ram() { memset(mem, 0, sizeof(mem)); }
+    bool read(uint32_t off, void *buf, size_t len) {
+	if (off + len > sizeof(mem))
+	    return false;
+	memcpy(buf, &mem[off], len);
+	return true;
+    }
+    bool write(uint32_t off, const void *buf, size_t len) {
+	if (off + len > sizeof(mem))
+	    return false;
+	memcpy(&mem[off], buf, len);
+	return true;
+    }
+};
+
+extern gn_rtcmem_esp gn_rtcmem_default;
+
+#endif /*__gn_rtcmem_h__*/
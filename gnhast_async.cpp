@@ -31,6 +31,7 @@ gnhast::gnhast(char *coll_name, int instance) {
 
     _collector_is_healthy = 1;
     _server = "gnhastd";
+    _server_mem = NULL;
     _port = 2920;
     _collector_name = coll_name;
     _keep_connection = 0;
@@ -41,6 +42,7 @@ gnhast::gnhast(char *coll_name, int instance) {
     /* zero fill the device table */
     for (i=0; i < gn_MAX_DEVICES; i++) {
 	_devices[i].uid = NULL;
+	_devices[i].uidlen = 0;
 	_devices[i].name = NULL;
 	_devices[i].type = 0;
 	_devices[i].subtype = 0;
@@ -48,11 +50,97 @@ gnhast::gnhast(char *coll_name, int instance) {
 	_devices[i].scale = 0;
 	_devices[i].arg = NULL;
 	_devices[i].datatype = 0;
+	_devices[i].precision = GN_DEFAULT_PRECISION;
+	_devices[i].stored = 0;
+	_devices[i].changed = 0;
+	_devices[i].flags = 0;
+	_devices[i].deadband = 0;
+	_devices[i].deadband_type = GN_DEADBAND_ABS;
+	_devices[i].min_interval = 0;
+	_devices[i].max_interval = 0;
+	_devices[i].sent_ms = 0;
+	_devices[i].sent.u64 = 0;
+	_devices[i].chg_cb = NULL;
+	_devices[i].filt = NULL;
 	_devices[i].data.u = 0;
     }
-    AsyncClient *client = NULL;
-    AsyncPrinter *ap = NULL;
-    DNSServer dns;
+    client = NULL;
+    _conn_state = GN_CONN_IDLE;
+    _conn_backoff = GN_BACKOFF_MIN;
+    _conn_next = 0;
+    _conn_started = 0;
+    _last_ping = 0;
+    _conn_replay = 0;
+    _conn_fast = false;
+    _rtc = &gn_rtcmem_default;
+    for (i=0; i < GN_MAX_AGG; i++)
+	_agg[i].dev = -1;
+    _spsc_head = _spsc_tail = 0;
+    _spsc_dropped = _spsc_hiwat = 0;
+    memset(_sensors, 0, sizeof(_sensors));
+    _nsensors = 0;
+    memset(_srv, 0, sizeof(_srv));
+    _srv_count = 0;
+    _srv_cur = 0;
+    _srv_probe_at = _srv_probe_last = 0;
+    _srv_forgive_last = 0;
+    _srv_failback = false;
+    _disc_on = false;
+    _disc_want = false;
+    _disc_mdns = false;
+    _disc_at = 0;
+    _disc_host[0] = '\0';
+    _sleep_mode = false;
+    _sleep_every = 1;
+    _sleep_urgent = false;
+    memset(&_ss, 0, sizeof(_ss));
+    memset(&_fc, 0, sizeof(_fc));
+    _fc_loaded = false;
+    _wifi_fast = false;
+    _pq_head = 0;
+    _pq_len = 0;
+    _pq_dev = 0;
+    _pq_next = 0;
+    _pq_dropped = 0;
+    _pq_replayed = 0;
+    _jnl_ready = false;
+    _jnl_size = 0;
+    _jnl_rd = 0;
+    _jb_len = 0;
+    _jb_rd = 0;
+    _jnl_spilled = 0;
+    _jnl_bad = 0;
+    _fs_mounted = false;
+    _cfg_loaded = false;
+    _cfg_dirty = 0;
+    _cfg_due = 0;
+    _cfg_nnames = 0;
+    _cfg_blob_crc = 0;
+    memset(_boot, 0, sizeof(_boot));
+    memset(_boot_reg, 0, sizeof(_boot_reg));
+    _wifi_state = GN_WIFI_NONE;
+    _wifi_started = 0;
+    _wifi_fails = 0;
+    _wifi_portal_after = GN_WIFI_PORTAL_AFTER;
+    _wifi_param_server = NULL;
+    _wifi_param_port = NULL;
+    server = NULL;
+    _tx_wr = 0;
+    _tx_snd = 0;
+    _tx_inflight = 0;
+    _tx_closing = false;
+    _tx_hold = false;
+    _tx_midline = false;
+    _tx_prio_len = 0;
+    _rx_len = 0;
+    _rx_discard = false;
+    memset(&_txstats, 0, sizeof(_txstats));
+    /* SUBTYPE_BOOL only marks the end, it has no name */
+    for (i=0; i < NROF_SUBTYPES; i++)
+	_dev_arglen[i] = _dev_argtable[i] ? strlen(_dev_argtable[i]) : 0;
+    memset(&_perf, 0, sizeof(_perf));
+    _perf.heap_min = 0xffffffff;
+    _mk_wr = _mk_snd = _mk_ack = 0;
     strncpy(_gnhast_server, GNHAST_SERVER_HOST, 80);
     strncpy(_gnhast_port_str, "2920", 8);
     shouldSaveConfig = true;
@@ -93,8 +181,12 @@ int gnhast::is_debug()
 
 void gnhast::set_server(char *server, int port)
 {
-    _server = strdup(server);
+    char *old = _server_mem;
+
+    _server = _server_mem = strdup(server);
     _port = port;
+    _srv_primary();
+    free(old);
 }
 
 /*
@@ -103,38 +195,14 @@ void gnhast::set_server(char *server, int port)
 
 void gnhast::init_server()
 {
-    _server = strdup(_gnhast_server);
-}
-
-/*
- * Just tell gnhast about our collector name
- */
-
-void gnhast::__gn_client()
-{
-    ap->printf("client client:%s-%0.3d\n", _collector_name, _instance);
-}
-
-/*
- * Barebones (for now) reply handler.  Ignores everything other than ping
- */
-
-void gnhast::__gn_gotdata(void *arg, AsyncPrinter *pri, uint8_t *data,
-			  size_t len)
-{
-    if (_debug) {
-    	Serial.printf("Got data len=%d\n", (int)len);
-    	Serial.write((uint8_t *)data, len);
-    }
-
-    if (len >= 4) {
-    	if (strncmp("ping", (char *)data, 4) == 0) {
-	    if (_debug)
-		Serial.printf("Got ping\n");
-    	    if (_collector_is_healthy)
-    		imalive();
-    	}
-    }
+    char *old = _server_mem;
+
+    _server = _server_mem = strdup(_gnhast_server);
+    if (_disc_on)
+	_disc_init();
+    /* entry 0 may still point at the old copy until this */
+    _srv_primary();
+    free(old);
 }
 
 /*!
@@ -145,66 +213,8 @@ void gnhast::imalive()
 {
     if (_debug)
 	Serial.println("Telling gnhast we are alive");
-    if (ap->connected())
-	ap->printf("imalive\n");
-}
-
-/*!
- * @brief Connect to gnhastd, initiate collector
- */
-
-bool gnhast::connect()
-{
-    int i;
-    Serial.printf("Connecting to: %s:%d\n", _server, _port);
-
-    if (!client) {
-	if (_debug)
-	    Serial.println("Allocating new client.");
-	client = new AsyncClient();
-    }
-    if (!client) {
-	Serial.println("Could not allocate client!");
-	return false;
-    }
-
-    /* setup the AsyncPrinter lib */
-    if (!ap) {
-	if (_debug)
-	    Serial.println("Allocating new AsyncPrinter");
-	ap = new AsyncPrinter(client);
-	
-	ap->onData(std::bind(&gnhast::__gn_gotdata, this,
-			     std::placeholders::_1,
-			     std::placeholders::_2,
-			     std::placeholders::_3,
-			     std::placeholders::_4), client);
-    }
-
-    if (!ap->connected()) {
-	if (!ap->connect(_server, _port)) {
-	    Serial.println("Connection to gnhastd failed!");
-	    return false;
-	}
-    }
-    __gn_client();
-    ap->printf("getapiv\n");
-    
-    return true;
-}
-
-/*!
- * @brief Disconnect from gnhast nicely
- */
-
-void gnhast::disconnect()
-{
-    if (_debug)
-	Serial.println("Requesting disconnect from gnhastd");
-    if (ap->connected()) {
-	ap->printf("disconnect\n");
-	ap->close();
-    }
+    if (_conn_state == GN_CONN_UP)
+	_tx_line("imalive");
 }
 
 /*!
@@ -212,19 +222,28 @@ void gnhast::disconnect()
  * Unlike normal gnhast, we just have an integer array of devices, to keep
  * it simple and small.  Also, the device definitions are greatly reduced, for
  * simplicity.
+ *
+ * The optional reporting policy lets gn_update_device() skip sends that
+ * would not tell gnhastd anything new: a change smaller than deadband
+ * (absolute, or percent of the last value sent) is ignored, no more than
+ * one upd per min_interval ms is sent, and if max_interval ms pass without
+ * one, the value is sent anyway as a heartbeat.  All zero (the default)
+ * sends every update, as before.
  */
 
 int gnhast::generic_build_device(char *uid, char *name,
 				 int proto, int type, int subtype,
-				 int datatype, int scale, void *arg)
+				 int datatype, int scale, void *arg,
+				 double deadband, int deadband_type,
+				 uint32_t min_interval, uint32_t max_interval)
 {
     int i;
 
+    i = _nrofdevs;
     if (_debug) {
 	Serial.print("Creating device #");
 	Serial.println(i);
     }
-    i = _nrofdevs;
     if (i == gn_MAX_DEVICES) {
 	Serial.println("Too many devices in generic_build_device, increase gn_MAX_DEVICES and rebuild");
 	return -1;
@@ -235,6 +254,7 @@ int gnhast::generic_build_device(char *uid, char *name,
     }
     
     _devices[i].uid = strdup(uid);
+    _devices[i].uidlen = strlen(uid);
     _devices[i].name = strdup(name);
     _devices[i].type = type;
     _devices[i].proto = proto;
@@ -242,6 +262,10 @@ int gnhast::generic_build_device(char *uid, char *name,
     _devices[i].datatype = datatype;
     _devices[i].scale = scale;
     _devices[i].arg = arg;
+    _devices[i].deadband = deadband;
+    _devices[i].deadband_type = deadband_type;
+    _devices[i].min_interval = min_interval;
+    _devices[i].max_interval = max_interval;
 
     _nrofdevs++;
     return i;
@@ -253,12 +277,18 @@ int gnhast::generic_build_device(char *uid, char *name,
 
 int gnhast::find_dev_byuid(char *uid)
 {
+#if GN_PERF
+    uint32_t start = micros();
+#endif
     int i;
 
     for (i=0; i < _nrofdevs; i++)
 	if (strcmp(_devices[i].uid, uid) == 0)
-	    return i;
-    return -1;
+	    break;
+#if GN_PERF
+    _perf_sample(&_perf.find_us, micros() - start);
+#endif
+    return (i < _nrofdevs) ? i : -1;
 }
 
 /*!
@@ -273,12 +303,121 @@ gn_dev_t *gnhast::get_dev_byindex(int idx)
     return(&_devices[idx]);
 }
 
+/*
+ * Compare two values of the given datatype
+ */
+
+static bool gn_data_differs(int datatype, gn_data_t a, gn_data_t b)
+{
+    switch (datatype) {
+    case DATATYPE_UINT:
+	return a.u != b.u;
+    case DATATYPE_DOUBLE:
+	return a.d != b.d;
+    case DATATYPE_LL:
+	return a.u64 != b.u64;
+    }
+    return true;
+}
+
+/*
+ * Would an upd for this device right now tell gnhastd anything new?
+ */
+
+bool gnhast::_gn_should_report(int dev, uint32_t now)
+{
+    gn_dev_t *d = &_devices[dev];
+    uint32_t since = now - d->sent_ms;
+
+    if (!(d->flags & GN_DEV_SENT))
+	return true;
+    if (d->deadband == 0 && d->min_interval == 0 && d->max_interval == 0)
+	return true;
+    if (d->max_interval && since >= d->max_interval)
+	return true;
+    if (d->min_interval && since < d->min_interval)
+	return false;
+    return _gn_past_deadband(dev, d->sent);
+}
+
+/*
+ * Has the value moved far enough from last to be worth sending?
+ */
+
+bool gnhast::_gn_past_deadband(int dev, gn_data_t sent)
+{
+    gn_dev_t *d = &_devices[dev];
+    double cur, last, delta;
+
+    switch (d->datatype) {
+    case DATATYPE_UINT:
+	cur = d->data.u;
+	last = sent.u;
+	break;
+    case DATATYPE_LL:
+	cur = d->data.u64;
+	last = sent.u64;
+	break;
+    default:
+	cur = d->data.d;
+	last = sent.d;
+	break;
+    }
+    delta = fabs(cur - last);
+    if (delta == 0)
+	return false;
+    if (d->deadband_type == GN_DEADBAND_PCT)
+	return delta * 100.0 >= d->deadband * fabs(last);
+    return delta >= d->deadband;
+}
+
+/*
+ * Does flush_dirty() need to send this device?  Either it changed, or its
+ * heartbeat is due, and the policy agrees.
+ */
+
+bool gnhast::_gn_flush_due(int dev, uint32_t now)
+{
+    gn_dev_t *d = &_devices[dev];
+
+    if (!(d->flags & GN_DEV_DIRTY) &&
+	!(d->max_interval && (d->flags & GN_DEV_SENT) &&
+	  now - d->sent_ms >= d->max_interval))
+	return false;
+    return _gn_should_report(dev, now);
+}
+
 /*!
  * @brief store a datapoint in a device for later upd
+ * If the value changed (or was never sent), the device is marked dirty,
+ * see flush_dirty().
  */
 
 void gnhast::store_data_dev(int dev, gn_data_t data)
 {
+    /* a filter may hold the value back, a rate's first sample, say */
+    if (_devices[dev].filt && !_filt_run(dev, &data))
+	return;
+    /* only the end of the window gets stored */
+    if (_devices[dev].flags & GN_DEV_AGG) {
+	_agg_add(dev, data);
+	return;
+    }
+    _gn_store(dev, data);
+}
+
+/*
+ * Put a value in a device
+ */
+
+void gnhast::_gn_store(int dev, gn_data_t data)
+{
+    _devices[dev].stored = micros();
+    if (!(_devices[dev].flags & GN_DEV_SENT) ||
+	gn_data_differs(_devices[dev].datatype, _devices[dev].data, data)) {
+	_devices[dev].flags |= GN_DEV_DIRTY;
+	_devices[dev].changed = millis();
+    }
     switch (_devices[dev].datatype) {
     case DATATYPE_UINT:
 	_devices[dev].data.u = data.u;
@@ -291,14 +430,37 @@ void gnhast::store_data_dev(int dev, gn_data_t data)
     }
 }
 
+/*!
+ * @brief set how many decimals to send for a DATATYPE_DOUBLE device
+ * Defaults to 6, like %f.  Fewer digits means shorter lines on the wire.
+ */
+
+void gnhast::set_dev_precision(int dev, int prec)
+{
+    if (prec < 0)
+	prec = 0;
+    if (prec > GN_FMT_MAXPREC)
+	prec = GN_FMT_MAXPREC;
+    _devices[dev].precision = prec;
+}
+
+/*!
+ * @brief let gnhastd change this device.  cb is called when a chg for the
+ * device arrives, and the confirming upd is sent right away, ahead of any
+ * queued updates.
+ */
+
+void gnhast::set_chg_callback(int dev, gn_chg_cb_t cb)
+{
+    _devices[dev].chg_cb = cb;
+}
+
 /*
  * Shortcut to modify a device name
  */
 
 void gnhast::gn_mod_name(int dev)
 {
-    char mod[256];
-
     /* Sanity verification */
     if (NULL == _devices[dev].name || NULL == _devices[dev].uid ||
 	_devices[dev].type == 0 || _devices[dev].proto == 0 ||
@@ -309,19 +471,20 @@ void gnhast::gn_mod_name(int dev)
 	return;
     }
 
-    sprintf(mod, "mod uid:%s name:\"%s\"\n", _devices[dev].uid,
-	    _devices[dev].name);
-
     if (_debug)
-	Serial.printf("Modify device:\n%s", mod);
-    if (!ap->connected()) {
-	Serial.println("Not connected in mod_name??");
-	if (!connect()) {
-	    Serial.println("mod_name cannot connect to gnhastd!");
-	    return;
-	}
+	Serial.println("Modify device:");
+    /* if we are down, the reg sent on reconnect carries the new name */
+    if (_conn_state != GN_CONN_UP) {
+	_gn_kick();
+	return;
     }
-    ap->printf("%s", mod);
+    _ln_begin();
+    _ln_put("mod uid:", 8);
+    _ln_put(_devices[dev].uid, _devices[dev].uidlen);
+    _ln_put(" name:\"", 7);
+    _ln_puts(_devices[dev].name);
+    _ln_putc('"');
+    _ln_end();
     return;
 }
 
@@ -342,39 +505,103 @@ void gnhast::gn_register_device(int dev)
 	return;
     }
 
-    if (_debug) {
+    if (_debug)
 	Serial.println("Registering a device");
-	Serial.printf("reg uid:%s name:\"%s\" devt:%d subt:%d "
-		      "proto:%d scale:%d\n",
-		      _devices[dev].uid, _devices[dev].name,
-		      _devices[dev].type, _devices[dev].subtype,
-		      _devices[dev].proto, _devices[dev].scale);
-    }
- 
-    if (!ap->connected()) {
-	Serial.println("Not connected in reg??");
-	if (!connect()) {
-	    Serial.println("register cannot connect to gnhastd!");
-	    return;
-	}
+
+    /* remember it, so it is re-registered whenever we reconnect */
+    _devices[dev].flags |= GN_DEV_REGISTERED;
+    if (_boot_reg[dev].called == 0)
+	_boot_reg[dev].called = millis() | 1;
+    if (_conn_state != GN_CONN_UP) {
+	if (_debug)
+	    Serial.println("Not connected, reg will be sent on connect");
+	_gn_kick();
+	return;
     }
-    ap->printf("reg uid:%s name:\"%s\" devt:%d subt:%d proto:%d"
-	       " scale:%d\n",
-	       _devices[dev].uid, _devices[dev].name,
-	       _devices[dev].type, _devices[dev].subtype,
-	       _devices[dev].proto, _devices[dev].scale);
+    _gn_encode_reg(dev);
+}
+
+/*
+ * Encode a reg line for a device into the tx buffer
+ */
+
+void gnhast::_gn_encode_reg(int dev)
+{
+    _ln_begin();
+    _ln_put("reg uid:", 8);
+    _ln_put(_devices[dev].uid, _devices[dev].uidlen);
+    _ln_put(" name:\"", 7);
+    _ln_puts(_devices[dev].name);
+    _ln_put("\" devt:", 7);
+    _ln_putu(_devices[dev].type);
+    _ln_put(" subt:", 6);
+    _ln_putu(_devices[dev].subtype);
+    _ln_put(" proto:", 7);
+    _ln_putu(_devices[dev].proto);
+    _ln_put(" scale:", 7);
+    _ln_putu(_devices[dev].scale);
+    if (_ln_end())
+	_boot_reg_sent(dev);
 
     return;
 }
 
+/*
+ * Encode an upd line for a device into the tx buffer
+ */
+
+bool gnhast::_gn_encode_upd(int dev, gn_data_t data, bool prio)
+{
+    char num[GN_FMT_BUFSIZE];
+
+    _ln_begin(prio);
+    _ln_put("upd uid:", 8);
+    _ln_put(_devices[dev].uid, _devices[dev].uidlen);
+    _ln_putc(' ');
+    if (_devices[dev].datatype == DATATYPE_DOUBLE &&
+	_devices[dev].type == DEVICE_DIMMER)
+	_ln_put("dimmer", 6);
+    else
+	_ln_put(_dev_argtable[_devices[dev].subtype],
+		_dev_arglen[_devices[dev].subtype]);
+    _ln_putc(':');
+
+    switch (_devices[dev].datatype) {
+    case DATATYPE_UINT:
+	_ln_putu(data.u);
+	break;
+    case DATATYPE_DOUBLE:
+	_ln_put(num, gn_fmt_fixed(num, data.d, _devices[dev].precision));
+	break;
+    case DATATYPE_LL:
+	_ln_put(num, gn_fmt_u64(num, data.u64));
+	break;
+    }
+    if (!_ln_end())
+	return false;
+    if (_perf.updates++ == 0)
+	_boot_end(GN_BOOT_FIRST_UPD);
+    return true;
+}
+
 /*!
  * @brief update the infor for a device, specifically the data.
  */
 
 void gnhast::gn_update_device(int dev)
 {
-    char buf[1024];
+    /* aggregate.cpp sends it when the window closes */
+    if (_devices[dev].flags & GN_DEV_AGG)
+	return;
+    _gn_update(dev);
+}
+
+/*
+ * Send (or queue) an upd, if the reporting policy wants one
+ */
 
+void gnhast::_gn_update(int dev)
+{
     /* Sanity verification */
     if (NULL == _devices[dev].name || NULL == _devices[dev].uid ||
 	_devices[dev].type == 0 || _devices[dev].proto == 0 ||
@@ -385,46 +612,103 @@ void gnhast::gn_update_device(int dev)
 	return;
     }
 
+    if (!_gn_should_report(dev, millis())) {
+	if (_debug)
+	    Serial.printf("Device #%d has nothing new, skipping upd\n", dev);
+	return;
+    }
+
     if (_debug)
 	Serial.println("Doing an update");
 
-    if (!ap->connected()) {
-	Serial.println("not connected in upd");
-	if (!connect()) {
-	    Serial.println("update cannot connect to gnhastd!");
-	    return;
-	}
+    if (_conn_state != GN_CONN_UP || _pq_busy(dev)) {
+	if (_debug)
+	    Serial.println("not connected in upd, queueing it");
+	_pq_add(dev);
+	_gn_kick();
+	return;
     }
-    
-    switch (_devices[dev].datatype) {
-    case DATATYPE_UINT:
-	sprintf(buf, "upd uid:%s %s:%d\n",
-		_devices[dev].uid,
-		_dev_argtable[_devices[dev].subtype],
-		_devices[dev].data.u);
-	break;
-    case DATATYPE_DOUBLE:
-	if (_devices[dev].type == DEVICE_DIMMER) {
-	    sprintf(buf, "upd uid:%s dimmer:%f\n",
-		_devices[dev].uid,
-		_devices[dev].data.d);
-	} else {
-	    sprintf(buf, "upd uid:%s %s:%f\n",
-		    _devices[dev].uid,
-		    _dev_argtable[_devices[dev].subtype],
-		    _devices[dev].data.d);
+
+    _gn_send_upd(dev);
+    return;
+}
+
+/*
+ * Queue the upd line for a device, and account for it
+ */
+
+void gnhast::_gn_send_upd(int dev, bool prio)
+{
+#if GN_PERF
+    uint32_t start, stack, left;
+
+    /* repaint the free stack, what is left of it after is what we used */
+    ESP.resetFreeContStack();
+    stack = ESP.getFreeContStack();
+    start = micros();
+#endif
+    if (_gn_encode_upd(dev, _devices[dev].data, prio)) {
+	_devices[dev].flags &= ~(GN_DEV_DIRTY|GN_DEV_PENDING);
+	_devices[dev].flags |= GN_DEV_SENT;
+	_devices[dev].sent = _devices[dev].data;
+	_devices[dev].sent_ms = millis();
+	if (!prio)
+	    _perf_mark(dev);
+	_perf_progress();
+    }
+#if GN_PERF
+    _perf_sample(&_perf.update_us, micros() - start);
+    left = ESP.getFreeContStack();
+    _perf_sample(&_perf.update_stack, (stack > left) ? stack - left : 0);
+    left = ESP.getFreeHeap();
+    if (left < _perf.heap_min)
+	_perf.heap_min = left;
+#endif
+}
+
+/*!
+ * @brief send an upd for every device whose value changed since it was
+ * last sent, subject to each device's reporting policy, and for any device
+ * whose max_interval heartbeat is due.  The lines are queued as one batch,
+ * and go out together.  Returns the number of devices updated.
+ */
+
+int gnhast::flush_dirty()
+{
+    uint32_t now = millis();
+    int i, count = 0;
+
+    for (i=0; i < _nrofdevs; i++)
+	if (_gn_flush_due(i, now))
+	    break;
+    if (i == _nrofdevs)
+	return 0;
+
+    if (_conn_state != GN_CONN_UP) {
+	if (_debug)
+	    Serial.println("not connected in flush_dirty, queueing");
+	for (; i < _nrofdevs; i++)
+	    if (_gn_flush_due(i, now))
+		_pq_add(i);
+	_gn_kick();
+	return 0;
+    }
+
+    _tx_hold = true;
+    for (; i < _nrofdevs; i++) {
+	if (!_gn_flush_due(i, now))
+	    continue;
+	if (_pq_busy(i)) {
+	    _pq_add(i);
+	    continue;
 	}
-	break;
-    case DATATYPE_LL:
-	sprintf(buf, "upd uid:%s %s:%jd\n",
-		_devices[dev].uid,
-		_dev_argtable[_devices[dev].subtype],
-		_devices[dev].data.u64);
-	break;
+	_gn_send_upd(i);
+	count++;
     }
-    if (_debug)
-	Serial.println(buf);
+    _tx_hold = false;
+    _tx_drain();
 
-    ap->printf("%s\n", buf);
-    return;
+    if (_debug)
+	Serial.printf("flush_dirty sent %d updates\n", count);
+    return count;
 }
@@ -19,7 +19,6 @@
 /* Async code */
 #include <ESPAsyncTCP.h>
 #include <ESPAsyncWebServer.h>
-#include <AsyncPrinter.h>
 
 /* Update code */
 #include <Updater.h>
@@ -47,8 +46,135 @@
 
 /* General library defs */
 
+/* reconnect backoff, doubles from min to max (ms), plus jitter */
+#ifndef GN_BACKOFF_MIN
+#define GN_BACKOFF_MIN 1000
+#endif
+#ifndef GN_BACKOFF_MAX
+#define GN_BACKOFF_MAX 60000
+#endif
+/* give up on a connect attempt after this long (ms) */
+#ifndef GN_CONNECT_TIMEOUT
+#define GN_CONNECT_TIMEOUT 10000
+#endif
+
 #define JSON_CONFIG_FILE_SIZE 2048
 
+/* Size of the outbound line buffer, must be a power of two */
+#ifndef GN_TXBUF_SIZE
+#define GN_TXBUF_SIZE 1024
+#endif
+
+/* Longest line we accept from gnhastd when it is split across segments */
+#ifndef GN_RXLINE_SIZE
+#define GN_RXLINE_SIZE 256
+#endif
+
+/* Buffer for lines that jump the tx queue, like chg confirmations */
+#ifndef GN_TXPRIO_SIZE
+#define GN_TXPRIO_SIZE 128
+#endif
+
+/* Samples of keep-all devices held while gnhastd is unreachable */
+#ifndef GN_PENDQ_SIZE
+#define GN_PENDQ_SIZE 32
+#endif
+/* once reconnected, replay this many queued upds every interval (ms) */
+#ifndef GN_REPLAY_BATCH
+#define GN_REPLAY_BATCH 8
+#endif
+#ifndef GN_REPLAY_INTERVAL
+#define GN_REPLAY_INTERVAL 100
+#endif
+
+/* When the pending queue fills, spill to this SPIFFS journal, appended a
+   page at a time, up to GN_JNL_MAX bytes.  GN_JNL_MAX 0 turns it off. */
+#ifndef GN_JNL_FILE
+#define GN_JNL_FILE "/gnhast.jnl"
+#endif
+#ifndef GN_JNL_PAGE
+#define GN_JNL_PAGE 256
+#endif
+#ifndef GN_JNL_MAX
+#define GN_JNL_MAX 32768
+#endif
+
+/* keep the config in one binary blob, json is then only for the web UI */
+#ifndef GN_CFG_BINARY
+#define GN_CFG_BINARY 0
+#endif
+#define GN_CFG_BLOB_FILE "/gnhast.bin"
+#define GN_CFG_BLOB_MAX 2048
+
+/* with init_wifi_async(), give each wifi attempt this long (ms), and start
+   the captive portal after this many failed ones, 0 never */
+#ifndef GN_WIFI_TIMEOUT
+#define GN_WIFI_TIMEOUT 15000
+#endif
+#ifndef GN_WIFI_PORTAL_AFTER
+#define GN_WIFI_PORTAL_AFTER 4
+#endif
+
+/* fast reconnect: how long to give the cached AP and lease (ms), and how
+   many boots in a row to reuse the lease before asking DHCP again */
+#ifndef GN_WIFI_FAST_TIMEOUT
+#define GN_WIFI_FAST_TIMEOUT 3000
+#endif
+#ifndef GN_FAST_MAX_USES
+#define GN_FAST_MAX_USES 100
+#endif
+/* where in RTC user memory (bytes) the fast reconnect cache, the
+   discovery cache and the deep sleep state live, packed in that order
+   above the part the core keeps for OTA (GN_RTCMEM_RESERVED) */
+#ifndef GN_RTC_FAST_OFFSET
+#define GN_RTC_FAST_OFFSET 128
+#endif
+#ifndef GN_RTC_DISC_OFFSET
+#define GN_RTC_DISC_OFFSET 168
+#endif
+#ifndef GN_RTC_SLEEP_OFFSET
+#define GN_RTC_SLEEP_OFFSET 184
+#endif
+
+/* DNS-SD service gnhastd is announced as, _gnhast._tcp */
+#ifndef GN_MDNS_SERVICE
+#define GN_MDNS_SERVICE "gnhast"
+#endif
+#ifndef GN_MDNS_PROTO
+#define GN_MDNS_PROTO "tcp"
+#endif
+/* trust a discovered address this long (s) before a failure looks again */
+#ifndef GN_DISC_TTL
+#define GN_DISC_TTL 300
+#endif
+/* the longest (ms) an mDNS query may hold up handle() */
+#ifndef GN_DISC_QUERY_MS
+#define GN_DISC_QUERY_MS 250
+#endif
+
+/* deep sleep mode: samples held in RTC memory between sends, and how many
+   devices get deadband and registration tracking across sleeps */
+#ifndef GN_SLEEP_RING
+#define GN_SLEEP_RING 12
+#endif
+#ifndef GN_SLEEP_DEVS
+#define GN_SLEEP_DEVS 16
+#endif
+/* give up on a deep sleep send after this long (ms) */
+#ifndef GN_SLEEP_SEND_TIMEOUT
+#define GN_SLEEP_SEND_TIMEOUT 10000
+#endif
+/* send the regs again every this many deep sleep sends, in case gnhastd
+   restarted while we slept */
+#ifndef GN_SLEEP_REREG
+#define GN_SLEEP_REREG 10
+#endif
+
+/* config changes are written this long (ms) after the last one */
+#ifndef GN_CFG_WRITE_DELAY
+#define GN_CFG_WRITE_DELAY 5000
+#endif
+
 
 /*!
  * gnhast defs, like types, subtypes, proto, etc
@@ -57,6 +183,58 @@
 /* pull in the mainline gnhast.h so we get all the proto defines and whatnot */
 #define _GN_ARDUINO_
 #include "gnhast_gnhast.h"
+#include "gn_numfmt.h"
+#include "gn_rtcmem.h"
+
+/* gnhastd pings every HEALTH_CHECK_RATE seconds, miss two and it's dead */
+#define GN_PING_TIMEOUT ((2 * HEALTH_CHECK_RATE + 10) * 1000UL)
+
+/* updates post_data_dev() can hold (a power of two), and how many
+   handle() takes off it per call, see spsc_queue.cpp */
+#ifndef GN_SPSC_SIZE
+#define GN_SPSC_SIZE 32
+#endif
+#ifndef GN_SPSC_BATCH
+#define GN_SPSC_BATCH 8
+#endif
+
+/* filter stages per device, and the largest median, see filter.cpp */
+#ifndef GN_FILT_STAGES
+#define GN_FILT_STAGES 3
+#endif
+#ifndef GN_FILT_MEDIAN_MAX
+#define GN_FILT_MEDIAN_MAX 7
+#endif
+
+/* devices that can be aggregated at once, see aggregate.cpp */
+#ifndef GN_MAX_AGG
+#define GN_MAX_AGG 4
+#endif
+
+/* sensors the scheduler can run, see sensor_sched.cpp */
+#ifndef GN_MAX_SENSORS
+#define GN_MAX_SENSORS 8
+#endif
+
+/* failover: how many gnhastd we know, how often to time the one we are
+   on (ms, 0 never), and the rtt assumed for one never timed (ms) */
+#ifndef GN_MAX_SERVERS
+#define GN_MAX_SERVERS 4
+#endif
+#ifndef GN_SRV_PROBE_INTERVAL
+#define GN_SRV_PROBE_INTERVAL 60000
+#endif
+#ifndef GN_SRV_RTT_UNKNOWN
+#define GN_SRV_RTT_UNKNOWN 1000
+#endif
+/* forgive each server we are not on one failure this often (ms), so one
+   that came back is failed back to */
+#ifndef GN_SRV_FORGIVE
+#define GN_SRV_FORGIVE 300000
+#endif
+
+/* digits after the decimal point for double devices, same as %f */
+#define GN_DEFAULT_PRECISION 6
 
 /* simplified datatype */
 enum gn_dev_datatype {
@@ -65,6 +243,12 @@ enum gn_dev_datatype {
     DATATYPE_LL, /**< uint64_t */
 };
 
+/* how a device deadband is measured */
+enum gn_deadband_type {
+    GN_DEADBAND_ABS, /**< absolute change in value */
+    GN_DEADBAND_PCT, /**< percent of the last value sent */
+};
+
 /* Hyper simplified from gnhast, we will hack it up hard */
 typedef union _data_t {
     uint32_t u;
@@ -72,6 +256,44 @@ typedef union _data_t {
     uint64_t u64;
 } gn_data_t;
 
+/*!
+ * Called when gnhastd asks us to change a device (chg).  Runs in the tcp
+ * callback, so do the actuation and return quickly.  Return true if the
+ * change was made, the confirming upd then carries the new value,
+ * otherwise the current one.
+ */
+typedef bool (*gn_chg_cb_t)(int dev, gn_data_t data);
+
+/* start a sensor conversion, return ms until the result can be read */
+typedef uint32_t (*gn_sensor_start_t)(void *arg);
+/* read the result, store_data_dev() it, return false if it failed */
+typedef bool (*gn_sensor_read_t)(void *arg);
+
+/*
+ * Filters a stored value can be run through, see filter.cpp
+ */
+enum gn_filter_type {
+    GN_FILT_EMA, /**< moving average, weight 1/2^param */
+    GN_FILT_MEDIAN, /**< median of the last param samples */
+    GN_FILT_RATE, /**< change per param ms, counters to rates */
+};
+
+typedef struct _gn_filtstage {
+    uint8_t type; /* enum gn_filter_type */
+    uint8_t n; /* samples seen, up to what the stage needs */
+    uint8_t pos; /* median: next slot in hist */
+    int32_t param;
+    int64_t state; /* ema: the average, rate: the previous sample */
+    uint32_t ms; /* rate: millis() of the previous sample */
+    int64_t hist[GN_FILT_MEDIAN_MAX]; /* median: the last samples */
+} gn_filtstage_t;
+
+typedef struct _gn_filter {
+    int datatype; /* how the stored value is to be read */
+    int nstages;
+    gn_filtstage_t st[GN_FILT_STAGES];
+} gn_filter_t;
+
 /*!
  * A device, super simple
  */
@@ -79,17 +301,264 @@ struct _gn_dev;
 typedef struct _gn_dev {
     char *name;
     char *uid;
+    uint8_t uidlen; /* strlen(uid), so the encoder need not */
     int type;
     int subtype;
     int proto;
     int datatype; /* store the datatype here */
     int scale; /* set scale type here */
+    int8_t precision; /* decimals sent for DATATYPE_DOUBLE */
+    uint32_t stored; /* micros() of the last store_data_dev */
+    uint32_t changed; /* millis() when the value last changed */
+    uint8_t flags; /* GN_DEV_* */
     gn_data_t data;
+    /* reporting policy, see generic_build_device */
+    double deadband; /* changes smaller than this are not news */
+    int deadband_type; /* enum gn_deadband_type */
+    uint32_t min_interval; /* ms, never report more often than this */
+    uint32_t max_interval; /* ms, report at least this often */
+    uint32_t sent_ms; /* millis() of the last upd */
+    gn_data_t sent; /* the value in the last upd */
+    gn_chg_cb_t chg_cb; /* handler for chg, NULL if not changeable */
+    gn_filter_t *filt; /* filters run on store, NULL if none */
     void *arg; /* pointer that can be used by program, not needed */
 } gn_dev_t;
 
+/* gn_dev_t flags */
+#define GN_DEV_DIRTY (1<<0) /* value changed since it was last sent */
+#define GN_DEV_SENT (1<<1) /* value has been sent at least once */
+#define GN_DEV_REGISTERED (1<<2) /* reg'd, replay it on every connect */
+#define GN_DEV_PENDING (1<<3) /* upd waiting for gnhastd to come back */
+#define GN_DEV_KEEPALL (1<<4) /* queue every sample while disconnected */
+#define GN_DEV_AGG (1<<5) /* samples are aggregated, see aggregate.cpp */
+
+/* one sample held for a keep-all device while disconnected */
+typedef struct _gn_pending {
+    uint8_t dev;
+    gn_data_t data;
+} gn_pending_t;
+
+/* a pending sample spilled to the journal, exactly 16 bytes on flash */
+typedef struct _gn_jrec {
+    uint8_t magic;
+    uint8_t dev; /* device index when written */
+    uint16_t uidcrc; /* crc16 of the uid, to catch a changed device table */
+    uint8_t data[8]; /* gn_data_t */
+    uint16_t datatype;
+    uint16_t crc; /* crc16 of everything above */
+} gn_jrec_t;
+
+/* the config files we cache */
+enum gn_cfg_file {
+    GN_CFG_SETTINGS, /**< /config.json, server and port */
+    GN_CFG_GNHAST, /**< /gnhast.json, collector and device names */
+    GN_CFG_NFILES,
+};
+
+/* a device name from the config, by uid */
+typedef struct _gn_cfgname {
+    char *uid;
+    char *name;
+} gn_cfgname_t;
+
+/* crc16-ccitt, journal.cpp */
+uint16_t gn_crc16(const void *buf, size_t len, uint16_t crc = 0xFFFF);
+
+/*
+ * Fast reconnect cache, kept in RTC memory, see fast_reconnect.cpp
+ */
+typedef struct _gn_fastconn {
+    uint32_t magic;
+    uint16_t crc; /* crc16 of everything from bssid on */
+    uint16_t uses; /* boots the lease was reused for */
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t flags; /* GN_FC_* */
+    uint32_t ip, gw, mask, dns;
+    uint32_t server_ip; /* gnhastd, as resolved */
+    uint16_t server_port;
+    uint16_t server_crc; /* crc16 of the name it was resolved from */
+} gn_fastconn_t;
+
+#define GN_FC_WIFI (1<<0) /* bssid, channel and lease are good */
+#define GN_FC_SERVER (1<<1) /* server_ip is good */
+
+/*
+ * Statistics a window of samples can be reported as, see aggregate.cpp
+ */
+enum gn_agg_stat {
+    GN_AGG_MEAN,
+    GN_AGG_MIN,
+    GN_AGG_MAX,
+    GN_AGG_LAST,
+    GN_AGG_NSTATS,
+};
+
+typedef struct _gn_agg {
+    int dev; /* the device sampled, -1 if the slot is free */
+    int16_t out[GN_AGG_NSTATS]; /* device each stat goes to, or -1 */
+    uint32_t window; /* ms */
+    uint32_t start; /* millis() the window opened */
+    uint32_t n; /* samples in this window */
+    double min, max, sum, last;
+} gn_agg_t;
+
+/*
+ * An update posted from timer or interrupt context, see spsc_queue.cpp
+ */
+typedef struct _gn_updrec {
+    uint16_t dev;
+    uint8_t pad[2];
+    uint32_t us; /* micros() when it was posted */
+    gn_data_t data;
+} gn_updrec_t;
+
+/*
+ * A sensor run by the scheduler, see sensor_sched.cpp
+ */
+typedef struct _gn_sensor {
+    gn_sensor_start_t start; /* NULL if there is nothing to start */
+    gn_sensor_read_t read;
+    void *arg;
+    uint32_t period; /* ms from one start to the next */
+    uint32_t due; /* millis() the next step is due */
+    uint32_t started; /* millis() of the last start */
+    uint16_t fails; /* reads failed in a row */
+    uint8_t converting; /* started, waiting to read */
+} gn_sensor_t;
+
+/*
+ * A gnhastd we can fail over to, see failover.cpp
+ */
+typedef struct _gn_server {
+    const char *host;
+    uint16_t port;
+    uint16_t fails; /* in a row, since it last answered */
+    uint32_t rtt_ms; /* smoothed getapiv round trip, 0 not timed yet */
+} gn_server_t;
+
+/*
+ * Where DNS-SD last found gnhastd, kept in RTC memory, see discovery.cpp
+ */
+typedef struct _gn_disc {
+    uint32_t magic;
+    uint16_t crc; /* crc16 of the rest */
+    uint16_t port;
+    uint32_t ip;
+    uint32_t age; /* s since the lookup, as of the last write */
+} gn_disc_t;
+
+/*
+ * Deep sleep state, kept in RTC memory, see deep_sleep.cpp
+ */
+typedef struct _gn_sleeprec {
+    uint8_t dev;
+    uint8_t pad[3];
+    uint8_t data[8]; /* gn_data_t */
+} gn_sleeprec_t;
+
+typedef struct _gn_sleepstate {
+    uint32_t magic;
+    uint16_t crc; /* crc16 of everything after it */
+    uint16_t wakes; /* since the last send */
+    uint8_t head; /* oldest sample in ring */
+    uint8_t count;
+    uint8_t flags; /* GN_SLEEP_* */
+    uint8_t regage; /* sends since the regs were last all sent */
+    uint32_t dropped; /* samples lost to a full ring */
+    uint32_t registered; /* bit per device, gnhastd has its reg */
+    uint32_t sentmask; /* bit per device, sent[] is good */
+    gn_sleeprec_t ring[GN_SLEEP_RING];
+    uint8_t sent[GN_SLEEP_DEVS][8]; /* last value sent, for the deadband */
+} gn_sleepstate_t;
+
+#define GN_SLEEP_SEND_NEXT (1<<0) /* send on the next wake */
+#define GN_SLEEP_RF_OFF (1<<1) /* we woke with the radio disabled */
+
+/* wifi bring-up */
+enum gn_wifi_state {
+    GN_WIFI_NONE, /**< the sketch does its own wifi */
+    GN_WIFI_CONNECTING, /**< joining the network in the background */
+    GN_WIFI_UP, /**< connected */
+    GN_WIFI_PORTAL, /**< captive portal up, still trying the network */
+};
+
+/* connection to gnhastd */
+enum gn_conn_state {
+    GN_CONN_IDLE, /**< not connected, and not trying */
+    GN_CONN_CONNECTING, /**< connect in progress */
+    GN_CONN_UP, /**< connected, and the client line sent */
+    GN_CONN_BACKOFF, /**< waiting to try again */
+};
+
 /* Change this if you need more than 20 things. that seems like alot */
+#ifndef gn_MAX_DEVICES
 #define gn_MAX_DEVICES 20
+#endif
+
+/*!
+ * Counters for the outbound buffer, use these to size GN_TXBUF_SIZE
+ */
+typedef struct _gn_txstats {
+    uint32_t queued; /* bytes accepted into the buffer */
+    uint32_t sent; /* bytes handed to tcp */
+    uint32_t acked; /* bytes acked by gnhastd */
+    uint32_t dropped; /* bytes thrown away (full, or lost link) */
+    uint32_t drop_lines; /* lines thrown away */
+    uint32_t hiwat; /* most bytes ever waiting in the buffer */
+    uint32_t waiting; /* bytes in the buffer now, not yet sent */
+    uint32_t inflight; /* bytes sent now, not yet acked */
+} gn_txstats_t;
+
+/*!
+ * Running min/max/mean of some sampled quantity
+ */
+typedef struct _gn_perfstat {
+    uint32_t n;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} gn_perfstat_t;
+
+/* time the update path, find_dev_byuid() and how long upds take to
+   reach tcp and be acked, see perf_stats.cpp.  Off by default, it costs
+   a few micros() on every update. */
+#ifndef GN_PERF
+#define GN_PERF 0
+#endif
+
+/* how many upd lines we track on their way to gnhastd at once */
+#define GN_PERF_MARKERS 16
+
+/* boot phases we time, see boot_json() */
+enum gn_boot_phase {
+    GN_BOOT_WIFI, /**< all of init_wifi() */
+    GN_BOOT_AUTOCONNECT, /**< autoConnect(), or the captive portal */
+    GN_BOOT_FSMOUNT, /**< SPIFFS mount */
+    GN_BOOT_CONFIG, /**< reading the config files */
+    GN_BOOT_WEBSERVER, /**< init_webserver() */
+    GN_BOOT_CONNECT, /**< connect() until the tcp connection is up */
+    GN_BOOT_APIV, /**< getapiv until gnhastd answers */
+    GN_BOOT_FIRST_UPD, /**< power on until the first upd is queued */
+    GN_BOOT_NPHASES,
+};
+
+/* millis() a boot phase started and ended, end 0 if it has not */
+typedef struct _gn_boottime {
+    uint32_t start;
+    uint32_t end;
+} gn_boottime_t;
+
+class gnhast;
+
+/* handler for one command verb from gnhastd, args is not NUL terminated */
+typedef void (gnhast::*gn_cmdfunc_t)(const char *args, size_t len);
+
+typedef struct _gn_cmdtab {
+    const char *verb;
+    uint8_t len;
+    gn_cmdfunc_t func;
+} gn_cmdtab_t;
 
 class gnhast {
  public:
@@ -97,14 +566,23 @@ class gnhast {
 
     void set_server(char *server, int port);
     void init_server();
+    void set_discovery(bool on);
+    int add_server(const char *server, int port);
     bool connect();
     void disconnect();
-    int generic_build_device(char *uid, char *name, int proto, int type, int subtype, int datatype, int scale, void *arg);
+    void handle();
+    int conn_state();
+    int generic_build_device(char *uid, char *name, int proto, int type, int subtype, int datatype, int scale, void *arg,
+			     double deadband = 0, int deadband_type = GN_DEADBAND_ABS,
+			     uint32_t min_interval = 0, uint32_t max_interval = 0);
     int find_dev_byuid(char *uid);
     void store_data_dev(int dev, gn_data_t data);
+    void set_dev_precision(int dev, int prec);
+    void set_chg_callback(int dev, gn_chg_cb_t cb);
     void gn_mod_name(int dev);
     void gn_register_device(int dev);
     void gn_update_device(int dev);
+    int flush_dirty();
     void set_debug_mode(int mode);
     void imalive();
     void set_collector_health(int health);
@@ -112,21 +590,63 @@ class gnhast {
     gn_dev_t *get_dev_byindex(int idx);
     bool shouldReboot;
 
+    /* tx_buffer.cpp */
+    void get_txstats(gn_txstats_t *st);
+    bool send_line(const char *line);
+
+    /* filter.cpp */
+    bool add_dev_filter(int dev, int type, int32_t param,
+			int in_datatype = -1);
+    void clear_dev_filters(int dev);
+
+    /* aggregate.cpp */
+    bool set_dev_aggregate(int dev, uint32_t window, int stat);
+    bool add_agg_output(int dev, int stat, int outdev);
+
+    /* spsc_queue.cpp */
+    bool post_data_dev(int dev, gn_data_t data);
+
+    /* sensor_sched.cpp */
+    int add_sensor(gn_sensor_start_t start, gn_sensor_read_t read,
+		   void *arg, uint32_t period);
+    int sensor_fails(int sensor);
+
+    /* pending_queue.cpp */
+    void set_dev_keepall(int dev, bool keepall);
+    int pending_count();
+
+    /* deep_sleep.cpp */
+    void set_rtcmem(gn_rtcmem *rtc);
+    void sleep_begin(int every);
+    bool sleep_due();
+    void sleep_end(uint64_t sleep_us);
+
+    /* perf_stats.cpp */
+    void perf_reset();
+    void perf_json(Print &out);
+    void boot_json(Print &out);
+
     /* config_helper.cpp */
     DynamicJsonDocument parse_json_conf(char *filename);
     void save_gnhast_config();
     DynamicJsonDocument read_gnhast_config();
+    const char *config_dev_name(const char *uid);
+    void config_commit();
+    void config_export(Print &out);
+    bool config_import(const char *json);
 
     /* wifi_web.cpp */
     void init_wifi();
+    void init_wifi_async(int portal_after = GN_WIFI_PORTAL_AFTER);
+    int wifi_state();
     boolean init_webserver();
     String getContentType(String filename);
     AsyncWebServer *server;
-    AsyncPrinter *ap;
 
  private:
     int _collector_is_healthy;
     char *_server;
+    char *_server_mem; /* our strdup() of the primary, for free() */
     int _port;
     gn_dev_t _devices[gn_MAX_DEVICES];
     char *_collector_name;
@@ -136,6 +656,7 @@ class gnhast {
     int _debug;
     char _gnhast_server[80];
     char _gnhast_port_str[8];
+    uint8_t _dev_arglen[NROF_SUBTYPES];
     const char *_dev_argtable[NROF_SUBTYPES] = {
 	"none",
 	"switch", "outlet", "temp", "humid", "count",
@@ -155,10 +676,253 @@ class gnhast {
     DNSServer dns;
     AsyncWiFiManager *wifimgr;
 
+    void _gn_encode_reg(int dev);
+    bool _gn_encode_upd(int dev, gn_data_t data, bool prio = false);
+    void _gn_send_upd(int dev, bool prio = false);
+    void _gn_store(int dev, gn_data_t data);
+    void _gn_update(int dev);
+    bool _gn_should_report(int dev, uint32_t now);
+    bool _gn_past_deadband(int dev, gn_data_t sent);
+    bool _gn_flush_due(int dev, uint32_t now);
+
+    /* connection.cpp */
+    int _conn_state; /* enum gn_conn_state */
+    uint32_t _conn_backoff; /* current backoff, ms */
+    uint32_t _conn_next; /* millis() of the next connect attempt */
+    uint32_t _conn_started; /* millis() the current attempt started */
+    uint32_t _last_ping; /* millis() of the last ping, 0 if none yet */
+    bool _conn_fast; /* this attempt uses the cached gnhastd address */
+    int _conn_replay; /* next device to re-register */
+
     void __gn_client();
-    void __gn_gotdata(void *arg, AsyncPrinter *pri, uint8_t *data, size_t len);
+    void __gn_connected(void *arg, AsyncClient *c);
+    void __gn_disconnected(void *arg, AsyncClient *c);
+    bool _gn_conn_start();
+    void _gn_conn_retry();
+    void _gn_kick();
+    void _gn_pump();
+
+    /* tx_buffer.cpp */
+    char _txbuf[GN_TXBUF_SIZE];
+    uint32_t _tx_wr; /* free running write offset */
+    uint32_t _tx_snd; /* free running offset of next byte for tcp */
+    uint32_t _tx_inflight; /* bytes handed to tcp, not yet acked */
+    bool _tx_closing; /* close once the buffer drains */
+    bool _tx_hold; /* batching, don't drain on every line */
+    bool _tx_midline; /* last byte handed to tcp was not a newline */
+    char _tx_prio[GN_TXPRIO_SIZE]; /* lines that jump the queue */
+    size_t _tx_prio_len;
+    gn_txstats_t _txstats;
+    uint32_t _ln_len; /* length of the line being encoded */
+    bool _ln_ovf; /* line being encoded did not fit */
+    bool _ln_prio; /* line being encoded goes in _tx_prio */
+
+    void _ln_begin(bool prio = false);
+    void _ln_put(const char *buf, size_t len);
+    void _ln_puts(const char *str);
+    void _ln_putc(char c);
+    void _ln_putu(uint32_t val, int width = 0);
+    bool _ln_end();
+    bool _tx_line(const char *str);
+    size_t _tx_free();
+    void _tx_drain();
+    void _tx_reset();
+    void __gn_gotack(void *arg, AsyncClient *c, size_t len, uint32_t time);
+
+    /* pending_queue.cpp */
+    gn_pending_t _pq[GN_PENDQ_SIZE];
+    uint16_t _pq_head; /* oldest record */
+    uint16_t _pq_len;
+    int _pq_dev; /* next device to check for GN_DEV_PENDING */
+    uint32_t _pq_next; /* millis() of the next replay batch */
+    uint32_t _pq_dropped; /* records lost to a full queue */
+    uint32_t _pq_replayed; /* upds sent late */
+
+    void _pq_add(int dev);
+    bool _pq_busy(int dev);
+    bool _pq_emit(int dev, gn_data_t data, uint32_t now);
+    void _pq_replay();
+
+    /* journal.cpp */
+    bool _jnl_ready; /* looked for a journal left by a previous boot */
+    uint32_t _jnl_size; /* bytes in the journal file */
+    uint32_t _jnl_rd; /* bytes of it already replayed */
+    uint8_t _jbuf[GN_JNL_PAGE]; /* records not yet written to flash */
+    size_t _jb_len;
+    size_t _jb_rd; /* bytes of _jbuf already replayed */
+    uint32_t _jnl_spilled; /* records moved to the journal */
+    uint32_t _jnl_bad; /* records that failed crc, or lost their device */
+
+    void _jnl_init();
+    uint32_t _jnl_count();
+    bool _jnl_flushpage();
+    bool _jnl_spill(gn_pending_t *p);
+    int _jnl_dev(gn_jrec_t *rec);
+    int _jnl_replay(int max, uint32_t now);
+
+    /* rx_parser.cpp */
+    char _rxbuf[GN_RXLINE_SIZE]; /* partial line carried between segments */
+    size_t _rx_len;
+    bool _rx_discard; /* line too long, skip to the next newline */
+    static const gn_cmdtab_t _cmdtab[];
+
+    void __gn_gotdata(void *arg, AsyncClient *c, void *data, size_t len);
+    void _rx_line(const char *line, size_t len);
+    void _gn_cmd_ping(const char *args, size_t len);
+    void _gn_cmd_apiv(const char *args, size_t len);
+    void _gn_cmd_chg(const char *args, size_t len);
+
+    /* perf_stats.cpp */
+    struct {
+	uint32_t updates; /* upd lines queued */
+	gn_perfstat_t update_us; /* time spent in gn_update_device */
+	gn_perfstat_t sock_us; /* store_data_dev until handed to tcp */
+	gn_perfstat_t ack_us; /* store_data_dev until acked */
+	gn_perfstat_t update_stack; /* stack used by one update */
+	gn_perfstat_t find_us;
+	gn_perfstat_t commit_us;
+	gn_perfstat_t parse_us;
+	uint32_t heap_min;
+    } _perf;
+    struct {
+	uint32_t end; /* tx offset just past the line */
+	uint32_t stored; /* when the value was stored */
+    } _perf_mk[GN_PERF_MARKERS];
+    uint8_t _mk_wr, _mk_snd, _mk_ack;
+    gn_boottime_t _boot[GN_BOOT_NPHASES];
+    struct {
+	uint32_t called; /* millis() of gn_register_device */
+	uint32_t sent; /* millis() its reg was first queued */
+    } _boot_reg[gn_MAX_DEVICES];
+
+    void _perf_sample(gn_perfstat_t *ps, uint32_t val);
+    void _perf_mark(int dev);
+    void _perf_progress();
+    void _perf_forget();
+    void _boot_begin(int phase);
+    void _boot_end(int phase);
+    void _boot_reg_sent(int dev);
+
+    /* deep_sleep.cpp */
+    gn_rtcmem *_rtc;
+    bool _sleep_mode;
+    int _sleep_every; /* send every this many wakes */
+    bool _sleep_urgent; /* a sample crossed its deadband */
+    gn_sleepstate_t _ss;
+
+    void _sleep_add(int dev);
+    bool _sleep_registered(int dev);
+    void _sleep_retire(int n);
+    bool _sleep_send();
+    void _sleep_save();
+
+    /* filter.cpp */
+    bool _filt_run(int dev, gn_data_t *data);
+
+    /* aggregate.cpp */
+    gn_agg_t _agg[GN_MAX_AGG];
+
+    gn_agg_t *_agg_find(int dev);
+    void _agg_add(int dev, gn_data_t data);
+    void _agg_run(uint32_t now);
+
+    /* spsc_queue.cpp */
+    gn_updrec_t _spsc[GN_SPSC_SIZE];
+    volatile uint32_t _spsc_head; /* written by the producer only */
+    volatile uint32_t _spsc_tail; /* written by the consumer only */
+    volatile uint32_t _spsc_dropped; /* producer only */
+    uint32_t _spsc_hiwat;
+
+    void _spsc_drain();
+
+    /* sensor_sched.cpp */
+    gn_sensor_t _sensors[GN_MAX_SENSORS];
+    int _nsensors;
+
+    void _sensor_run(uint32_t now);
+
+    /* failover.cpp */
+    gn_server_t _srv[GN_MAX_SERVERS];
+    int _srv_count;
+    int _srv_cur; /* the one _server and _port are from */
+    uint32_t _srv_probe_at; /* millis() of the getapiv in flight, 0 none */
+    uint32_t _srv_probe_last; /* millis() of the last answer */
+    uint32_t _srv_forgive_last; /* millis() of the last forgiveness */
+    bool _srv_failback; /* one was forgiven, see if it is better */
+
+    void _srv_primary();
+    int _srv_pick();
+    void _srv_use(int i);
+    bool _srv_failed();
+    void _srv_healthy();
+    void _srv_probe(uint32_t now);
+    void _srv_answer();
+    void _srv_forgive(uint32_t now);
+
+    /* discovery.cpp */
+    bool _disc_on;
+    bool _disc_want; /* look gnhastd up before the next attempt */
+    bool _disc_mdns; /* MDNS.begin() done */
+    uint32_t _disc_at; /* millis() of the last lookup, 0 never */
+    char _disc_host[16]; /* dotted quad of what we found */
+
+    void _disc_init();
+    void _disc_lookup();
+    void _disc_failed();
+    void _disc_sleep(uint64_t sleep_us);
+
+    /* fast_reconnect.cpp */
+    gn_fastconn_t _fc;
+    bool _fc_loaded;
+    bool _wifi_fast; /* current wifi attempt is the fast path */
+
+    void _fc_load();
+    void _fc_save();
+    bool _wifi_fast_begin();
+    void _wifi_fast_failed();
+    void _fc_wifi_up();
+    bool _fc_server(IPAddress &ip);
+    void _fc_server_up(IPAddress ip);
+    void _fc_server_failed();
+
+    /* config_helpers.cpp */
+    bool _fs_mounted;
+    bool _cfg_loaded;
+    uint8_t _cfg_dirty; /* 1 << enum gn_cfg_file, waiting to be written */
+    uint32_t _cfg_due; /* millis() to write them */
+    uint16_t _cfg_crc[GN_CFG_NFILES]; /* of the json last read or written */
+    gn_cfgname_t _cfg_names[gn_MAX_DEVICES];
+    int _cfg_nnames;
+
+    bool _fs_mount();
+    void _cfg_load();
+    void _cfg_load_json();
+    void _cfg_recover(const char *path);
+    bool _cfg_replace(const char *path);
+    void _cfg_set_name(const char *uid, const char *name);
+    void _cfg_build(int which, DynamicJsonDocument &doc);
+    void _cfg_write(int which);
+    void _cfg_touch(int which);
+
+    /* config_blob.cpp */
+    uint16_t _cfg_blob_crc; /* of the blob last read or written */
+
+    bool _cfg_blob_load();
+    void _cfg_blob_write();
 
     /* wifi_web.cpp */
+    int _wifi_state; /* enum gn_wifi_state */
+    uint32_t _wifi_started; /* millis() of the current attempt */
+    int _wifi_fails; /* attempts that timed out in a row */
+    int _wifi_portal_after;
+    AsyncWiFiManagerParameter *_wifi_param_server;
+    AsyncWiFiManagerParameter *_wifi_param_port;
+
+    void _wifi_begin();
+    void _wifi_portal();
+    void _wifi_up();
+    void _wifi_poll(uint32_t now);
+    bool _wifi_ready();
     void _read_settings_conf();
     void _save_settings_conf();
     void saveConfigCallback();
@@ -167,6 +931,7 @@ class gnhast {
 			size_t index, uint8_t *data, size_t len, bool final);
     void handleUpdate(AsyncWebServerRequest *request);
     void handle_modcfg(AsyncWebServerRequest *request);
+    void handle_cfgimport(AsyncWebServerRequest *request);
     void handle_reboot(AsyncWebServerRequest *request);
 };
     
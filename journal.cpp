@@ -0,0 +1,224 @@
+/*
+ * Update journal on SPIFFS, for outages longer than the pending queue.
+ *
+ * When the RAM queue of keep-all samples fills up, the oldest record is
+ * spilled here instead of being dropped.  Records are 16 bytes of binary
+ * with a crc16, collected in a GN_JNL_PAGE sized buffer and appended to
+ * GN_JNL_FILE a page at a time, so flash sees few, whole page writes.  The
+ * file is append only: after a reconnect it is read back from the front,
+ * at the replay pace of the pending queue, and removed once drained.
+ * Records survive a reboot, a torn record at the tail fails its crc and
+ * is skipped.  Anything in the journal is older than what is in RAM, so
+ * it always goes first.
+ */
+
+#include "gnhast_async.h"
+
+#define GN_JNL_MAGIC 0xA5
+
+static_assert(sizeof(gn_jrec_t) == 16, "journal records must be 16 bytes");
+static_assert(GN_JNL_PAGE % sizeof(gn_jrec_t) == 0,
+	      "GN_JNL_PAGE must hold whole records");
+
+/*
+ * crc16-ccitt, small and slow is fine, records are tiny.  Pass the crc of
+ * the previous chunk to continue it.
+ */
+
+uint16_t gn_crc16(const void *buf, size_t len, uint16_t crc)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    int i;
+
+    while (len--) {
+	crc ^= (uint16_t)*p++ << 8;
+	for (i=0; i < 8; i++)
+	    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+/*
+ * Find out what a previous boot left behind, once
+ */
+
+void gnhast::_jnl_init()
+{
+    File f;
+
+    if (_jnl_ready)
+	return;
+    _jnl_ready = true;
+    if (!_fs_mount() || !SPIFFS.exists(GN_JNL_FILE))
+	return;
+    f = SPIFFS.open(GN_JNL_FILE, "r");
+    if (!f)
+	return;
+    _jnl_size = f.size() - f.size() % sizeof(gn_jrec_t);
+    f.close();
+    if (_jnl_size)
+	Serial.printf("Found %u journaled updates\n",
+		      (unsigned)(_jnl_size / sizeof(gn_jrec_t)));
+}
+
+/*
+ * How many records are waiting in the journal
+ */
+
+uint32_t gnhast::_jnl_count()
+{
+    return (_jnl_size - _jnl_rd + _jb_len - _jb_rd) / sizeof(gn_jrec_t);
+}
+
+/*
+ * Append the page buffer to the journal file
+ */
+
+bool gnhast::_jnl_flushpage()
+{
+    File f;
+    size_t len = _jb_len - _jb_rd;
+
+    if (len == 0)
+	return true;
+    if (_jnl_size + len > GN_JNL_MAX) {
+	if (_debug)
+	    Serial.println("journal full");
+	return false;
+    }
+    if (!_fs_mount())
+	return false;
+    f = SPIFFS.open(GN_JNL_FILE, "a");
+    if (!f) {
+	Serial.println("Cannot open journal for writing");
+	return false;
+    }
+    if (f.write((uint8_t *)&_jbuf[_jb_rd], len) != len) {
+	Serial.println("Short write to journal");
+	f.close();
+	return false;
+    }
+    f.close();
+    _jnl_size += len;
+    _jb_len = _jb_rd = 0;
+    return true;
+}
+
+/*
+ * Move a sample out of RAM and into the journal.  Returns false if there
+ * is no room for it there either.
+ */
+
+bool gnhast::_jnl_spill(gn_pending_t *p)
+{
+    gn_jrec_t rec;
+
+    _jnl_init();
+    if (_jb_len + sizeof(rec) > GN_JNL_PAGE && !_jnl_flushpage())
+	return false;
+
+    rec.magic = GN_JNL_MAGIC;
+    rec.dev = p->dev;
+    rec.uidcrc = gn_crc16(_devices[p->dev].uid, _devices[p->dev].uidlen);
+    memcpy(rec.data, &p->data, sizeof(rec.data));
+    rec.datatype = _devices[p->dev].datatype;
+    rec.crc = gn_crc16(&rec, offsetof(gn_jrec_t, crc));
+    memcpy(&_jbuf[_jb_len], &rec, sizeof(rec));
+    _jb_len += sizeof(rec);
+    _jnl_spilled++;
+    return true;
+}
+
+/*
+ * Which device a record belongs to, -1 if it is bad or the device is gone
+ */
+
+int gnhast::_jnl_dev(gn_jrec_t *rec)
+{
+    int i;
+
+    if (rec->magic != GN_JNL_MAGIC ||
+	rec->crc != gn_crc16(rec, offsetof(gn_jrec_t, crc))) {
+	_jnl_bad++;
+	return -1;
+    }
+    i = rec->dev;
+    if (i < _nrofdevs &&
+	gn_crc16(_devices[i].uid, _devices[i].uidlen) == rec->uidcrc)
+	return i;
+    /* device table changed across a reboot, look for it */
+    for (i=0; i < _nrofdevs; i++)
+	if (gn_crc16(_devices[i].uid, _devices[i].uidlen) == rec->uidcrc &&
+	    _devices[i].datatype == rec->datatype)
+	    return i;
+    _jnl_bad++;
+    return -1;
+}
+
+/*
+ * Send up to max journaled records, oldest first.  Returns how many were
+ * used up, the caller must not send newer updates while _jnl_count() is
+ * not zero.
+ */
+
+int gnhast::_jnl_replay(int max, uint32_t now)
+{
+    gn_jrec_t recs[GN_REPLAY_BATCH];
+    gn_data_t data;
+    File f;
+    bool fromfile;
+    int i, n, dev, done = 0;
+
+    _jnl_init();
+    fromfile = (_jnl_rd < _jnl_size);
+    if (max > GN_REPLAY_BATCH)
+	max = GN_REPLAY_BATCH;
+
+    if (fromfile) {
+	n = (_jnl_size - _jnl_rd) / sizeof(gn_jrec_t);
+	if (n > max)
+	    n = max;
+	if (!_fs_mount())
+	    return 0;
+	f = SPIFFS.open(GN_JNL_FILE, "r");
+	if (!f || !f.seek(_jnl_rd) ||
+	    f.read((uint8_t *)recs, n * sizeof(gn_jrec_t)) !=
+	    n * sizeof(gn_jrec_t)) {
+	    Serial.println("Cannot read journal, discarding it");
+	    if (f)
+		f.close();
+	    n = 0;
+	    _jnl_rd = _jnl_size;
+	} else
+	    f.close();
+    } else {
+	n = (_jb_len - _jb_rd) / sizeof(gn_jrec_t);
+	if (n > max)
+	    n = max;
+	memcpy(recs, &_jbuf[_jb_rd], n * sizeof(gn_jrec_t));
+    }
+
+    for (i=0; i < n; i++) {
+	dev = _jnl_dev(&recs[i]);
+	if (dev >= 0) {
+	    if (_tx_free() < 64u + _devices[dev].uidlen)
+		break;
+	    memcpy(&data, recs[i].data, sizeof(recs[i].data));
+	    _pq_emit(dev, data, now);
+	}
+	done++;
+    }
+
+    if (fromfile) {
+	_jnl_rd += done * sizeof(gn_jrec_t);
+	if (_jnl_rd >= _jnl_size) {
+	    SPIFFS.remove(GN_JNL_FILE);
+	    _jnl_size = _jnl_rd = 0;
+	}
+    } else {
+	_jb_rd += done * sizeof(gn_jrec_t);
+	if (_jb_rd == _jb_len)
+	    _jb_len = _jb_rd = 0;
+    }
+    return done;
+}
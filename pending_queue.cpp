@@ -0,0 +1,159 @@
+/*
+ * Store and forward for updates made while gnhastd is unreachable.
+ *
+ * By default only the latest value of a device matters, so an update made
+ * while disconnected just marks the device GN_DEV_PENDING, the value is
+ * already in the device.  Devices put in keep-all mode (counters, where
+ * every sample counts) instead get each sample copied into a small ring of
+ * GN_PENDQ_SIZE records, oldest dropped first when it fills.  Once the
+ * link is back and the regs have been replayed, _pq_replay() sends the
+ * ring in order, then the pending devices, GN_REPLAY_BATCH lines every
+ * GN_REPLAY_INTERVAL ms, so a reconnect does not flood gnhastd.  If the
+ * ring fills, the oldest record spills to the SPIFFS journal (journal.cpp)
+ * rather than being lost, and the journal is replayed before the ring.
+ */
+
+#include "gnhast_async.h"
+
+/*!
+ * @brief queue every sample of this device while disconnected, instead
+ * of just the latest one.  Meant for counters, where gnhastd should see
+ * every value.
+ */
+
+void gnhast::set_dev_keepall(int dev, bool keepall)
+{
+    if (keepall)
+	_devices[dev].flags |= GN_DEV_KEEPALL;
+    else
+	_devices[dev].flags &= ~GN_DEV_KEEPALL;
+}
+
+/*!
+ * @brief how many updates are waiting to be sent to gnhastd
+ */
+
+int gnhast::pending_count()
+{
+    int i, count = _pq_len + _jnl_count();
+
+    for (i=0; i < _nrofdevs; i++)
+	if (_devices[i].flags & GN_DEV_PENDING)
+	    count++;
+    return count;
+}
+
+/*
+ * Hold on to the current value of dev until we can send it
+ */
+
+void gnhast::_pq_add(int dev)
+{
+    gn_pending_t *p;
+
+    /* in deep sleep mode, samples wait in RTC memory */
+    if (_sleep_mode) {
+	_sleep_add(dev);
+	return;
+    }
+    if (!(_devices[dev].flags & GN_DEV_KEEPALL)) {
+	_devices[dev].flags |= GN_DEV_PENDING;
+	return;
+    }
+    if (_pq_len == GN_PENDQ_SIZE) {
+	if (GN_JNL_MAX == 0 || !_jnl_spill(&_pq[_pq_head])) {
+	    _pq_dropped++;
+	    if (_debug)
+		Serial.println("pending queue full, dropping oldest");
+	}
+	_pq_head = (_pq_head + 1) % GN_PENDQ_SIZE;
+	_pq_len--;
+    }
+    p = &_pq[(_pq_head + _pq_len) % GN_PENDQ_SIZE];
+    p->dev = dev;
+    p->data = _devices[dev].data;
+    _pq_len++;
+    /* the value is in the queue now, don't send it twice */
+    _devices[dev].flags &= ~GN_DEV_DIRTY;
+}
+
+/*
+ * Is there still queued history for dev?  Live updates of a keep-all
+ * device must then go behind it, or gnhastd sees them out of order.
+ */
+
+bool gnhast::_pq_busy(int dev)
+{
+    return (_pq_len || _jnl_count()) &&
+	(_devices[dev].flags & GN_DEV_KEEPALL);
+}
+
+/*
+ * Send one queued sample
+ */
+
+bool gnhast::_pq_emit(int dev, gn_data_t data, uint32_t now)
+{
+    if (!_gn_encode_upd(dev, data))
+	return false;
+    _devices[dev].flags |= GN_DEV_SENT;
+    _devices[dev].sent = data;
+    _devices[dev].sent_ms = now;
+    _pq_replayed++;
+    return true;
+}
+
+/*
+ * Send the next batch of queued updates, oldest first.  Called by
+ * _gn_pump() once the regs are out.
+ */
+
+void gnhast::_pq_replay()
+{
+    uint32_t now = millis();
+    gn_pending_t *p;
+    gn_dev_t *d;
+    int sent = 0;
+
+    if ((int32_t)(now - _pq_next) < 0)
+	return;
+
+    /* the journal holds the oldest samples */
+    _jnl_init();
+    if (_jnl_count()) {
+	sent = _jnl_replay(GN_REPLAY_BATCH, now);
+	if (_jnl_count()) {
+	    if (sent)
+		_pq_next = now + GN_REPLAY_INTERVAL;
+	    return;
+	}
+    }
+
+    while (_pq_len && sent < GN_REPLAY_BATCH) {
+	p = &_pq[_pq_head];
+	d = &_devices[p->dev];
+	/* an upd is about 40 bytes plus the uid and value */
+	if (_tx_free() < 64u + d->uidlen)
+	    break;
+	_pq_emit(p->dev, p->data, now);
+	_pq_head = (_pq_head + 1) % GN_PENDQ_SIZE;
+	_pq_len--;
+	sent++;
+    }
+
+    for (; _pq_dev < _nrofdevs && sent < GN_REPLAY_BATCH; _pq_dev++) {
+	d = &_devices[_pq_dev];
+	if (!(d->flags & GN_DEV_PENDING))
+	    continue;
+	if (_tx_free() < 64u + d->uidlen)
+	    break;
+	_gn_send_upd(_pq_dev);
+	_pq_replayed++;
+	sent++;
+    }
+    if (_pq_dev == _nrofdevs && !_pq_len)
+	_pq_dev = 0;
+
+    if (sent)
+	_pq_next = now + GN_REPLAY_INTERVAL;
+}
@@ -0,0 +1,232 @@
+/*
+ * Performance counters for the collector hot path.
+ *
+ * The ones on the update path only exist with GN_PERF: a handful of
+ * micros() calls per update, the stack it used, and a small ring of
+ * markers so we can tell when the bytes of a given upd line were handed
+ * to tcp, and when gnhastd acked them.  The config timings and the tx,
+ * pending and server counters are always kept.  Everything can be dumped
+ * as JSON, see perf_json() and the /stats web page.
+ *
+ * Boot is timed too, phase by phase, so we can see whether the seconds
+ * go to WiFi, flash or the gnhastd handshake.  Each phase is logged on
+ * the serial port as it ends, and all of them are in boot_json() and the
+ * /boot web page.  Only the first run of a phase counts, a reconnect an
+ * hour later is not boot.
+ */
+
+#include "gnhast_async.h"
+
+/*!
+ * @brief Zero all the performance counters
+ */
+
+void gnhast::perf_reset()
+{
+    memset(&_perf, 0, sizeof(_perf));
+    _perf.heap_min = ESP.getFreeHeap();
+    _mk_wr = _mk_snd = _mk_ack = 0;
+}
+
+/*
+ * Fold one sample into a running stat
+ */
+
+void gnhast::_perf_sample(gn_perfstat_t *ps, uint32_t val)
+{
+    if (ps->n == 0 || val < ps->min)
+	ps->min = val;
+    if (val > ps->max)
+	ps->max = val;
+    ps->sum += val;
+    ps->n++;
+}
+
+/*
+ * An upd line for dev was just committed, its last byte sits at _tx_wr
+ */
+
+void gnhast::_perf_mark(int dev)
+{
+#if GN_PERF
+    uint8_t next = (_mk_wr + 1) % GN_PERF_MARKERS;
+
+    /* full, skip this one rather than lose track of the others */
+    if (next == _mk_ack)
+	return;
+    _perf_mk[_mk_wr].end = _tx_wr;
+    _perf_mk[_mk_wr].stored = _devices[dev].stored;
+    _mk_wr = next;
+#endif
+}
+
+/*
+ * Called after the drain hands data to tcp, and after an ack.  Retire any
+ * markers whose line has made it that far.
+ */
+
+void gnhast::_perf_progress()
+{
+#if GN_PERF
+    uint32_t now = micros();
+    uint32_t acked = _tx_snd - _tx_inflight;
+
+    while (_mk_snd != _mk_wr &&
+	   (int32_t)(_tx_snd - _perf_mk[_mk_snd].end) >= 0) {
+	_perf_sample(&_perf.sock_us, now - _perf_mk[_mk_snd].stored);
+	_mk_snd = (_mk_snd + 1) % GN_PERF_MARKERS;
+    }
+    while (_mk_ack != _mk_snd &&
+	   (int32_t)(acked - _perf_mk[_mk_ack].end) >= 0) {
+	_perf_sample(&_perf.ack_us, now - _perf_mk[_mk_ack].stored);
+	_mk_ack = (_mk_ack + 1) % GN_PERF_MARKERS;
+    }
+#endif
+}
+
+/*
+ * The link went away, nothing queued will ever be sent
+ */
+
+void gnhast::_perf_forget()
+{
+    _mk_wr = _mk_snd = _mk_ack = 0;
+}
+
+/*
+ * One stat as a JSON object: n, min, max, mean
+ */
+
+static void perf_json_stat(DynamicJsonDocument &doc, const char *name,
+			   gn_perfstat_t *ps)
+{
+    doc[name]["n"] = ps->n;
+    doc[name]["min"] = ps->min;
+    doc[name]["max"] = ps->max;
+    doc[name]["mean"] = ps->n ? (uint32_t)(ps->sum / ps->n) : 0;
+}
+
+/*!
+ * @brief Write all the performance counters as JSON
+ * Times are in microseconds, memory in bytes.  The update path stats are
+ * only there when the library is built with GN_PERF.
+ */
+
+void gnhast::perf_json(Print &out)
+{
+    DynamicJsonDocument doc(JSON_CONFIG_FILE_SIZE);
+    int i;
+
+    doc["devices"] = _nrofdevs;
+    doc["updates"] = _perf.updates;
+    doc["uptime_ms"] = millis();
+    doc["tx"]["size"] = GN_TXBUF_SIZE;
+    doc["tx"]["queued"] = _txstats.queued;
+    doc["tx"]["sent"] = _txstats.sent;
+    doc["tx"]["acked"] = _txstats.acked;
+    doc["tx"]["dropped"] = _txstats.dropped;
+    doc["tx"]["drop_lines"] = _txstats.drop_lines;
+    doc["tx"]["hiwat"] = _txstats.hiwat;
+    doc["posted"]["size"] = GN_SPSC_SIZE;
+    doc["posted"]["dropped"] = _spsc_dropped;
+    doc["posted"]["hiwat"] = _spsc_hiwat;
+    doc["pending"]["queued"] = pending_count();
+    doc["pending"]["dropped"] = _pq_dropped;
+    doc["pending"]["replayed"] = _pq_replayed;
+    doc["pending"]["journal_spilled"] = _jnl_spilled;
+    doc["pending"]["journal_bad"] = _jnl_bad;
+#if GN_PERF
+    perf_json_stat(doc, "update_us", &_perf.update_us);
+    perf_json_stat(doc, "update_stack", &_perf.update_stack);
+    perf_json_stat(doc, "store_to_socket_us", &_perf.sock_us);
+    perf_json_stat(doc, "store_to_ack_us", &_perf.ack_us);
+    perf_json_stat(doc, "find_dev_byuid_us", &_perf.find_us);
+    doc["heap_min"] = _perf.heap_min;
+#endif
+    perf_json_stat(doc, "config_commit_us", &_perf.commit_us);
+    perf_json_stat(doc, "parse_json_conf_us", &_perf.parse_us);
+    for (i=0; i < _srv_count; i++) {
+	doc["servers"][i]["host"] = _srv[i].host;
+	doc["servers"][i]["port"] = _srv[i].port;
+	doc["servers"][i]["rtt_ms"] = _srv[i].rtt_ms;
+	doc["servers"][i]["fails"] = _srv[i].fails;
+	doc["servers"][i]["current"] = (i == _srv_cur);
+    }
+    doc["heap_free"] = ESP.getFreeHeap();
+
+    serializeJson(doc, out);
+}
+
+static const char *gn_boot_names[GN_BOOT_NPHASES] = {
+    "wifi", "autoconnect", "fs_mount", "config", "webserver",
+    "connect", "apiv", "first_upd",
+};
+
+/*
+ * A boot phase starts
+ */
+
+void gnhast::_boot_begin(int phase)
+{
+    if (_boot[phase].start == 0)
+	_boot[phase].start = millis() | 1;
+}
+
+/*
+ * A boot phase is done, log it
+ */
+
+void gnhast::_boot_end(int phase)
+{
+    gn_boottime_t *b = &_boot[phase];
+
+    if (b->end)
+	return;
+    b->end = millis() | 1;
+    Serial.printf("boot: %s done at %u ms, took %u ms\n",
+		  gn_boot_names[phase], (unsigned)b->end,
+		  (unsigned)(b->end - b->start));
+}
+
+/*
+ * The reg of a device was queued, log it the first time
+ */
+
+void gnhast::_boot_reg_sent(int dev)
+{
+    if (_boot_reg[dev].sent)
+	return;
+    _boot_reg[dev].sent = millis() | 1;
+    Serial.printf("boot: reg %s done at %u ms, took %u ms\n",
+		  _devices[dev].uid, (unsigned)_boot_reg[dev].sent,
+		  (unsigned)(_boot_reg[dev].sent - _boot_reg[dev].called));
+}
+
+/*!
+ * @brief Write the boot phase timings as JSON
+ * Each phase has start and end in ms since power on, and how long it
+ * took.  A phase that never ran, or never finished, has end 0.
+ */
+
+void gnhast::boot_json(Print &out)
+{
+    DynamicJsonDocument doc(JSON_CONFIG_FILE_SIZE);
+    gn_boottime_t *b;
+    int i;
+
+    for (i=0; i < GN_BOOT_NPHASES; i++) {
+	b = &_boot[i];
+	doc[gn_boot_names[i]]["start"] = b->start;
+	doc[gn_boot_names[i]]["end"] = b->end;
+	doc[gn_boot_names[i]]["ms"] = b->end ? b->end - b->start : 0;
+    }
+    for (i=0; i < _nrofdevs; i++) {
+	if (_boot_reg[i].called == 0)
+	    continue;
+	doc["reg"][_devices[i].uid]["start"] = _boot_reg[i].called;
+	doc["reg"][_devices[i].uid]["end"] = _boot_reg[i].sent;
+	doc["reg"][_devices[i].uid]["ms"] = _boot_reg[i].sent ?
+	    _boot_reg[i].sent - _boot_reg[i].called : 0;
+    }
+    serializeJson(doc, out);
+}
@@ -0,0 +1,226 @@
+/*
+ * Inbound line parser.
+ *
+ * gnhastd talks to us in newline terminated lines, but tcp hands them to
+ * us in whatever segments it likes.  Complete lines are parsed in place,
+ * straight out of the pbuf, only a trailing partial line is copied into
+ * _rxbuf to wait for the rest.  Each line is dispatched on its first word
+ * through _cmdtab.
+ */
+
+#include "gnhast_async.h"
+
+/* Commands we understand from gnhastd */
+const gn_cmdtab_t gnhast::_cmdtab[] = {
+    { "ping", 4, &gnhast::_gn_cmd_ping },
+    { "apiv", 4, &gnhast::_gn_cmd_apiv },
+    { "chg", 3, &gnhast::_gn_cmd_chg },
+    { NULL, 0, NULL },
+};
+
+/*
+ * Find key:value in the args of a command.  Values may be "quoted".
+ * Returns false if the key is not there.
+ */
+
+static bool gn_getarg(const char *args, size_t len, const char *key,
+		      const char **val, size_t *vlen)
+{
+    const char *p = args, *end = args + len, *v;
+    size_t klen = strlen(key);
+    bool quoted;
+
+    while (p < end) {
+	while (p < end && *p == ' ')
+	    p++;
+	if ((size_t)(end - p) > klen && p[klen] == ':' &&
+	    memcmp(p, key, klen) == 0) {
+	    v = p + klen + 1;
+	    quoted = (v < end && *v == '"');
+	    if (quoted)
+		v++;
+	    p = v;
+	    while (p < end && *p != (quoted ? '"' : ' '))
+		p++;
+	    *val = v;
+	    *vlen = p - v;
+	    return true;
+	}
+	/* skip this token, minding quotes */
+	quoted = false;
+	while (p < end && (quoted || *p != ' ')) {
+	    if (*p == '"')
+		quoted = !quoted;
+	    p++;
+	}
+    }
+    return false;
+}
+
+/*
+ * Got a segment from gnhastd, split it into lines
+ */
+
+void gnhast::__gn_gotdata(void *arg, AsyncClient *c, void *data,
+			  size_t len)
+{
+    const char *p = (const char *)data;
+    const char *end = p + len;
+    const char *nl;
+    size_t n;
+
+    if (_debug) {
+	Serial.printf("Got data len=%d\n", (int)len);
+	Serial.write((uint8_t *)data, len);
+    }
+
+    while (p < end) {
+	nl = (const char *)memchr(p, '\n', end - p);
+	n = (nl ? nl : end) - p;
+
+	if (_rx_discard) {
+	    if (nl)
+		_rx_discard = false;
+	} else if (nl && _rx_len == 0) {
+	    /* the common case, a whole line in this segment */
+	    _rx_line(p, n);
+	} else if (_rx_len + n > sizeof(_rxbuf)) {
+	    Serial.println("Line from gnhastd too long, discarding");
+	    _rx_len = 0;
+	    _rx_discard = (nl == NULL);
+	} else {
+	    memcpy(&_rxbuf[_rx_len], p, n);
+	    _rx_len += n;
+	    if (nl) {
+		_rx_line(_rxbuf, _rx_len);
+		_rx_len = 0;
+	    }
+	}
+
+	if (nl == NULL)
+	    break;
+	p = nl + 1;
+    }
+}
+
+/*
+ * One complete line, without the newline.  Find the verb and dispatch.
+ */
+
+void gnhast::_rx_line(const char *line, size_t len)
+{
+    const char *sp;
+    size_t vlen;
+    int i;
+
+    if (len && line[len - 1] == '\r')
+	len--;
+    if (len == 0)
+	return;
+
+    sp = (const char *)memchr(line, ' ', len);
+    vlen = sp ? sp - line : len;
+
+    for (i=0; _cmdtab[i].verb != NULL; i++) {
+	if (_cmdtab[i].len == vlen &&
+	    memcmp(_cmdtab[i].verb, line, vlen) == 0) {
+	    if (sp)
+		(this->*_cmdtab[i].func)(sp + 1, len - vlen - 1);
+	    else
+		(this->*_cmdtab[i].func)(line + len, 0);
+	    return;
+	}
+    }
+    if (_debug)
+	Serial.printf("Ignoring unknown command: %.*s\n", (int)len, line);
+}
+
+/*
+ * gnhastd wants to know if we are still here
+ */
+
+void gnhast::_gn_cmd_ping(const char *args, size_t len)
+{
+    if (_debug)
+	Serial.printf("Got ping\n");
+    /* 0 means no ping yet */
+    _last_ping = millis() | 1;
+    _srv_healthy();
+    if (_collector_is_healthy)
+	imalive();
+}
+
+/*
+ * Reply to our getapiv, nothing to do with it yet
+ */
+
+void gnhast::_gn_cmd_apiv(const char *args, size_t len)
+{
+    _boot_end(GN_BOOT_APIV);
+    _srv_answer();
+    if (_debug)
+	Serial.printf("gnhastd api: %.*s\n", (int)len, args);
+}
+
+/*
+ * gnhastd wants a device changed, chg uid:<uid> <key>:<value>.  Hand it
+ * to the device's callback, and confirm with an upd that jumps the queue.
+ */
+
+void gnhast::_gn_cmd_chg(const char *args, size_t len)
+{
+    const char *uid, *val;
+    size_t uidlen, vlen;
+    char num[GN_FMT_BUFSIZE];
+    gn_data_t data;
+    gn_dev_t *d;
+    int dev;
+
+    if (!gn_getarg(args, len, "uid", &uid, &uidlen)) {
+	Serial.println("chg without a uid, ignoring");
+	return;
+    }
+    for (dev=0; dev < _nrofdevs; dev++)
+	if (_devices[dev].uidlen == uidlen &&
+	    memcmp(_devices[dev].uid, uid, uidlen) == 0)
+	    break;
+    if (dev == _nrofdevs || _devices[dev].chg_cb == NULL) {
+	if (_debug)
+	    Serial.printf("chg for unknown or read-only uid %.*s\n",
+			  (int)uidlen, uid);
+	return;
+    }
+    d = &_devices[dev];
+
+    if (!gn_getarg(args, len, _dev_argtable[d->subtype], &val, &vlen) &&
+	!(d->type == DEVICE_DIMMER && gn_getarg(args, len, "dimmer",
+						&val, &vlen))) {
+	Serial.printf("chg for %s has no value we understand\n", d->uid);
+	return;
+    }
+    if (vlen >= sizeof(num))
+	vlen = sizeof(num) - 1;
+    memcpy(num, val, vlen);
+    num[vlen] = '\0';
+
+    switch (d->datatype) {
+    case DATATYPE_UINT:
+	data.u = strtoul(num, NULL, 10);
+	break;
+    case DATATYPE_DOUBLE:
+	data.d = strtod(num, NULL);
+	break;
+    case DATATYPE_LL:
+	data.u64 = strtoull(num, NULL, 10);
+	break;
+    }
+
+    if (_debug)
+	Serial.printf("chg device #%d to %s\n", dev, num);
+    /* a commanded value is not a sample, it skips the filters and the
+       aggregation window, so the confirming upd carries exactly what was
+       accepted, or the value we kept if the sketch refused it */
+    if (d->chg_cb(dev, data))
+	_gn_store(dev, data);
+    _gn_send_upd(dev, true);
+}
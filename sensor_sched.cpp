@@ -0,0 +1,96 @@
+/*
+ * Cooperative sensor scheduler.
+ *
+ * Slow sensors (a DS18B20 takes up to 750 ms per conversion) must not be
+ * waited on, neither from loop() nor from a timer callback, or the async
+ * tcp and web stacks stall with them.  Instead each sensor is split in two
+ * steps: start, which kicks off a conversion and says how long it takes,
+ * and read, which collects the result and stores it.  handle() runs
+ * whichever steps are due and never waits in between.  Sensors that have
+ * no conversion to start just pass a NULL start.  The values read in one
+ * pass go out together, as one flush_dirty() batch, subject to each
+ * device's reporting policy.
+ */
+
+#include "gnhast_async.h"
+
+/*!
+ * @brief Have handle() run a sensor every period ms.  start begins a
+ * conversion (it may be NULL) and returns ms until the result is ready,
+ * read collects it, store_data_dev()s it, and returns false if that
+ * failed.  Returns the sensor index, or -1 if there are too many.
+ */
+
+int gnhast::add_sensor(gn_sensor_start_t start, gn_sensor_read_t read,
+		       void *arg, uint32_t period)
+{
+    gn_sensor_t *s;
+
+    if (_nsensors == GN_MAX_SENSORS || read == NULL) {
+	Serial.println("Cannot add sensor");
+	return -1;
+    }
+    s = &_sensors[_nsensors];
+    s->start = start;
+    s->read = read;
+    s->arg = arg;
+    s->period = period;
+    s->fails = 0;
+    s->converting = 0;
+    /* spread the first runs out a little, so they do not all land at once */
+    s->due = millis() + _nsensors * 10;
+    return _nsensors++;
+}
+
+/*!
+ * @brief How many reads of a sensor failed in a row
+ */
+
+int gnhast::sensor_fails(int sensor)
+{
+    if (sensor < 0 || sensor >= _nsensors)
+	return 0;
+    return _sensors[sensor].fails;
+}
+
+/*
+ * Run the sensor steps that are due, from handle()
+ */
+
+void gnhast::_sensor_run(uint32_t now)
+{
+    gn_sensor_t *s;
+    int i, reads = 0;
+    uint32_t wait;
+
+    for (i=0; i < _nsensors; i++) {
+	s = &_sensors[i];
+	if ((int32_t)(now - s->due) < 0)
+	    continue;
+
+	if (!s->converting) {
+	    s->started = now;
+	    wait = s->start ? s->start(s->arg) : 0;
+	    if (wait) {
+		s->converting = 1;
+		s->due = now + wait;
+		continue;
+	    }
+	}
+
+	s->converting = 0;
+	if (s->read(s->arg))
+	    s->fails = 0;
+	else if (s->fails < 0xffff)
+	    s->fails++;
+	reads++;
+
+	/* keep the cadence, unless we fell a whole period behind */
+	s->due = s->started + s->period;
+	if ((int32_t)(now - s->due) >= 0)
+	    s->due = now + s->period;
+    }
+
+    if (reads)
+	flush_dirty();
+}
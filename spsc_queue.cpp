@@ -0,0 +1,87 @@
+/*
+ * Handing updates from timer and interrupt context to the network side.
+ *
+ * store_data_dev() and gn_update_device() touch the device table and the
+ * tx buffer, which the AsyncClient callbacks touch too, so calling them
+ * from an os_timer callback or an ISR races with the network code.
+ * post_data_dev() instead copies the value into a small single producer,
+ * single consumer ring of GN_SPSC_SIZE records, in O(1), without touching
+ * anything else, and handle() takes up to GN_SPSC_BATCH of them at a time
+ * and stores and sends them as one tx batch.  No locks: only the producer
+ * writes _spsc_head, only handle() writes _spsc_tail, and each publishes
+ * its offset after the record it covers is complete.
+ *
+ * One producer context only.  Post from a timer, or from one ISR, not
+ * both; an ISR interrupting a timer mid post would corrupt the ring.
+ */
+
+#include "gnhast_async.h"
+
+#if (GN_SPSC_SIZE & (GN_SPSC_SIZE - 1)) != 0
+#error "GN_SPSC_SIZE must be a power of two"
+#endif
+#define GN_SPSC_MASK (GN_SPSC_SIZE - 1)
+
+/* keep the compiler from moving loads and stores across the publish,
+   the ESP8266 has a single core that does not reorder them itself */
+#define GN_SPSC_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+/*!
+ * @brief Store a value from timer or interrupt context, handle() sends
+ * it.  Returns false if dev is not a device, or, counting it, if the
+ * queue is full.
+ */
+
+bool IRAM_ATTR gnhast::post_data_dev(int dev, gn_data_t data)
+{
+    uint32_t head = _spsc_head;
+    gn_updrec_t *r;
+
+    if (dev < 0 || dev >= _nrofdevs)
+	return false;
+    if (head - _spsc_tail == GN_SPSC_SIZE) {
+	_spsc_dropped++;
+	return false;
+    }
+    r = &_spsc[head & GN_SPSC_MASK];
+    r->dev = dev;
+    r->us = micros();
+    r->data = data;
+    GN_SPSC_BARRIER();
+    _spsc_head = head + 1;
+    return true;
+}
+
+/*
+ * Store and send the next batch of posted updates, from handle()
+ */
+
+void gnhast::_spsc_drain()
+{
+    uint32_t tail = _spsc_tail, head = _spsc_head;
+    gn_updrec_t *r;
+    gn_dev_t *d;
+    int n;
+
+    if (head == tail)
+	return;
+    GN_SPSC_BARRIER();
+    if (head - tail > _spsc_hiwat)
+	_spsc_hiwat = head - tail;
+
+    _tx_hold = true;
+    for (n=0; tail != head && n < GN_SPSC_BATCH; n++, tail++) {
+	r = &_spsc[tail & GN_SPSC_MASK];
+	if (r->dev >= _nrofdevs)
+	    continue;
+	d = &_devices[r->dev];
+	store_data_dev(r->dev, r->data);
+	/* it was stored when it was posted, not now */
+	d->stored = r->us;
+	gn_update_device(r->dev);
+    }
+    GN_SPSC_BARRIER();
+    _spsc_tail = tail;
+    _tx_hold = false;
+    _tx_drain();
+}
@@ -0,0 +1,299 @@
+/*
+ * Outbound ring buffer.
+ *
+ * Every line we send to gnhastd (client, reg, upd, mod, imalive) is queued
+ * here, and drained into the AsyncClient as the tcp window allows.  Only
+ * one batch is in flight at a time, so a burst of updates piles up in the
+ * ring while the previous batch is being acked, and goes out in as few
+ * segments as possible.  If the ring fills, whole lines are dropped and
+ * counted, we never block or overrun the lwIP send window.
+ *
+ * Lines that must not wait behind queued telemetry (the upd confirming a
+ * chg) go into the small _tx_prio buffer instead, which jumps the queue at
+ * the next line boundary and is sent without waiting for acks.  A line tcp
+ * only took part of is finished first, so the two never interleave.
+ */
+
+#include "gnhast_async.h"
+
+#if (GN_TXBUF_SIZE & (GN_TXBUF_SIZE - 1)) != 0
+#error "GN_TXBUF_SIZE must be a power of two"
+#endif
+#define GN_TXBUF_MASK (GN_TXBUF_SIZE - 1)
+
+/*!
+ * @brief Copy the outbound buffer counters, and what is in the buffer
+ * and in flight right now
+ */
+
+void gnhast::get_txstats(gn_txstats_t *st)
+{
+    *st = _txstats;
+    st->waiting = (_tx_wr - _tx_snd) + _tx_prio_len;
+    st->inflight = _tx_inflight;
+}
+
+/*!
+ * @brief Queue a line of your own for gnhastd, without the newline.  This
+ * replaces writing to gnhast.ap, which went around the buffer and could
+ * land in the middle of a queued line.
+ * @return false if not connected, or the line was dropped
+ */
+
+bool gnhast::send_line(const char *line)
+{
+    if (_conn_state != GN_CONN_UP)
+	return false;
+    return _tx_line(line);
+}
+
+/*
+ * Line encoder.  Protocol lines are written straight into the ring, at the
+ * write offset, and only become visible to the drain when _ln_end()
+ * commits them.  Nothing is formatted into a temporary buffer first, and
+ * a line that does not fit is dropped as a whole.
+ */
+
+void gnhast::_ln_begin(bool prio)
+{
+    _ln_len = 0;
+    _ln_ovf = false;
+    _ln_prio = prio;
+}
+
+void gnhast::_ln_put(const char *buf, size_t len)
+{
+    size_t idx, first;
+
+    if (_ln_ovf)
+	return;
+    if (_ln_prio) {
+	if (_tx_prio_len + _ln_len + len > GN_TXPRIO_SIZE) {
+	    _ln_ovf = true;
+	    return;
+	}
+	memcpy(&_tx_prio[_tx_prio_len + _ln_len], buf, len);
+	_ln_len += len;
+	return;
+    }
+    if ((_tx_wr - _tx_snd) + _ln_len + len > GN_TXBUF_SIZE) {
+	_ln_ovf = true;
+	return;
+    }
+    idx = (_tx_wr + _ln_len) & GN_TXBUF_MASK;
+    first = GN_TXBUF_SIZE - idx;
+    if (first > len)
+	first = len;
+    memcpy(&_txbuf[idx], buf, first);
+    memcpy(_txbuf, buf + first, len - first);
+    _ln_len += len;
+}
+
+void gnhast::_ln_puts(const char *str)
+{
+    _ln_put(str, strlen(str));
+}
+
+void gnhast::_ln_putc(char c)
+{
+    _ln_put(&c, 1);
+}
+
+/*
+ * Unsigned decimal, zero padded to at least width digits
+ */
+
+void gnhast::_ln_putu(uint32_t val, int width)
+{
+    char buf[10];
+    int i = sizeof(buf);
+
+    do {
+	buf[--i] = '0' + (val % 10);
+	val /= 10;
+	width--;
+    } while (val || (width > 0 && i > 0));
+    _ln_put(&buf[i], sizeof(buf) - i);
+}
+
+/*
+ * Terminate and commit the line being built, and kick the drain
+ */
+
+bool gnhast::_ln_end()
+{
+    uint32_t used = _tx_wr - _tx_snd;
+    size_t idx, first;
+
+    _ln_putc('\n');
+    if (_ln_ovf) {
+	_txstats.dropped += _ln_len;
+	_txstats.drop_lines++;
+	if (_debug)
+	    Serial.println("tx buffer full, dropping line");
+	return false;
+    }
+
+    if (_ln_prio) {
+	if (_debug)
+	    Serial.write((uint8_t *)&_tx_prio[_tx_prio_len], _ln_len);
+	_tx_prio_len += _ln_len;
+	_txstats.queued += _ln_len;
+	_tx_drain();
+	return true;
+    }
+
+    if (_debug) {
+	idx = _tx_wr & GN_TXBUF_MASK;
+	first = GN_TXBUF_SIZE - idx;
+	if (first > _ln_len)
+	    first = _ln_len;
+	Serial.write((uint8_t *)&_txbuf[idx], first);
+	Serial.write((uint8_t *)_txbuf, _ln_len - first);
+    }
+
+    _tx_wr += _ln_len;
+    _txstats.queued += _ln_len;
+    if (used + _ln_len > _txstats.hiwat)
+	_txstats.hiwat = used + _ln_len;
+
+    if (!_tx_hold)
+	_tx_drain();
+    return true;
+}
+
+/*
+ * How many bytes the ring can still take
+ */
+
+size_t gnhast::_tx_free()
+{
+    return GN_TXBUF_SIZE - (_tx_wr - _tx_snd);
+}
+
+/*
+ * Queue a constant line, no newline needed
+ */
+
+bool gnhast::_tx_line(const char *str)
+{
+    _ln_begin();
+    _ln_puts(str);
+    return _ln_end();
+}
+
+/*
+ * Hand as much of the ring to tcp as it will take.  Called when a line is
+ * queued, when we connect, and whenever gnhastd acks.
+ */
+
+void gnhast::_tx_drain()
+{
+    size_t room, chunk, idx, added, n;
+    bool pushed = false;
+    bool eol;
+
+    if (client == NULL || !client->connected())
+	return;
+
+    /*
+     * Priority lines may only go in between lines, so if tcp took part of
+     * a line, finish that line first, whatever is in flight.  Otherwise
+     * wait for the previous batch, so the next one coalesces.
+     */
+    eol = (_tx_midline && _tx_prio_len);
+    if (eol || (_tx_inflight == 0 && _tx_prio_len == 0)) {
+	while (_tx_snd != _tx_wr) {
+	    room = client->space();
+	    if (room == 0)
+		break;
+	    idx = _tx_snd & GN_TXBUF_MASK;
+	    chunk = _tx_wr - _tx_snd;
+	    if (chunk > GN_TXBUF_SIZE - idx)
+		chunk = GN_TXBUF_SIZE - idx;
+	    if (eol) {
+		for (n=0; n < chunk && _txbuf[idx + n] != '\n'; n++)
+		    ;
+		if (n < chunk)
+		    chunk = n + 1;
+	    }
+	    if (chunk > room)
+		chunk = room;
+	    added = client->add(&_txbuf[idx], chunk, ASYNC_WRITE_FLAG_COPY);
+	    if (added == 0)
+		break;
+	    _tx_snd += added;
+	    _tx_inflight += added;
+	    _txstats.sent += added;
+	    _tx_midline = (_txbuf[(_tx_snd - 1) & GN_TXBUF_MASK] != '\n');
+	    pushed = true;
+	    if (eol && !_tx_midline)
+		break;
+	}
+    }
+
+    /* priority lines do not wait for acks */
+    if (_tx_prio_len && !_tx_midline) {
+	room = client->space();
+	if (room > _tx_prio_len)
+	    room = _tx_prio_len;
+	added = room ? client->add(_tx_prio, room, ASYNC_WRITE_FLAG_COPY) : 0;
+	if (added) {
+	    _tx_prio_len -= added;
+	    memmove(_tx_prio, &_tx_prio[added], _tx_prio_len);
+	    _tx_inflight += added;
+	    _txstats.sent += added;
+	    pushed = true;
+	}
+    }
+
+    if (pushed) {
+	client->send();
+	_perf_progress();
+    }
+
+    if (_tx_closing && _tx_snd == _tx_wr && _tx_prio_len == 0) {
+	_tx_closing = false;
+	client->close();
+    }
+}
+
+/*
+ * Throw away anything not yet handed to tcp, used when the link goes away.
+ */
+
+void gnhast::_tx_reset()
+{
+    uint32_t i;
+
+    for (i = _tx_snd; i != _tx_wr; i++)
+	if (_txbuf[i & GN_TXBUF_MASK] == '\n')
+	    _txstats.drop_lines++;
+    _txstats.dropped += _tx_wr - _tx_snd;
+    _tx_snd = _tx_wr;
+    for (i = 0; i < _tx_prio_len; i++)
+	if (_tx_prio[i] == '\n')
+	    _txstats.drop_lines++;
+    _txstats.dropped += _tx_prio_len;
+    _tx_prio_len = 0;
+    _tx_midline = false;
+    _tx_inflight = 0;
+    _tx_closing = false;
+    _perf_forget();
+}
+
+/*
+ * gnhastd acked some data, send the next batch
+ */
+
+void gnhast::__gn_gotack(void *arg, AsyncClient *c, size_t len,
+			 uint32_t time)
+{
+    if (len > _tx_inflight)
+	len = _tx_inflight;
+    _tx_inflight -= len;
+    _txstats.acked += len;
+    _perf_progress();
+    _tx_drain();
+    _gn_pump();
+}
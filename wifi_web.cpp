@@ -4,41 +4,21 @@
 
 #include "gnhast_async.h"
 
-/* read the settings file */
+/* read the settings file, into the config cache */
 
 void gnhast::_read_settings_conf()
 {
-    DynamicJsonDocument json_doc = parse_json_conf("/config.json");
-
-    if (json_doc["gnhast_server"] && json_doc["gnhast_port"]) {
-	strcpy(_gnhast_server, json_doc["gnhast_server"]);
-	strcpy(_gnhast_port_str, json_doc["gnhast_port"]);
-	Serial.printf("From config /config.json:\nGnhast Server: %s:%s\n",
-		      _gnhast_server, _gnhast_port_str);
-    }
+    _cfg_load();
+    Serial.printf("Gnhast Server: %s:%s\n", _gnhast_server, _gnhast_port_str);
 }
 
 /*
- * Save the basic settings
+ * Save the basic settings, written from handle() if they changed
  */
 
 void gnhast::_save_settings_conf()
 {
-    DynamicJsonDocument json_doc(JSON_CONFIG_FILE_SIZE);
-
-    Serial.println("saving config");
-    json_doc["gnhast_server"] = _gnhast_server;
-    json_doc["gnhast_port"] = _gnhast_port_str;
-    
-    File configFile = SPIFFS.open("/config.json", "w");
-    if (!configFile) {
-	Serial.println("failed to open config file for writing");
-    }
-
-    if (_debug)
-	serializeJson(json_doc, Serial);
-    serializeJson(json_doc, configFile);
-    configFile.close();
+    _cfg_touch(GN_CFG_SETTINGS);
 }
 
 /* callback telling us to save the config */
@@ -55,6 +35,9 @@ void gnhast::saveConfigCallback()
 void gnhast::init_wifi()
 {
     char ap_name[32];
+    uint32_t start;
+
+    _boot_begin(GN_BOOT_WIFI);
 
     /* Things that we will ask the user for */
     AsyncWiFiManagerParameter custom_gnhast_server("gn_server", "Gnhast Server",
@@ -85,16 +68,32 @@ void gnhast::init_wifi()
 
     snprintf(ap_name, 32, "%s-%d", AP_NAME, ESP.getChipId());
     
-    if (!wifiManager.autoConnect(ap_name, AP_PASSWORD)) {
-	Serial.println("Failed to connect and hit timeout");
-	delay(6000);
-	ESP.reset(); /* woo, that's harsh */
-	delay(5000);
+    _boot_begin(GN_BOOT_AUTOCONNECT);
+    /* try the cached AP and lease first, it skips the scan and DHCP */
+    if (_wifi_fast_begin()) {
+	start = millis();
+	while (WiFi.status() != WL_CONNECTED &&
+	       millis() - start < GN_WIFI_FAST_TIMEOUT)
+	    delay(10);
+	if (WiFi.status() != WL_CONNECTED)
+	    _wifi_fast_failed();
     }
-    /* read the gnhast settings */
-    strcpy(_gnhast_server, custom_gnhast_server.getValue());
-    strcpy(_gnhast_port_str, custom_gnhast_port.getValue());
-    _port = atoi(_gnhast_port_str);
+    if (WiFi.status() == WL_CONNECTED) {
+	_port = atoi(_gnhast_port_str);
+    } else {
+	if (!wifiManager.autoConnect(ap_name, AP_PASSWORD)) {
+	    Serial.println("Failed to connect and hit timeout");
+	    delay(6000);
+	    ESP.reset(); /* woo, that's harsh */
+	    delay(5000);
+	}
+	/* read the gnhast settings */
+	strcpy(_gnhast_server, custom_gnhast_server.getValue());
+	strcpy(_gnhast_port_str, custom_gnhast_port.getValue());
+	_port = atoi(_gnhast_port_str);
+    }
+    _boot_end(GN_BOOT_AUTOCONNECT);
+    _fc_wifi_up();
 
     /* Let's save these to disk */
     if (shouldSaveConfig)
@@ -107,6 +106,190 @@ void gnhast::init_wifi()
     Serial.println(WiFi.localIP());
     Serial.println(WiFi.gatewayIP());
     Serial.println(WiFi.subnetMask());
+    /*
+     * wifiManager and its parameters go away when we return.  handle()
+     * still watches the link, but only init_wifi_async() sets up what the
+     * modeless portal needs, so here losing the wifi just means retrying.
+     */
+    wifimgr = NULL;
+    _wifi_portal_after = 0;
+    _wifi_state = GN_WIFI_UP;
+    _boot_end(GN_BOOT_WIFI);
+}
+
+/*!
+ * @brief Bring up the wifi in the background, instead of blocking
+ * Connects with the credentials the ESP remembers, and returns at once,
+ * handle() finishes the job.  Sensors can run right away, their updates
+ * are queued until gnhastd is reachable.  After portal_after failed
+ * attempts of GN_WIFI_TIMEOUT ms each (or right away if we have never
+ * been configured), the captive portal is started, without blocking
+ * either, and we keep trying the old network meanwhile.
+ */
+
+void gnhast::init_wifi_async(int portal_after)
+{
+    _boot_begin(GN_BOOT_WIFI);
+    _boot_begin(GN_BOOT_AUTOCONNECT);
+    _read_settings_conf();
+    _port = atoi(_gnhast_port_str);
+    _wifi_portal_after = portal_after;
+    _wifi_fails = 0;
+
+    server = new AsyncWebServer(80);
+
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
+    if (WiFi.SSID().length() == 0) {
+	Serial.println("No wifi configured");
+	_wifi_portal();
+	return;
+    }
+    _wifi_begin();
+}
+
+/*!
+ * @brief Where the wifi is at, see enum gn_wifi_state
+ */
+
+int gnhast::wifi_state()
+{
+    return _wifi_state;
+}
+
+/*
+ * Start (another) attempt to join the remembered network
+ */
+
+void gnhast::_wifi_begin()
+{
+    _wifi_started = millis();
+    if (_wifi_fails == 0 && _wifi_state != GN_WIFI_PORTAL &&
+	_wifi_fast_begin()) {
+	_wifi_state = GN_WIFI_CONNECTING;
+	return;
+    }
+    Serial.printf("Connecting to wifi %s\n", WiFi.SSID().c_str());
+    WiFi.begin();
+    if (_wifi_state != GN_WIFI_PORTAL)
+	_wifi_state = GN_WIFI_CONNECTING;
+}
+
+/*
+ * Give up waiting, and offer the captive portal.  Modeless, so sampling
+ * and queueing go on while somebody finds the AP.
+ */
+
+void gnhast::_wifi_portal()
+{
+    char ap_name[32];
+
+    if (wifimgr == NULL) {
+	wifimgr = new AsyncWiFiManager(server, &dns);
+	_wifi_param_server = new AsyncWiFiManagerParameter("gn_server",
+							   "Gnhast Server",
+							   _gnhast_server, 79);
+	_wifi_param_port = new AsyncWiFiManagerParameter("gn_port",
+							 "Gnahst port",
+							 _gnhast_port_str, 7);
+	wifimgr->setDebugOutput(true);
+	wifimgr->setMinimumSignalQuality();
+	wifimgr->addParameter(_wifi_param_server);
+	wifimgr->addParameter(_wifi_param_port);
+    }
+    snprintf(ap_name, 32, "%s-%d", AP_NAME, ESP.getChipId());
+    Serial.printf("Starting config portal %s\n", ap_name);
+    wifimgr->startConfigPortalModeless(ap_name, AP_PASSWORD);
+    _wifi_state = GN_WIFI_PORTAL;
+    _wifi_started = millis();
+}
+
+/*
+ * The wifi is up (again)
+ */
+
+void gnhast::_wifi_up()
+{
+    if (_wifi_state == GN_WIFI_PORTAL) {
+	/* the portal may have new gnhastd settings for us */
+	snprintf(_gnhast_server, sizeof(_gnhast_server), "%s",
+		 _wifi_param_server->getValue());
+	snprintf(_gnhast_port_str, sizeof(_gnhast_port_str), "%s",
+		 _wifi_param_port->getValue());
+	_port = atoi(_gnhast_port_str);
+	if (strcmp(_server, _gnhast_server) != 0)
+	    init_server();
+	_save_settings_conf();
+	WiFi.mode(WIFI_STA);
+    }
+    _wifi_state = GN_WIFI_UP;
+    _wifi_fails = 0;
+    _fc_wifi_up();
+    Serial.print("Wifi is connected, local ip ");
+    Serial.println(WiFi.localIP());
+    _boot_end(GN_BOOT_AUTOCONNECT);
+    _boot_end(GN_BOOT_WIFI);
+}
+
+/*
+ * Drive the background wifi bring-up, from handle()
+ */
+
+void gnhast::_wifi_poll(uint32_t now)
+{
+    bool connected;
+
+    if (_wifi_state == GN_WIFI_NONE)
+	return;
+    connected = (WiFi.status() == WL_CONNECTED);
+
+    switch (_wifi_state) {
+    case GN_WIFI_UP:
+	if (!connected) {
+	    Serial.println("Lost wifi");
+	    /* the SDK reconnects by itself, we just time it */
+	    _wifi_state = GN_WIFI_CONNECTING;
+	    _wifi_started = now;
+	}
+	break;
+    case GN_WIFI_PORTAL:
+	wifimgr->loop();
+	/* FALLTHROUGH */
+    case GN_WIFI_CONNECTING:
+	if (connected) {
+	    _wifi_up();
+	    break;
+	}
+	if (_wifi_fast) {
+	    if (now - _wifi_started >= GN_WIFI_FAST_TIMEOUT) {
+		_wifi_fast_failed();
+		_wifi_begin();
+	    }
+	    break;
+	}
+	if (now - _wifi_started < GN_WIFI_TIMEOUT)
+	    break;
+	_wifi_fails++;
+	Serial.printf("Wifi not up after %d tries\n", _wifi_fails);
+	if (_wifi_state == GN_WIFI_CONNECTING && _wifi_portal_after > 0 &&
+	    _wifi_fails >= _wifi_portal_after)
+	    _wifi_portal();
+	else if (WiFi.SSID().length())
+	    _wifi_begin();
+	else
+	    _wifi_started = now;
+	break;
+    }
+}
+
+/*
+ * Can we talk to the network?  If the sketch brings up wifi itself, we
+ * have to assume so.
+ */
+
+bool gnhast::_wifi_ready()
+{
+    return _wifi_state == GN_WIFI_NONE || _wifi_state == GN_WIFI_UP;
 }
 
 /********************  Over the air update code ********************/
@@ -146,7 +329,8 @@ void gnhast::handleDoUpdate(AsyncWebServerRequest *request,
     if (Update.write(data, len) != len) {
 	Update.printError(Serial);
     } else {
-	Serial.printf("Progress: %d%%\n", (Update.progress()*100)/Update.size());
+	Serial.printf("Progress: %u%%\n",
+		      (unsigned)((Update.progress()*100)/Update.size()));
     }
 
     if (final) {
@@ -158,6 +342,7 @@ void gnhast::handleDoUpdate(AsyncWebServerRequest *request,
 	    Update.printError(Serial);
 	} else {
 	    Serial.println("Update complete");
+	    config_commit();
 	    Serial.flush();
 	    shouldReboot = true;
 	}
@@ -177,6 +362,7 @@ void gnhast::handle_reboot(AsyncWebServerRequest *request)
     request->send(response);
 
     Serial.println("Reboot Requested");
+    config_commit();
     Serial.flush();
     shouldReboot = true;
 }
@@ -209,6 +395,7 @@ void gnhast::handle_modcfg(AsyncWebServerRequest *request)
 	    return;
 	}
 	dev = get_dev_byindex(devidx);
+	free(dev->name);
 	dev->name = strdup(devname->value().c_str());
     } else {
 	request->send(200, "text/html", fail);
@@ -225,6 +412,20 @@ void gnhast::handle_modcfg(AsyncWebServerRequest *request)
     request->send(200, "text/html", done);
 }
 
+/*
+ * Handle a config import, the json is in the "config" form field
+ */
+
+void gnhast::handle_cfgimport(AsyncWebServerRequest *request)
+{
+    if (!request->hasParam("config", true) ||
+	!config_import(request->getParam("config", true)->value().c_str())) {
+	request->send(200, "text/html", "<p>Bad config</p><br><a href=\"/\">Back to main Page</a>");
+	return;
+    }
+    request->send(200, "text/html", "<p>Config imported</p><br><a href=\"/\">Back to main Page</a>");
+}
+
 /* File type handler */
 
 String gnhast::getContentType(String filename)
@@ -250,6 +451,7 @@ String gnhast::getContentType(String filename)
 
 boolean gnhast::init_webserver()
 {
+    _boot_begin(GN_BOOT_WEBSERVER);
     server->on("/update", HTTP_GET, [this](AsyncWebServerRequest *request){handleUpdate(request);});
     server->on("/doUpdate", HTTP_POST,
 	      [this](AsyncWebServerRequest *request) {},
@@ -258,15 +460,39 @@ boolean gnhast::init_webserver()
   );
     server->on("/modcfg", HTTP_POST, [this](AsyncWebServerRequest *request){handle_modcfg(request);});
 
+    server->on("/cfg_export", HTTP_GET, [this](AsyncWebServerRequest *request)
+	       {
+		   AsyncResponseStream *response = request->beginResponseStream("application/json");
+		   config_export(*response);
+		   request->send(response);
+	       });
+    server->on("/cfg_import", HTTP_POST, [this](AsyncWebServerRequest *request){handle_cfgimport(request);});
+
+    server->on("/boot", HTTP_GET, [this](AsyncWebServerRequest *request)
+	       {
+		   AsyncResponseStream *response = request->beginResponseStream("application/json");
+		   boot_json(*response);
+		   request->send(response);
+	       });
+
+    server->on("/stats", HTTP_GET, [this](AsyncWebServerRequest *request)
+	       {
+		   AsyncResponseStream *response = request->beginResponseStream("application/json");
+		   perf_json(*response);
+		   request->send(response);
+	       });
+
     server->on("/reboot_coll", HTTP_GET, [this](AsyncWebServerRequest *request){handle_reboot(request);});
 
     server->on("/reconfig", HTTP_GET, [this](AsyncWebServerRequest *request)
 	       {
 		   Serial.println("Resetting WiFi");
-		   if (wifimgr != NULL) {
-		       shouldReboot = true;
+		   shouldReboot = true;
+		   /* all resetSettings() does, and init_wifi() has none */
+		   if (wifimgr != NULL)
 		       wifimgr->resetSettings();
-		   }
+		   else
+		       WiFi.disconnect(true);
 		   AsyncWebServerResponse *response = request->beginResponse(302, "text/plain", "Please wait while the device resets");
 		   response->addHeader("Refresh", "1");
 		   response->addHeader("Location", "/");
@@ -281,4 +507,6 @@ boolean gnhast::init_webserver()
 		request->send(404, "text/plain", "404: Not Found");
 	});
     server->begin();
+    _boot_end(GN_BOOT_WEBSERVER);
+    return true;
 }